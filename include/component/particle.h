@@ -101,55 +101,11 @@ public:
            , is_kinetic_energy_valid(false)
            {}
 
-  Particle(const Particle<V>& other) {
-    this->m_velocity = other.m_velocity;
-    this->m_position = other.m_position;
-    this->m_radius = other.m_radius;
-    this->m_mass = other.m_mass;
-    this->m_inverse_mass = other.m_inverse_mass;
-    this->is_inverse_mass_valid = other.is_inverse_mass_valid;
-    this->m_kinetic_energy = other.m_kinetic_energy;
-    this->is_kinetic_energy_valid = other.is_kinetic_energy_valid;
-    this->uid = other.uid;
-  }
-
-  Particle(Particle<V>&& other) {
-    this->m_velocity = other.m_velocity;
-    this->m_position = other.m_position;
-    this->m_radius = other.m_radius;
-    this->m_mass = other.m_mass;
-    this->m_inverse_mass = other.m_inverse_mass;
-    this->is_inverse_mass_valid = other.is_inverse_mass_valid;
-    this->m_kinetic_energy = other.m_kinetic_energy;
-    this->is_kinetic_energy_valid = other.is_kinetic_energy_valid;
-    this->uid = other.uid;
-  }
-
-  Particle& operator=(const Particle<V>& other) {
-    this->m_velocity = other.m_velocity;
-    this->m_position = other.m_position;
-    this->m_radius = other.m_radius;
-    this->m_mass = other.m_mass;
-    this->m_inverse_mass = other.m_inverse_mass;
-    this->is_inverse_mass_valid = other.is_inverse_mass_valid;
-    this->m_kinetic_energy = other.m_kinetic_energy;
-    this->is_kinetic_energy_valid = other.is_kinetic_energy_valid;
-    this->uid = other.uid;
-    return *this;
-  }
-
-  Particle& operator=(Particle<V>&& other) {
-    this->m_velocity = other.m_velocity;
-    this->m_position = other.m_position;
-    this->m_radius = other.m_radius;
-    this->m_mass = other.m_mass;
-    this->m_inverse_mass = other.m_inverse_mass;
-    this->is_inverse_mass_valid = other.is_inverse_mass_valid;
-    this->m_kinetic_energy = other.m_kinetic_energy;
-    this->is_kinetic_energy_valid = other.is_kinetic_energy_valid;
-    this->uid = other.uid;
-    return *this;
-  }
+  // plain data, so a frame of particles can be copied and diffed by its bytes (see Util::FrameHistory)
+  Particle(const Particle<V>&) = default;
+  Particle(Particle<V>&&) = default;
+  Particle& operator=(const Particle<V>&) = default;
+  Particle& operator=(Particle<V>&&) = default;
 
   // get a copy of this particle's position vector
   const V& position() const { return m_position; };
@@ -169,6 +125,36 @@ public:
 
   void set_position(const V&);
 
+  // When this particle next reaches a wall, in simulation seconds. Free flight doesn't change it, so it's
+  // only worked out again once the velocity changes. See PhysicsContext::bounce()
+  bool wall_time_valid() const { return is_wall_time_valid; }
+
+  double wall_time() const { return m_wall_time; }
+
+  void set_wall_time(double t) {
+    m_wall_time = t;
+    is_wall_time_valid = true;
+  }
+
+  // How many steps in a row this particle has been nearly still
+  uint32_t rest_steps() const { return m_rest_steps; }
+
+  void set_rest_steps(uint32_t steps) { m_rest_steps = steps; }
+
+  // Sleeping particles are left out of gravity, stepping and bouncing until something knocks them.
+  // island is the uid of someone they fell asleep touching, so a pile wakes up together
+  bool asleep() const { return m_island != 0; }
+
+  size_t island() const { return m_island; }
+
+  // go to sleep, and stop dead
+  void sleep(size_t island);
+
+  void wake() {
+    m_island = 0;
+    m_rest_steps = 0;
+  }
+
   // UID for this particle
   // 0 is an invalid UID
   Util::LatchingValue<size_t> uid;
@@ -193,6 +179,14 @@ private:
   vector_t m_kinetic_energy;
   // is it valid?
   bool is_kinetic_energy_valid;
+  // steps spent nearly still
+  uint32_t m_rest_steps = 0;
+  // 0 while awake, see asleep()
+  size_t m_island = 0;
+  // next wall contact
+  double m_wall_time = 0;
+  // is it valid?
+  bool is_wall_time_valid = false;
 };
 
 // Particle == Particle
@@ -28,43 +28,14 @@ public:
         : m_x(x)
         , m_y(y)
         , m_z(z)
-        , is_mag_valid(false)
-        , m_magnitude(0)
+        , m_magnitude(-1)
         {}
 
-  Vector(const Vector<T>& other) {
-    this->m_x = other.m_x;
-    this->m_y = other.m_y;
-    this->m_z = other.m_z;
-    this->is_mag_valid = other.is_mag_valid;
-    this->m_magnitude = other.m_magnitude;
-  }
-
-  Vector(Vector<T>&& other) {
-    this->m_x = other.m_x;
-    this->m_y = other.m_y;
-    this->m_z = other.m_z;
-    this->is_mag_valid = other.is_mag_valid;
-    this->m_magnitude = other.m_magnitude;
-  }
-
-  Vector& operator=(const Vector<T>& other) {
-    this->m_x = other.m_x;
-    this->m_y = other.m_y;
-    this->m_z = other.m_z;
-    this->is_mag_valid = other.is_mag_valid;
-    this->m_magnitude = other.m_magnitude;
-    return *this;
-  }
-
-  Vector& operator=(Vector<T>&& other) {
-    this->m_x = other.m_x;
-    this->m_y = other.m_y;
-    this->m_z = other.m_z;
-    this->is_mag_valid = other.is_mag_valid;
-    this->m_magnitude = other.m_magnitude;
-    return *this;
-  }
+  // plain data, so a frame of particles can be copied and diffed by its bytes (see Util::FrameHistory)
+  Vector(const Vector<T>&) = default;
+  Vector(Vector<T>&&) = default;
+  Vector& operator=(const Vector<T>&) = default;
+  Vector& operator=(Vector<T>&&) = default;
 
   // get a unit vector
   Vector unit_vector() const;
@@ -101,7 +72,8 @@ private:
   T m_y;
   T m_z;
 
-  bool is_mag_valid;
+  // negative until magnitude() works it out. No separate flag, a bool would leave padding behind it which
+  // every copy fills with whatever was on the stack, and frames are diffed by their bytes.
   T m_magnitude;
 };
 
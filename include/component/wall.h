@@ -42,6 +42,7 @@ public:
   const vector_t position() const { return position_n; }
   const V& normal() const { return normal_vector; }
   const V& inverse() const { return inverse_vector; }
+  WallIdx index() const { return idx; }
 
   template <typename Vv>
   friend std::ostream& operator<<(std::ostream &os, const Wall<Vv>&);
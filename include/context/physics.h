@@ -1,11 +1,14 @@
 #pragma once
 #include "component.h"
 #include "context.h"
+#include "physics/barnes_hut.h"
 #include "sim_settings.h"
+#include "util/energy_ledger.h"
 #include "util/latch.h"
 #include "util/status.h"
 
 #include <cmath>
+#include <cstdint>
 #include <memory>
 
 // Functions for physical interactions
@@ -22,7 +25,7 @@ class PhysicsContext {
 typedef typename V::vector_t vector_t;
 
 public:
-  PhysicsContext() : m_settings(Simulation::DefaultSettings<vector_t>) {}
+  PhysicsContext() : PhysicsContext(Simulation::DefaultSettings<vector_t>) {}
 
   PhysicsContext(Simulation::SimSettings<vector_t> settings)
                    : m_settings(settings)
@@ -33,52 +36,107 @@ public:
                                    sin(static_cast<vector_t>(M_PI) *
                                      static_cast<vector_t>(m_settings.get().gravity_angle) / static_cast<vector_t>(180)),
                                  0))
-                    ,in_replay_mode(false)
-                  {}
-
-  // Collide one particle into another
-  // Status::None if no collision occurred (too far away)
+                  {
+                    // the fastest a particle can go at each level and still move no more than radius_min a sub-step
+                    const auto step_s = time_scalar<vector_t>(SIM_RESOLUTION_US);
+                    for (size_t level = 0; level <= m_settings.get().max_substep_level; level++) {
+                      m_substep_limits.push_back(m_settings.get().radius_min *
+                                                 static_cast<vector_t>(static_cast<double>(1UL << level)) / step_s);
+                    }
+                    m_substep_reach = m_settings.get().radius_min + m_settings.get().radius_min;
+                  }
+
+  // Work out how far any two particles could have closed on each other over the step which just ran,
+  // so collide() can rule out pairs with a compare or two. Call once a step, before colliding anything.
+  // Particles with a non-zero level (see substep_level()) had their collisions sub-stepped and don't count.
+  void prepare_collisions(const std::vector<Component::Particle<V>>&, const std::vector<uint8_t>& levels = {});
+
+  // Collide one particle into another, anywhere along their paths over the step which just ran.
+  // The pair is wound back to the moment they touched, bounced, and carried forward to the end of the step again.
+  // Status::None if no collision occurred (too far away, or already moving apart)
   // Status::Success if a collision occurred
-  // Status::Corrected if we encountered an error but were able to correct for it.
-  // Status::Inconsistent if we encountered an error but were unable to correct for it.
-  // O3 optimized because this is a hyper critical loop, and doing so results in
-  // inlining all the vector operations, yielding a 5-10x performance increase overall
-  #if defined(__clang__)
-  #elif defined(__GNUC__)
-  __attribute__((optimize(3)))
-  #endif
-  Status collide(Component::Particle<V>&, Component::Particle<V>&);
+  Status collide(Component::Particle<V>& a, Component::Particle<V>& b) {
+    return sweep(a, b, SIM_RESOLUTION_S, m_reach);
+  }
+
+  // The same, but only over the last sub-step at this level. For particles stepped with substep_level(),
+  // which between them can't have closed more than 2 * radius_min over it.
+  Status collide(Component::Particle<V>& a, Component::Particle<V>& b, size_t level) {
+    return sweep(a, b, SIM_RESOLUTION_S / static_cast<double>(1UL << level), m_substep_reach);
+  }
+
+  // How many times to halve the step for this particle, so it doesn't move more than radius_min at once.
+  // 0 for the vast majority, who step once like always.
+  size_t substep_level(const Component::Particle<V>&) const;
+
+  // Bounce a particle off the walls, now being the simulation time (in seconds) its position is for.
+  // Compares against the particle's cached time of impact and returns right away if it hasn't come yet.
+  // A particle which went through a wall is mirrored back inside, so nothing tunnels out at any speed.
+  // Returns how many bounces that was, 0 if it's nowhere near a wall.
+  size_t bounce(Component::Particle<V>&, const std::array<Component::Wall<V>, Component::WallIdx::SIZE>&, double now);
+
+  // kinetic energy as the ledger counts it, in double whatever we simulate in
+  static double ledger_energy(const Component::Particle<V>& p) {
+    const auto& v = p.velocity();
+    const double x = static_cast<double>(v.x());
+    const double y = static_cast<double>(v.y());
+    const double z = static_cast<double>(v.z());
+    return 0.5 * static_cast<double>(p.mass()) * (x * x + y * y + z * z);
+  }
+
+  // what collisions and bounces have done to the energy
+  Util::EnergyLedger& ledger() { return m_ledger; }
+  const Util::EnergyLedger& ledger() const { return m_ledger; }
 
-  // Bounce a particle off a wall.
-  // Status::None if the particle did not bounce off the wall. Too far away, or not traveling toward it.
-  // Status::Success if the particle bounced off the wall, and has a new velocity.
-  Status bounce(Component::Particle<V>&, const Component::Wall<V>&);
+  // momentum the walls have taken from bounce() since the last time this was asked, for pressure
+  double take_wall_impulse() {
+    const double impulse = m_wall_impulse;
+    m_wall_impulse = 0;
+    return impulse;
+  }
 
   void set_sim(Simulation::SimulationContext<V>* sim) {
     m_outer_sim = sim;
   }
 
   // accelerate a particle in the direction of gravity
-  void gravity(Component::Particle<V>&, US_T);
+  void gravity(Component::Particle<V>&, FRAC_US_T);
 
   // Move a particle forward in time.
-  void step(Component::Particle<V>&, US_T);
-private:
-  // when an impossible collision is detected (result of clipping), we attempt to correct
-  Status correct_collision(Component::Particle<V>&, Component::Particle<V>&);
+  void step(Component::Particle<V>&, FRAC_US_T);
 
-  // allows 1 level of recursion
-  Status collide_internal(Component::Particle<V>&, Component::Particle<V>&, bool);
+  // accelerate every particle towards every other, if mutual_gravity is set
+  void mutual_gravity(std::vector<Component::Particle<V>>&, US_T);
+private:
+  // collide() over the last window_s seconds, ruling out anyone further apart than their radii plus reach on any axis
+  // O3 optimized because this is a hyper critical loop, and doing so results in
+  // inlining all the vector operations, yielding a 5-10x performance increase overall
+  #if defined(__clang__)
+  #elif defined(__GNUC__)
+  __attribute__((optimize(3)))
+  #endif
+  Status sweep(Component::Particle<V>&, Component::Particle<V>&, double window_s, const vector_t& reach);
 
   Util::LatchingValue<Simulation::SimSettings<vector_t>> m_settings;
 
   Util::LatchingValue<V> m_gravity;
+  // from prepare_collisions(), 0 only catches pairs still touching at the end of the step
+  vector_t m_reach = 0;
+  // fastest speed (summed over the axes) for each sub-step level, and how far a sub-stepped pair can close in one
+  std::vector<vector_t> m_substep_limits;
+  vector_t m_substep_reach = 0;
+  // summed by bounce(), see take_wall_impulse()
+  double m_wall_impulse = 0;
+  // every collision and bounce records what it did to the energy here
+  Util::EnergyLedger m_ledger;
   // access to the simulation in which we're running
   // TODO manage ths properly, should be read-only
   Simulation::SimulationContext<V>* m_outer_sim;
 
-  // Don't echo events during replay, when correcting issues.
-  bool in_replay_mode;
+  // mutual gravity, kept around so its buffers are reused step to step
+  BarnesHut m_tree;
+  std::vector<BarnesHut::Body> m_bodies;
+  std::vector<BarnesHut::Accel> m_accel;
 };
 
 } // Physics
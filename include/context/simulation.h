@@ -1,19 +1,41 @@
 #pragma once
 #include "component.h"
 #include "context.h"
+#include "physics/observables.h"
+#include "physics/spatial_index.h"
 #include "sim_settings.h"
 #include "sim_time.h"
+#include "util/perf_counters.h"
+#include "util/profiler.h"
 #include "util/ring_buffer.h"
+#include "util/scheduler.h"
+#include "util/shared_frames.h"
+#include "util/trace.h"
 
 #include <array>
+#include <atomic>
+#include <cstdint>
+#include <limits>
 #include <memory>
+#include <mutex>
 #include <tuple>
+#include <utility>
 #include <vector>
 
 extern volatile bool g_pause;
 extern volatile bool g_step;
+// steps to go back before the next one, the window sets it and the simulation thread takes it
+extern std::atomic<size_t> g_rewind;
 
 namespace Simulation {
+
+// A particle's uid is its slot (+1, so 0 is never a uid) in the low 32 bits and the slot's generation above.
+// Slots are reused once their particle is removed, the generation tells the new particle from the old one.
+// Particles present from the start are generation 0, so their uids are just 1..N.
+inline size_t make_uid(size_t slot, size_t generation) { return (generation << 32) | (slot + 1); }
+inline size_t uid_slot(size_t uid) { return (uid & 0xFFFFFFFF) - 1; }
+inline size_t uid_generation(size_t uid) { return uid >> 32; }
+
 /**
  * The simulation class manages time and holds references to all objects within the context
  */
@@ -28,17 +50,21 @@ public:
   SimulationContext(SimSettings<vector_t> settings)
                     : SimulationContext() {
                       m_settings = settings;
+                      m_particle_buffer.set_depth(settings.history_depth);
+                      open_observables();
+                      open_shared_frames();
                     }
 
   // Or do it later.
   SimulationContext()
-                   : m_particle_buffer()
+                   : m_particle_buffer(DefaultSettings<vector_t>.history_depth)
                    , m_sim_clock()
                    , m_start(chrono::time_point_cast<US_T>(m_sim_clock.now()))
                    , m_tock(m_start)
                    , m_free_run(false)
                    , should_calc_next_step(true)
                    , m_settings(DefaultSettings<vector_t>)
+                   , m_scheduler(SIM_RESOLUTION_US)
                    {}
 
   // get the time of the simulation
@@ -54,14 +80,67 @@ public:
   // add a particle into the simulation by passing a velocity and position vector
   void add_particle(const V&, const V&);
 
+  // add many particles at once, in order
+  void add_particles(const std::vector<Component::Particle<V>>&);
+
+  // make room for this many particles in total, ahead of adding them one at a time
+  void reserve_particles(size_t n) {
+    m_particle_buffer.reserve(n);
+  }
+
+  // make added particles visible to get_particles()
+  // call once everything's added and before other threads start reading, otherwise the first run() will
+  void commit_particles();
+
+  // Queue particles to join a running simulation, they're added between steps and get fresh uids.
+  // Safe to call from any thread.
+  void queue_add(std::vector<Component::Particle<V>>);
+
+  // Queue particles to leave a running simulation, by uid. Removed between steps, uids which are stale
+  // or unknown are ignored. Safe to call from any thread.
+  // Removal swaps the last particle into the gap, so don't hold on to positions in get_particles()
+  void queue_remove(std::vector<size_t>);
+
   // run the simulation, please call repeatedly in a dedicated thread
   void run();
 
   // read-only view of particles, in their last good state
+  // only for the simulation thread (or before it starts), it's recycled once the simulation moves on
   const std::vector<Component::Particle<V>>& get_particles() const {
     return m_particle_buffer.latest();
   }
 
+  // the particles as of the last step, which stay that way for as long as the handle's held. Safe from any thread.
+  std::shared_ptr<const std::vector<Component::Particle<V>>> get_frame() const {
+    return m_particle_buffer.frame();
+  }
+
+  // get_frame() indexed for radius searches, nearest neighbours and ray casts, without scanning everyone.
+  // Built by whoever first asks after a step and shared by everyone else until the next. Safe from any thread,
+  // and the simulation never waits on it.
+  std::shared_ptr<const SpatialIndex<V>> query() const;
+
+  // a copy of get_particles() as it was `back` steps ago, 0 being now. Safe from any thread.
+  // Status::Failure if that's further back than --history-depth, or than we've run
+  Status get_history(size_t back, std::vector<Component::Particle<V>>& out) const {
+    return m_particle_buffer.history(back, out);
+  }
+
+  // Go back to how things were `back` steps ago and carry on from there, forgetting the steps in between.
+  // Particles, uids and the step count come back, collision and bounce counts keep counting.
+  // Only for the simulation thread, between run()s. Status::Failure if get_history() can't go back that far.
+  Status rewind(size_t back);
+
+  // a particle in get_particles() by uid, nullptr if it isn't there (e.g. it was added this step)
+  // only for the simulation thread, others don't know what the slots look like
+  const Component::Particle<V>* find_particle(size_t uid) const;
+
+  // particles in the simulation right now, including ones not yet visible in get_particles()
+  size_t get_particle_count() const { return m_particle_count; }
+
+  // particles asleep as of the last step
+  size_t get_sleeping_count() const { return m_sleeping_count; }
+
   // create a simulation box, centered about the origin, with dimensions {x, y, z}
   // only support this as a whole number now (it's generally the size of the screen)
   void set_boundaries(size_t, size_t, size_t);
@@ -90,11 +169,67 @@ public:
 
   size_t get_step() { return m_step; }
 
+  // simulated time at the start of the current step, in seconds
+  double get_step_time() const { return static_cast<double>(m_step) * SIM_RESOLUTION_S; }
+
+  size_t get_collision_count() const { return m_collision_count; }
+
+  size_t get_bounce_count() const { return m_bounce_count; }
+
+  // time spent in each phase of run(), only populated when built with PROFILE_PHASES
+  Util::PhaseProfiler& get_profiler() { return m_profiler; }
+
+  // hardware counters for each phase of run(), only populated with --debug-perf
+  Util::PerfCounters& get_perf_counters() { return m_perf_counters; }
+
+  // how well SimulationContextThread() is keeping up with real time
+  const Util::TickScheduler& get_scheduler() const { return m_scheduler; }
+
+  // where the energy went, see --energy-audit
+  const Util::EnergyLedger& get_energy_ledger() const { return m_physics_context.ledger(); }
+
+  // temperature, pressure and speeds as of the last sample, only taken with --observables
+  const Observables<V>& get_observables() const { return m_observables; }
+
 private:
   void add_particle_internal(Component::Particle<V>&);
 
-  // keeping a ringbuffer of particles allows us to go back N steps in time, with minimal overhead
-  Util::ThreadedRingBuffer<std::vector<Component::Particle<V>>, Component::Particle<V>, SimSettings<V>::RingBufferSize> m_particle_buffer;
+  // give a particle the next free slot, and the uid that goes with it
+  void assign_uid(Component::Particle<V>&, size_t idx);
+
+  // apply anything from queue_add()/queue_remove() to the working buffer
+  void apply_pending(std::vector<Component::Particle<V>>&);
+
+  // a sleeping particle was just in a collision, wake its island if it was hit hard enough
+  void knock(Component::Particle<V>&);
+
+  // wake everyone in the islands knock() asked for
+  void wake_islands(std::vector<Component::Particle<V>>&);
+
+  // count who's been still, and put islands which have all been still long enough to sleep
+  void settle(std::vector<Component::Particle<V>>&);
+
+  // make room in all the per-particle scratch below for n particles, so a step doesn't allocate just
+  // because something happens in it for the first time
+  void reserve_scratch(size_t n);
+
+  // recount the energy from scratch, and check the ledger against it
+  void audit_energy(const std::vector<Component::Particle<V>>&);
+
+  // start streaming samples to settings.observables, if it's set
+  void open_observables();
+
+  // start exporting frames to settings.shm, if it's set
+  void open_shared_frames();
+
+  // copy a frame out to shared memory, if it's open
+  void export_frame(const std::vector<Component::Particle<V>>&, double time);
+
+  // move, collide and bounce everyone in m_fast over the step, each a sub-step at a time
+  void substep(std::vector<Component::Particle<V>>&);
+
+  // Each step is published as an immutable frame, and the last N steps are kept to go back to
+  Util::ThreadedRingBuffer<std::vector<Component::Particle<V>>, Component::Particle<V>> m_particle_buffer;
 
   chrono::steady_clock m_sim_clock;
   const chrono::time_point<chrono::steady_clock, US_T> m_start;
@@ -106,12 +241,6 @@ private:
   // Number of steps the simulator has run
   size_t m_step = 0;
 
-  // Number of times the simulator detectd an impossible situation, and was able to mitigate it.
-  size_t m_correction_count = 0;
-
-  // Number of times the simulator detectd an impossible situation, and was not able to correct it.
-  size_t m_inconsistent_count = 0;
-
   // Number of collisions experienced by system.
   size_t m_collision_count = 0;
 
@@ -124,11 +253,65 @@ private:
   // Total particles in system
   size_t m_particle_count = 0;
 
+  // Particles have been added since the last commit_particles()
+  bool m_uncommitted = false;
+
+  static constexpr size_t REMOVED = std::numeric_limits<size_t>::max();
+
+  // Per slot: the generation of its current (or last) particle, and where it is in the working buffer
+  std::vector<uint32_t> m_slot_generation;
+  std::vector<size_t> m_slot_index;
+  // Slots whose particle has been removed, ready for reuse
+  std::vector<size_t> m_free_slots;
+
+  // Changes waiting for the next step, from any thread
+  std::mutex m_pending_lock;
+  std::vector<Component::Particle<V>> m_pending_add;
+  std::vector<size_t> m_pending_remove;
+  std::atomic<bool> m_has_pending{false};
+
+  // Particles asleep as of the last settle()
+  size_t m_sleeping_count = 0;
+  // Islands knocked awake this step
+  std::vector<size_t> m_woken_islands;
+  // Indices of the particles awake (and not sub-stepped) at the start of this step's collisions
+  std::vector<size_t> m_awake;
+  // settle() scratch: particles by grid cell, and islands as a union-find forest
+  std::vector<std::pair<uint64_t, size_t>> m_settle_cells;
+  std::vector<size_t> m_island_parent;
+  std::vector<uint8_t> m_island_ready;
+
+  // Sub-step level of each particle this step, and the indices of those above 0
+  std::vector<uint8_t> m_substep_levels;
+  std::vector<size_t> m_fast;
+  // substep() scratch: the last tick each particle moved on, and who moved this tick
+  std::vector<size_t> m_moved_on;
+  std::vector<size_t> m_moved;
+
   // Invariant settings for the system (well as long as you don't call update settings at runtime, which might be fun)
   Util::LatchingValue<SimSettings<vector_t>> m_settings;
 
   // Physics rules for the simulation
   Simulation::PhysicsContext<V> m_physics_context;
+
+  // Where the time goes in each step
+  Util::PhaseProfiler m_profiler;
+
+  // And what the CPU was doing with it
+  Util::PerfCounters m_perf_counters;
+
+  // Paces SimulationContextThread() at a step per SIM_RESOLUTION_US of real time
+  Util::TickScheduler m_scheduler;
+
+  // Thermodynamics of the whole system, every so often
+  Observables<V> m_observables;
+
+  // Every frame out to other processes, with --shm
+  Util::SharedFrames m_shared_frames;
+
+  // The last query(), and only one thread building the next at a time
+  mutable std::shared_ptr<const SpatialIndex<V>> m_index;
+  mutable std::mutex m_index_lock;
 };
 
 // run me!
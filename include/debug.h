@@ -1,33 +1,29 @@
 #pragma once
+#include "util/event_log.h"
+
 // Store debug messages here as macros to avoid cluttering source code with blocks of cout <<
 // macros will always be designed in such a way that DEBUG_MSG(X); results in intended behavior (e.g. semicolons are fair game)
-#define NOTE_REPLAY_HEADER \
-  if (in_replay_mode) { \
-    std::cout << "> (Note: The following event is occurring as part of a requested replay.)" << std::endl; \
-  } \
 
-#define NOTE_REPLAY_FOOTER \
-  if (in_replay_mode) { \
-    std::cout << "> (Note: The preceeding event has occurred as part of a requested replay.)" << std::endl; \
-  } \
+// With --debug-event-log the binary log replaces the text below, printing both would defeat the point
+#define TEXT_TRACE_ENABLED (!Util::EventLog::get().is_open())
+
+#define TRACED_PAIR \
+  (Simulation::trace_present(m_settings.get().trace, a.uid.get()) or \
+   Simulation::trace_present(m_settings.get().trace, b.uid.get()))
 
 #define COLLISION_DATA_HEADER \
   std::cout << "*******************Collision detected!*******************" << std::endl; \
   std::cout << "*********************************************************" << std::endl; \
-  NOTE_REPLAY_HEADER \
 
 #define COLLISION_DATA_FOOTER \
-    NOTE_REPLAY_FOOTER \
     std::cout << "$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$" << std::endl; \
     std::cout << "$$$$$$$$$$$$$$$$$$End Collision Data$$$$$$$$$$$$$$$$$$" << std::endl << std::endl; \
 
 #define BOUNCE_DATA_HEADER \
     std::cout << "*******************Bounce detected!*******************" << std::endl; \
     std::cout << "******************************************************" << std::endl; \
-    NOTE_REPLAY_HEADER \
 
 #define BOUNCE_DATA_FOOTER \
-    NOTE_REPLAY_FOOTER \
     std::cout << "$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$" << std::endl; \
     std::cout << "$$$$$$$$$$$$$$$$$$End Bounce Data$$$$$$$$$$$$$$$$$$" << std::endl << std::endl; \
 
@@ -39,27 +35,15 @@
     std::cout << "$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$" << std::endl; \
     std::cout << "$$$$$$$$$$$$$$$End System Report (Post Run)$$$$$$$$$$$$$$$" << std::endl << std::endl; \
 
-#define IMPOSSIBLE_COLLISION_WARNING \
-    if (Simulation::trace_present(m_settings.get().trace, a.uid.get()) or \
-        Simulation::trace_present(m_settings.get().trace, b.uid.get())) { \
-        std::cout << "!!!!!!!!!!!!!!!!!!Detected impossible collision!!!!!!!!!!!!!!!!!!!" << std::endl << std::endl; \
-        std::cout << "> Particle Status (Would Have Been): " << std::endl << std::endl; \
-        std::cout << "Particle A (Would Have Been): " << std::endl << a << std::endl; \
-        std::cout << "----------------------------------------------------" << std::endl; \
-        std::cout << "Particle B (Would Have Been): " << std::endl << b << std::endl << std::endl; \
-        std::cout << "Delta KE (Would Have Been): " << k_delta << std::endl; \
-        std::cout << "Total KE (Would Have Been): " << ka_after + kb_after << std::endl << std::endl; \
-    }
-
 #define COLLISION_DETECTED \
-  if (Simulation::trace_present(m_settings.get().trace, a.uid.get()) or \
-      Simulation::trace_present(m_settings.get().trace, b.uid.get())) { \
+  if (TEXT_TRACE_ENABLED and TRACED_PAIR) { \
     COLLISION_DATA_HEADER \
     std::cout << "On Step: " << m_outer_sim->get_step() << std::endl; \
     auto elapsed_time = m_outer_sim->get_elapsed_time_us().count(); \
     std::cout << "Elapsed Time (Real): " << elapsed_time << "us " << "| (" \
       << static_cast<float>(elapsed_time) / static_cast<float>(1e6) << "s)" << std::endl; \
     std::cout << "Distance: " << dist << std::endl; \
+    std::cout << "Contact: " << contact_s << "s into the step" << std::endl; \
     std::cout << "V Delta: " << v_delta_before << std::endl << std::endl; \
     std::cout << "> Particle Status Pre-Collision: " << std::endl << std::endl; \
     std::cout << "Particle A (Pre): " << std::endl << a << std::endl; \
@@ -70,18 +54,11 @@
     std::cout << "Impulse vector: " << impulse_vector << std::endl << std::endl;; \
   } \
 
-#define UNABLE_TO_CORRECT_COLLISION \
-    std::cout << "Final Result: Unable To Correct Collision." << std::endl; \
-    COLLISION_DATA_FOOTER \
-
-// don't print this out on our internal recursive call
-// we also need to recalculate KE since it might've changed as a result of correction
 #define POST_COLLISION_REPORT \
   const auto k_delta_final = abs((ka_before + kb_before) - (a.kinetic_energy() + b.kinetic_energy())); \
   const auto ka_after_final = a.kinetic_energy(); \
   const auto kb_after_final = b.kinetic_energy(); \
-  if (Simulation::trace_present(m_settings.get().trace, a.uid.get()) or \
-      Simulation::trace_present(m_settings.get().trace, b.uid.get())) { \
+  if (TEXT_TRACE_ENABLED and TRACED_PAIR) { \
     std::cout << "> Particle Status Post-Collision: " << std::endl << std::endl; \
     std::cout << "Particle A (Post): " << std::endl << a << std::endl; \
     std::cout << "----------------------------------------------------" << std::endl; \
@@ -91,20 +68,8 @@
     COLLISION_DATA_FOOTER \
   } \
 
-#define CORRECTION_ATTEMPT_FAILED \
-    std::cout << "Unable To Correct Collision. On Attempt: " \
-      << attempt << " of " << scales.size() << "." << std::endl << std::endl; \
-
-#define CORRECTION_ATTEMPT_SUCCESS \
-    std::cout << "Successfully corrected collision! On Attempt: " \
-      << attempt << " of " << scales.size() << "." << std::endl << std::endl; \
-
-#define CORRECTION_ATTEMPT_REPORT \
-    std::cout << "Attempting a Correction. This will be attempt: " << attempt << " of " << scales.size() << "." << std::endl; \
-    std::cout << "Replaying sim with time resolution: " << std::get<0>(scale).count() << "us" << std::endl << std::endl; \
-
 #define BOUNCE_DETECTION \
-  if (Simulation::trace_present(m_settings.get().trace, p.uid.get())) { \
+  if (TEXT_TRACE_ENABLED and Simulation::trace_present(m_settings.get().trace, p.uid.get())) { \
     BOUNCE_DATA_HEADER \
     std::cout << "On Step: " << m_outer_sim->get_step() << std::endl; \
     auto elapsed_time = m_outer_sim->get_elapsed_time_us().count(); \
@@ -118,10 +83,7 @@
 #define SYSTEM_STATS \
   std::cout << "Bounces: " << m_bounce_count << std::endl; \
   std::cout << "Collisions : " << m_collision_count << std::endl; \
-  std::cout << "Corrections: " << m_correction_count << " (" << static_cast<float>(m_correction_count) / \
-    static_cast<float>(m_correction_count + m_inconsistent_count) * 100 << "% of impossible collisions)" << std::endl; \
-  std::cout << "Inconsistencies: " << m_inconsistent_count << " (" << static_cast<float>(m_inconsistent_count) / \
-    static_cast<float>(m_collision_count) * 100 << "%)" << std::endl << std::endl; \
+  std::cout << "Asleep: " << m_sleeping_count << " | Awake: " << m_particle_count - m_sleeping_count << std::endl << std::endl; \
 
 #define SYSTEM_REPORT \
   { \
@@ -139,7 +101,7 @@
       if (Simulation::trace_present(m_settings.get().trace, p.uid.get())) { \
         std::cout << p << std::endl; \
         std::cout << "----------------------------------------------------" << std::endl; \
-        total_energy += p.kinetic_energy(); \
+        total_energy += const_cast<Component::Particle<V>&>(p).kinetic_energy(); \
       } \
     } \
     std::cout << "Total System KE: " << total_energy << std::endl; \
@@ -148,13 +110,44 @@
   } \
   } \
 
-#define COLLISION_CORRECTION_REPORT \
-  std::cout << "Attempting to correct collision..." << std::endl; \
-  std::cout << "The current system time resolution is " << SIM_RESOLUTION_US.count() << "us." << std::endl; \
-  std::cout << "> Particle Status (1 Frame Ago):" << std::endl << std::endl; \
-  std::cout << "Particle A (1 Frame Ago): " << std::endl << a_old << std::endl; \
-  std::cout << "----------------------------------------------------" << std::endl; \
-  std::cout << "Particle B (1 Frame Ago): " << std::endl << b_old << std::endl << std::endl; \
+// Binary event log records. Unlike the above these aren't compiled out of release builds,
+// they cost a single check unless --debug-event-log was given.
+#define LOG_EVENT_HEADER(TYPE, STATUS, UID_A, UID_B) \
+    Util::EventRecord record{}; \
+    record.type = TYPE; \
+    record.status = STATUS; \
+    record.step = m_outer_sim->get_step(); \
+    record.elapsed_us = static_cast<uint64_t>(m_outer_sim->get_elapsed_time_us().count()); \
+    record.uid_a = UID_A; \
+    record.uid_b = UID_B; \
+
+#define LOG_COLLISION(STATUS) \
+  if (Util::EventLog::get().is_open() and TRACED_PAIR) { \
+    LOG_EVENT_HEADER(Util::EventType::Collision, STATUS, a.uid.get(), b.uid.get()) \
+    record.data[0] = static_cast<double>(ka_before + kb_before); \
+    record.data[1] = static_cast<double>(a.kinetic_energy() + b.kinetic_energy()); \
+    record.data[2] = static_cast<double>(const_cast<V&>(dist).magnitude()); \
+    record.data[3] = static_cast<double>(a.velocity().x()); \
+    record.data[4] = static_cast<double>(a.velocity().y()); \
+    record.data[5] = static_cast<double>(a.velocity().z()); \
+    record.data[6] = static_cast<double>(b.velocity().x()); \
+    record.data[7] = static_cast<double>(b.velocity().y()); \
+    record.data[8] = static_cast<double>(b.velocity().z()); \
+    Util::EventLog::get().push(record); \
+  } \
+
+#define LOG_BOUNCE \
+  if (Util::EventLog::get().is_open() and Simulation::trace_present(m_settings.get().trace, p.uid.get())) { \
+    LOG_EVENT_HEADER(Util::EventType::Bounce, Util::EventStatus::Success, p.uid.get(), 0) \
+    record.wall = static_cast<uint8_t>(wall.index()); \
+    record.data[0] = static_cast<double>(p.position().x()); \
+    record.data[1] = static_cast<double>(p.position().y()); \
+    record.data[2] = static_cast<double>(p.position().z()); \
+    record.data[3] = static_cast<double>(p.velocity().x()); \
+    record.data[4] = static_cast<double>(p.velocity().y()); \
+    record.data[5] = static_cast<double>(p.velocity().z()); \
+    Util::EventLog::get().push(record); \
+  } \
 
 #ifdef DEBUG
 #define DEBUG_MSG(X) X
@@ -3,11 +3,19 @@
 #include "component.h"
 #include "context.h"
 
+#include <cstdint>
 #include <random>
+#include <vector>
 
 namespace Demo {
 
 template<typename V>
 void set_initial_conditions(Simulation::SimulationContext<V>& sim, Simulation::SimSettings<typename V::vector_t> settings);
 
+// Start from the scene file in settings.scene instead, see demo/scene.h
+// colors gets the scene's per-particle colors (0xRRGGBB), if it had any
+template<typename V>
+Status set_scene_conditions(Simulation::SimulationContext<V>& sim, const Simulation::SimSettings<typename V::vector_t>& settings,
+                            std::vector<uint32_t>& colors);
+
 } // Demo
\ No newline at end of file
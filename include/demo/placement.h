@@ -0,0 +1,31 @@
+#pragma once
+
+#include "util/random.h"
+
+#include <cstddef>
+#include <vector>
+
+namespace Demo {
+
+// A particle's footprint in the xy plane, for finding it somewhere to start
+struct Disk {
+  double x;
+  double y;
+  double radius;
+  size_t index;   ///<< caller's bookkeeping, carried along untouched
+};
+
+/**
+ *  Make a set of disks non-overlapping inside an x_width * y_width box centred on the origin.
+ *
+ *  Each disk comes in with a suggested position. Largest first, a disk keeps its suggestion if it's
+ *  free, otherwise it's moved to a random free spot (dart throwing), trying near the suggestion before
+ *  empty grid cells anywhere in the box. Overlap checks go through a uniform grid, so this is ~O(n)
+ *  rather than O(n^2).
+ *
+ *  Disks which can't be fit anywhere are removed, the rest keep their original order.
+ *  Returns how many were removed.
+ **/
+size_t place_disks(std::vector<Disk>& disks, double x_width, double y_width, Util::CounterRng& gen);
+
+} // Demo
@@ -0,0 +1,78 @@
+#pragma once
+
+#include "component.h"
+#include "context.h"
+#include "util/status.h"
+
+#include <array>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace Demo {
+
+/**
+ *  Prepared initial conditions, as an alternative to the generated ones.
+ *
+ *  Two formats are accepted, told apart by the first 8 bytes:
+ *
+ *  Binary: a SceneHeader followed by `count` SceneRecords. Compact and quick to load, see write_scene().
+ *
+ *  Text: one particle per line as comma separated
+ *      x, y, vx, vy, radius, mass[, r, g, b]
+ *    Blank lines and lines starting with # are skipped, a first line which isn't numbers is taken as
+ *    column names. A `# box <x> <y> [z]` line sets the simulation box.
+ *
+ *  Either way particles stream straight into the simulation, nothing is held on the side but colors.
+ **/
+
+static constexpr char SCENE_MAGIC[8] = {'S', 'I', 'M', 'S', 'C', 'N', '0', '1'};
+
+enum SceneFlags : uint32_t {
+  HasColors = 1 << 0,
+  HasBox    = 1 << 1,
+};
+
+struct SceneHeader {
+  char magic[8];
+  uint32_t record_size;
+  uint32_t flags;
+  uint64_t count;
+  float box[3];
+  uint32_t reserved;
+};
+
+static_assert(sizeof(SceneHeader) == 40, "SceneHeader is part of the file format, don't change its size by accident");
+
+struct SceneRecord {
+  float position[3];
+  float velocity[3];
+  float radius;
+  float mass;
+  uint8_t rgb[3];
+  uint8_t reserved;
+};
+
+static_assert(sizeof(SceneRecord) == 36, "SceneRecord is part of the file format, don't change its size by accident");
+
+// What we learned loading a scene, other than the particles themselves
+struct SceneInfo {
+  size_t count = 0;
+  bool has_box = false;
+  std::array<double, 3> box = {{0, 0, 0}};
+  // 0xRRGGBB per particle, in the order they were added. Empty if the scene had none.
+  std::vector<uint32_t> colors;
+};
+
+// Add every particle in a scene file to the simulation
+// Status::Failure, after saying why, if the file is missing or malformed
+template<typename V>
+Status load_scene(const std::string& path, Simulation::SimulationContext<V>& sim, SceneInfo& info);
+
+// Save particles in the binary scene format
+// colors may be empty, box may be all 0 to let the loader decide
+template<typename V>
+bool write_scene(const std::string& path, const std::vector<Component::Particle<V>>& particles,
+                 const std::array<double, 3>& box, const std::vector<uint32_t>& colors);
+
+} // Demo
@@ -0,0 +1,73 @@
+#pragma once
+#include "context.h"
+#include "sim_settings.h"
+#include "util/status.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace Ensemble {
+
+/**
+ *  Lots of small simulations at once, headless, for parameter studies.
+ *
+ *  A sweep file says what to vary:
+ *      # comments
+ *      steps 2000                  how many steps each run takes (1000 if unspecified)
+ *      threads 8                   how many runs at a time, one per core if unspecified or 0
+ *      --p-count 1000 2000 5000    any command line option, and the values to try
+ *      --gravity 0 100
+ *  and every combination is run, 6 here. A run's settings are the original command line plus one
+ *  value of each swept option, parsed like any other command line. So swept options can't also be
+ *  given on the command line, and runs share the same seed unless it's swept too.
+ *
+ *  Runs are handed out to a pool of threads, one per core and pinned to it, and each thread takes
+ *  a simulation start to finish before moving on to the next. Every run ends up a row in one CSV.
+ *  With --observables each run streams its own, to the path suffixed with the run number. Same for --shm.
+ **/
+
+struct Sweep {
+  size_t steps = 1000;
+  size_t threads = 0;
+  // options to vary, and the values to try, in the order they were given
+  std::vector<std::pair<std::string, std::vector<std::string>>> axes;
+};
+
+// How a run went
+struct Summary {
+  std::string args;         ///<< the swept options, as they were given
+  bool completed;           ///<< false if it couldn't even start, e.g. a missing scene
+  uint64_t seed;
+  size_t particles;
+  size_t steps;
+  size_t collisions;
+  size_t bounces;
+  size_t asleep;
+  double energy_start;      ///<< total kinetic energy, before the first step and after the last
+  double energy_end;
+  int64_t wall_us;
+};
+
+// Status::Failure, saying why, if this isn't a sweep file
+Status load_sweep(std::istream&, Sweep&);
+
+// every combination of the sweep's values as extra command line arguments, the last axis changing fastest
+std::vector<std::vector<std::string>> expand(const Sweep&);
+
+// one simulation, start to finish, on the calling thread
+template<typename V>
+Summary run_one(const Simulation::SimSettings<typename V::vector_t>& settings, size_t steps);
+
+// the sweep in settings.ensemble, writing to settings.ensemble_out
+// argv is the command line every run starts from, settings is what it parsed to
+template<typename V>
+Status run(int argc, char** argv, const Simulation::SimSettings<typename V::vector_t>& settings);
+
+// CSV, a header then a row per summary
+void write_summaries(std::ostream&, const std::vector<Summary>&);
+
+} // Ensemble
@@ -2,14 +2,40 @@
 // Informational messages are always printed. These should be lightweight and shown infrequently.
 #include "debug.h"
 
+#include <fstream>
+
 #define SYSTEM_STATUS \
 { \
 static size_t last_frame = 0; \
 if (m_settings.get().info and (m_step - last_frame) > TICKS_PER_SECOND * 5) { \
   last_frame = m_step; \
   SYSTEM_STATS \
+  m_scheduler.report(std::cout); \
+  m_physics_context.ledger().report(std::cout); \
+  PROFILE_REPORT \
+  m_perf_counters.report(std::cout); \
   std::cout << std::endl; \
 } \
 } \
 
-#define INFO_MSG(X) X
\ No newline at end of file
+#define INFO_MSG(X) X
+
+#ifdef PROFILE_PHASES
+#define PROFILE_REPORT \
+  m_profiler.report(std::cout); \
+
+// Rewrite the whole profile every 5 seconds, so there's always a complete file to read
+#define PROFILE_DUMP \
+{ \
+static size_t last_dump = 0; \
+if (!m_settings.get().profile_dump.empty() and (m_step - last_dump) > TICKS_PER_SECOND * 5) { \
+  last_dump = m_step; \
+  std::ofstream dump_file(m_settings.get().profile_dump, std::ios::trunc); \
+  m_profiler.dump(dump_file); \
+} \
+} \
+
+#else
+#define PROFILE_REPORT
+#define PROFILE_DUMP do {} while(0)
+#endif
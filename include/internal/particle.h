@@ -13,7 +13,7 @@ template<typename T>
 std::ostream& operator<<(std::ostream& os, const Particle<T>& p) {
   // Note: Printing will force calculations of all on-demand members
   os << "{{UID: " << p.uid.get()  << ", Radius: " << p.radius() << std::endl;
-  os << "  Mass: " << p.m_mass << " | KE: " << p.kinetic_energy() << std::endl;
+  os << "  Mass: " << p.m_mass << " | KE: " << const_cast<Particle<T>&>(p).kinetic_energy() << std::endl;
   os << "  Vel : " << p.m_velocity << std::endl;
   os << "  Pos : " << p.m_position << "}}";
   return os;
@@ -57,7 +57,7 @@ T operator%(const Vector<T>& first, const Vector<T>& second) {
 template<typename T>
 std::ostream& operator<<(std::ostream& os, const Vector<T>& v) {
   // Note: printing will force calculation of all on-demand members
-  os << "{ " << v.x() << " : " << v.y() << " : " << v.z() << " | " << v.m_magnitude() << " }";
+  os << "{ " << v.x() << " : " << v.y() << " : " << v.z() << " | " << v.m_magnitude << " }";
   return os;
 }
 
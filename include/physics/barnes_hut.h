@@ -0,0 +1,72 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+namespace Simulation {
+
+/**
+ *  Mutual gravity between n bodies in ~O(n log n), by Barnes-Hut.
+ *
+ *  Bodies are bucketed into a quadtree (2D, like the rest of the system for now) and each node remembers
+ *  its total mass and centre of mass. Working out the pull on a body, any node which looks small from
+ *  where the body is (width / distance < theta) counts as a single body at its centre of mass, anything
+ *  else is opened up. theta = 0 opens everything and is exact, ~0.5 is the usual tradeoff.
+ *
+ *  Everything here is double no matter what the simulation runs in, the tree is rebuilt every step
+ *  and with PARALLELIZE_FOR_LOOPS both building and evaluating it are spread over threads.
+ **/
+class BarnesHut {
+public:
+  struct Body {
+    double x;
+    double y;
+    double mass;
+  };
+
+  typedef std::array<double, 2> Accel;
+
+  // rebuild the tree around these bodies
+  void build(const std::vector<Body>& bodies);
+
+  // acceleration of every body towards all the others, in the order they were given to build()
+  // g is the gravitational constant, softening keeps close encounters from blowing up
+  void accelerations(double g, double theta, double softening, std::vector<Accel>& out) const;
+
+  // the same, by brute force over every pair. For checking the tree, and small systems.
+  static void direct(const std::vector<Body>& bodies, double g, double softening, std::vector<Accel>& out);
+
+  size_t node_count() const { return m_nodes.size(); }
+
+private:
+  struct Node {
+    double x;                 ///<< centre of mass
+    double y;
+    double mass;
+    double width;
+    uint32_t begin;           ///<< bodies under this node, as a range of m_sorted
+    uint32_t end;
+    uint32_t first_child;     ///<< children are contiguous, 0 for a leaf (the root is nobody's child)
+    uint32_t child_count;
+  };
+
+  // no point splitting nodes smaller than this
+  static constexpr uint32_t LEAF_SIZE = 8;
+  // 16 bits of each axis in a morton key, so no deeper than this
+  static constexpr uint32_t MAX_DEPTH = 16;
+
+  // bodies in morton order, so every node covers a contiguous range
+  std::vector<Body> m_sorted;
+  std::vector<uint32_t> m_order;      ///<< where each of m_sorted came from
+  std::vector<uint32_t> m_keys;       ///<< morton key of each of m_sorted
+  std::vector<Node> m_nodes;          ///<< breadth first
+  std::vector<size_t> m_levels;       ///<< the first node of each level, plus one past the end
+  // build() scratch
+  std::vector<std::pair<uint32_t, uint32_t>> m_scratch;
+  std::vector<uint32_t> m_child_counts;
+};
+
+} // Simulation
@@ -0,0 +1,70 @@
+#pragma once
+#include "component.h"
+#include "util/status.h"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+namespace Simulation {
+
+/**
+ *  Thermodynamics of the particles as a whole, reduced in the engine so only a line of numbers per
+ *  sample has to leave it.
+ *
+ *  Temperature comes from equipartition, KE = (d / 2) N k T with k = 1. Pressure is the momentum the walls
+ *  took from bounces since the last sample, over the time and the length of wall it was spread over.
+ *  Speeds are binned out to 4x the RMS speed, beyond which a Maxwell-Boltzmann gas has next to nobody,
+ *  anyone faster lands in the last bin.
+ *
+ *  Everything is 2D, like the rest of the system for now. With PARALLELIZE_FOR_LOOPS the reduction is
+ *  spread over threads.
+ **/
+template<typename V>
+class Observables {
+public:
+  static constexpr size_t DIMENSIONS = 2;
+  static constexpr size_t SPEED_BINS = 32;
+
+  struct Sample {
+    size_t step;
+    double time;              ///<< simulated seconds
+    size_t particles;
+    double kinetic_energy;
+    double temperature;
+    double pressure;
+    double bin_width;         ///<< speed covered by each of speeds
+    std::array<uint64_t, SPEED_BINS> speeds;
+  };
+
+  // Start streaming samples to this file as CSV, a header and then a row per write()
+  Status open(const std::string& path);
+
+  bool is_open() const { return m_file.is_open(); }
+
+  // Reduce the particles to a sample, as of `time`. wall_impulse is the momentum the walls have taken since
+  // the last measure(), wall_length how much wall there is.
+  const Sample& measure(const std::vector<Component::Particle<V>>&, size_t step, double time,
+                        double wall_impulse, double wall_length);
+
+  // the next measure() is from `time`, rather than the last one. After a rewind, time went backwards.
+  void restart(double time) { m_last_time = time; }
+
+  // the last measure()
+  const Sample& latest() const { return m_sample; }
+
+  // append the last measure() to the file, if there is one
+  void write();
+
+private:
+  Sample m_sample{};
+  double m_last_time = 0;
+  // each particle's speed, between the two passes of measure()
+  std::vector<double> m_speeds;
+  std::ofstream m_file;
+};
+
+} // Simulation
@@ -0,0 +1,77 @@
+#pragma once
+#include "component.h"
+
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+namespace Simulation {
+
+/**
+ *  Where everyone is in one frame, for answering "who's near here" and "what does this hit" without
+ *  looking at every particle.
+ *
+ *  Particles are bucketed into a uniform grid over their bounding box, about one per cell and no smaller
+ *  than the biggest radius, so a particle only ever pokes into the cells next to its own. Cells are laid out
+ *  one after another with a copy of their particles' positions and radii, in double, so a query only walks
+ *  a few short runs of memory.
+ *
+ *  An index holds on to its frame, and neither ever changes once built, so it can be queried from any number
+ *  of threads at once. Results are indices into particles(). Everything is 2D, like the rest of the system
+ *  for now.
+ **/
+template<typename V>
+class SpatialIndex {
+public:
+  typedef std::vector<Component::Particle<V>> Frame;
+
+  struct Hit {
+    size_t index;             ///<< into particles()
+    double distance;          ///<< from the query point, to the particle's centre or along the ray to its edge
+  };
+
+  explicit SpatialIndex(std::shared_ptr<const Frame> frame);
+
+  const Frame& particles() const { return *m_frame; }
+  const std::shared_ptr<const Frame>& frame() const { return m_frame; }
+
+  // Everyone whose centre is within radius of (x, y), appended to out in no particular order
+  void within(double x, double y, double radius, std::vector<size_t>& out) const;
+
+  // The k centres nearest (x, y), nearest first, into out. Fewer if there aren't k particles.
+  void nearest(double x, double y, size_t k, std::vector<Hit>& out) const;
+
+  // The first particle a ray from (x, y) heading (dx, dy) runs into, no further than max_distance along it.
+  // A particle the ray starts inside is hit at 0. False if it hits nobody, or (dx, dy) is 0.
+  bool ray_cast(double x, double y, double dx, double dy, double max_distance, Hit& hit) const;
+
+  size_t cell_count() const { return m_cells_x * m_cells_y; }
+
+private:
+  struct Entry {
+    double x;
+    double y;
+    double radius;
+    size_t index;
+  };
+
+  // grid cell of a coordinate, clamped onto the grid
+  size_t cell_x(double x) const;
+  size_t cell_y(double y) const;
+
+  std::shared_ptr<const Frame> m_frame;
+
+  // bottom left corner of the grid, and the width of a cell
+  double m_x0 = 0;
+  double m_y0 = 0;
+  double m_cell = 1;
+  size_t m_cells_x = 1;
+  size_t m_cells_y = 1;
+  double m_max_radius = 0;
+
+  // cell c holds m_entries[m_starts[c]] up to m_entries[m_starts[c + 1]], cells row by row
+  std::vector<size_t> m_starts;
+  std::vector<Entry> m_entries;
+};
+
+} // Simulation
@@ -2,6 +2,8 @@
 #include "util/latch.h"
 
 #include <algorithm>
+#include <cstdint>
+#include <string>
 #include <vector>
 
 namespace Simulation {
@@ -41,8 +43,28 @@ struct SimSettings {
   VT gravity;                   ///<< I don't think you understand the gravity of the situation
   float gravity_angle;          ///<< I don't think you understand the gravity of the situation
   bool info;                    ///<< Print out INFO level messages.
-
-  static constexpr size_t RingBufferSize = 10;
+  std::string profile_dump;     ///<< Periodically write the per-phase step profile here as CSV (requires PROFILE_PHASES)
+  std::string chrome_trace;     ///<< Record a timeline of every thread and write it here as Chrome trace JSON on exit
+  bool perf_counters;           ///<< Sample hardware performance counters around each phase of a step (Linux only)
+  std::string event_log;        ///<< Write collisions, bounces and corrections here as binary records instead of printing them
+  uint64_t seed;                ///<< Initial conditions and colors depend only on this. 0 picks one at random.
+  std::string scene;            ///<< Load initial conditions from this file instead of generating them
+  size_t sleep_steps;           ///<< Particles still for this many steps in a row fall asleep. 0 never sleeps.
+  VT sleep_energy;              ///<< Below this kinetic energy a particle counts as still
+  VT mutual_gravity;            ///<< Gravitational constant between every pair of particles. 0 for none.
+  float gravity_theta;          ///<< Barnes-Hut opening angle for mutual gravity, 0 is exact and slow
+  float gravity_softening;      ///<< Smooths mutual gravity at close range so near misses don't fling particles
+  size_t max_substep_level;     ///<< Fast particles take up to 2^this sub-steps a step, so none moves more than radius_min at once
+  size_t history_depth;         ///<< How many past steps are kept (compressed) to go back to, 0 keeps none
+  size_t max_catch_up;          ///<< Steps run back to back to catch up when we fall behind real time, the rest are skipped
+  std::string ensemble;         ///<< Run every combination in this sweep file headless, instead of one simulation
+  std::string ensemble_out;     ///<< Where an ensemble writes its summary, a CSV row per run
+  std::string observables;      ///<< Stream temperature, pressure and the speed distribution here as CSV
+  size_t observables_every;     ///<< Steps between samples of the above
+  size_t energy_audit;          ///<< Steps between full recounts of the energy, to check the ledger against. 0 never.
+  float energy_drift;           ///<< Warn once the energy has drifted this fraction of the total. 0 never.
+  std::string stream;           ///<< Stream frames to viewers here, unix:<path> or tcp:<port>
+  std::string shm;              ///<< Export every frame to this POSIX shared memory region, see util/shm_frame.h
 };
 
 // Copy this object to get some default settings.
@@ -72,7 +94,29 @@ const SimSettings<T> DefaultSettings{
   /* .extra_trace */            false,
   /* .gravity */                0,
   /* .gravity_angle */          270,
-  /* .info */                   false
+  /* .info */                   false,
+  /* .profile_dump */           std::string(),
+  /* .chrome_trace */           std::string(),
+  /* .perf_counters */          false,
+  /* .event_log */              std::string(),
+  /* .seed */                   0,
+  /* .scene */                  std::string(),
+  /* .sleep_steps */            0,
+  /* .sleep_energy */           1,
+  /* .mutual_gravity */         0,
+  /* .gravity_theta */          0.5f,
+  /* .gravity_softening */      10,
+  /* .max_substep_level */      6,
+  /* .history_depth */          10,
+  /* .max_catch_up */           5,
+  /* .ensemble */               std::string(),
+  /* .ensemble_out */           "ensemble.csv",
+  /* .observables */            std::string(),
+  /* .observables_every */      10,
+  /* .energy_audit */           1000,
+  /* .energy_drift */           1e-4f,
+  /* .stream */                 std::string(),
+  /* .shm */                    std::string()
 };
 
 inline bool trace_present(const std::vector<size_t>& v, size_t puid) {
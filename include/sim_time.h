@@ -6,6 +6,8 @@ namespace chrono = std::chrono;
 using US_T = chrono::microseconds;
 using MS_T = chrono::milliseconds;
 using S_T =  chrono::seconds;
+// fractions of a microsecond, for sub-steps
+using FRAC_US_T = chrono::duration<double, std::micro>;
 
 constexpr size_t US_IN_S = 1'000'000UL;
 
@@ -13,5 +15,14 @@ constexpr size_t US_IN_S = 1'000'000UL;
 // time between updates. Decrease to tradeoff fidelity for performance.
 static constexpr chrono::microseconds SIM_RESOLUTION_US{10'000UL};
 
+// The same, in seconds
+static constexpr double SIM_RESOLUTION_S = static_cast<double>(SIM_RESOLUTION_US.count()) / US_IN_S;
+
+// A duration in seconds, as whatever number type the simulation runs in
+template<typename T>
+T time_scalar(FRAC_US_T us) {
+  return static_cast<T>(us.count() / US_IN_S);
+}
+
 // How many discrete engine ticks we get every second.
 static constexpr size_t TICKS_PER_SECOND = US_IN_S / SIM_RESOLUTION_US.count();
\ No newline at end of file
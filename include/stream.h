@@ -0,0 +1,153 @@
+#pragma once
+#include "context.h"
+#include "util/frame_codec.h"
+#include "util/status.h"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace Stream {
+
+/**
+ *  Frames out to viewers in other processes, so a headless run can be watched from somewhere else.
+ *
+ *  An address is either unix:<path> for a Unix domain socket, or tcp:<port> on localhost only. To watch
+ *  from another machine, tunnel to it (ssh -L). bin/stream_view is a viewer.
+ *
+ *  The server has a thread of its own, which picks up the newest frame about FRAME_INTERVAL_MS and sends
+ *  it to everyone connected, quantized and delta encoded per Util::FrameHeader. Sockets never block. A
+ *  viewer still working through the last frame skips this one, and gets the next as a delta against what it
+ *  does have, so a slow viewer sees a lower frame rate rather than slowing anyone down. The simulation only
+ *  ever hands over frames, it never waits on the server.
+ **/
+
+static constexpr int FRAME_INTERVAL_MS = 16;
+
+// Status::Failure unless it's unix:<path> or tcp:<port>
+Status check_address(const std::string& address);
+
+template<typename V>
+class Server {
+public:
+  explicit Server(const Simulation::SimulationContext<V>& sim)
+                 : m_sim(sim)
+                 {}
+
+  ~Server() { stop(); }
+
+  // Listen on the address and start sending frames. Status::Failure if we can't listen there.
+  Status start(const std::string& address);
+
+  // Hang up on everyone and stop
+  void stop();
+
+  size_t client_count() const { return m_client_count.load(); }
+
+  // frames sent and skipped, over every viewer
+  uint64_t frames_sent() const { return m_frames_sent.load(); }
+  uint64_t frames_skipped() const { return m_frames_skipped.load(); }
+
+private:
+  struct Connection {
+    int fd;
+    // the last frame this viewer got, or is getting, what the next one is a delta against. nullptr for a keyframe
+    std::shared_ptr<const std::vector<Util::QuantizedParticle>> base;
+    // whatever of the last frame didn't fit in the socket yet
+    std::vector<uint8_t> pending;
+    size_t sent;
+  };
+
+  void serve();
+
+  // quantize a new frame
+  void publish(const std::vector<Component::Particle<V>>&);
+
+  // send the current frame to everyone who's caught up. fresh if it's only just been published
+  void deliver(bool fresh);
+
+  // Send as much of what's pending as the socket takes. false if they've hung up.
+  bool flush(Connection&);
+
+  void hang_up(size_t connection);
+
+  const Simulation::SimulationContext<V>& m_sim;
+  std::string m_unix_path;
+  int m_listen_fd = -1;
+  uint32_t m_width = 0;
+  uint32_t m_height = 0;
+
+  std::thread m_thread;
+  std::atomic<bool> m_stop{false};
+
+  // only touched by the server thread
+  std::vector<Connection> m_connections;
+  std::shared_ptr<const std::vector<Component::Particle<V>>> m_last_frame;
+  std::shared_ptr<const std::vector<Util::QuantizedParticle>> m_current;
+  uint64_t m_sequence = 0;
+  // this frame encoded against each base someone has, so viewers in step share the work
+  std::vector<std::pair<const void*, std::vector<uint8_t>>> m_encoded;
+
+  std::atomic<size_t> m_client_count{0};
+  std::atomic<uint64_t> m_frames_sent{0};
+  std::atomic<uint64_t> m_frames_skipped{0};
+};
+
+/**
+ *  The other end, a viewer. Frames come in on a thread of their own and turn back into particles, which
+ *  get_frame() hands out the same way SimulationContext's does, so the window can draw them.
+ **/
+class Client {
+public:
+  typedef Component::Vector<float> V;
+  typedef std::vector<Component::Particle<V>> Frame;
+
+  Client()
+        : m_frame(std::make_shared<const Frame>())
+        {}
+
+  ~Client() { disconnect(); }
+
+  // Status::Failure if there's nobody streaming there
+  Status connect(const std::string& address);
+
+  void disconnect();
+
+  // false once the server's hung up, or sent something we can't read
+  bool connected() const { return m_connected.load(); }
+
+  // the newest frame, empty until the first arrives. Safe from any thread.
+  std::shared_ptr<const Frame> get_frame() const {
+    return std::atomic_load(&m_frame);
+  }
+
+  // there's no history on this end, always Status::Failure
+  Status get_history(size_t, Frame&) const { return Status::Failure; }
+
+  // frames received, and the server's sequence number of the last
+  uint64_t frames() const { return m_frames.load(); }
+  uint64_t sequence() const { return m_sequence.load(); }
+
+  // the box, as of the last frame
+  uint32_t width() const { return m_width.load(); }
+  uint32_t height() const { return m_height.load(); }
+
+private:
+  void receive();
+
+  int m_fd = -1;
+  std::thread m_thread;
+  std::atomic<bool> m_connected{false};
+  std::shared_ptr<const Frame> m_frame;
+  std::atomic<uint64_t> m_frames{0};
+  std::atomic<uint64_t> m_sequence{0};
+  std::atomic<uint32_t> m_width{0};
+  std::atomic<uint32_t> m_height{0};
+};
+
+} // Stream
@@ -0,0 +1,126 @@
+#pragma once
+#include "util/aligned_allocator.h"
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <vector>
+
+namespace Util {
+
+// Neumaier's take on Kahan summation. The rounding error of every add is carried on the side, so a sum of
+// millions of tiny deltas comes out as if it had been done exactly and rounded once.
+class CompensatedSum {
+public:
+  void add(double x) {
+    const double t = m_sum + x;
+    if (std::abs(m_sum) >= std::abs(x)) {
+      m_compensation += (m_sum - t) + x;
+    } else {
+      m_compensation += (x - t) + m_sum;
+    }
+    m_sum = t;
+  }
+
+  void add(const CompensatedSum& other) {
+    add(other.m_sum);
+    add(other.m_compensation);
+  }
+
+  double value() const { return m_sum + m_compensation; }
+
+  void clear() {
+    m_sum = 0;
+    m_compensation = 0;
+  }
+
+private:
+  double m_sum = 0;
+  double m_compensation = 0;
+};
+
+/**
+ *  Where the system's kinetic energy went, kept up as it changes rather than by adding it all up again.
+ *
+ *  Collisions and bounces ought to conserve energy, and record() what they actually did. That's the drift,
+ *  rounding and the like, and it costs O(collisions) a step to keep track of. Anything meant to change the
+ *  energy (adding or removing particles, putting them to sleep) goes through external() instead.
+ *
+ *  Every so often audit() is given a full recount. If nothing the ledger can't see (gravity) is at work, the
+ *  recount should be the last one plus everything recorded since, what's left over is unexplained.
+ *  check() holds the drift and unexplained since the first audit against the latest recount. After a
+ *  rebase() they count from the next audit instead.
+ *
+ *  record() is safe from any number of threads, each gets its own running sum which merge() folds into the
+ *  total once a step. Everything else is for the simulation thread.
+ **/
+class EnergyLedger {
+public:
+  EnergyLedger();
+
+  // a collision or bounce changed the energy by this much, from whichever thread it happened on
+  void record(double delta);
+
+  // the energy was changed on purpose by this much
+  void external(double delta) { m_external.add(delta); }
+
+  // fold every thread's record()s into the totals
+  void merge();
+
+  // A full recount of the energy. closed if nothing has changed it since the last that wasn't recorded.
+  void audit(double total, size_t step, bool closed);
+
+  // Forget the audits so far, e.g. the particles were rewound, check() starts over from the next one
+  void rebase() { m_audited = false; }
+
+  // Whether the drift (or anything unexplained) since the first audit, or the first since rebase(), is past
+  // tolerance of the last audit's total. Says so once each time it goes over.
+  bool check(double tolerance);
+
+  // drift recorded by every collision and bounce so far
+  double drift() const { return m_drift.value(); }
+
+  // energy changed on purpose so far
+  double external_change() const { return m_external.value(); }
+
+  // the energy we expect right now, from the last audit and everything since. 0 before the first audit.
+  double expected() const;
+
+  // the last audit, and how far off what we expected it was
+  double audited() const { return m_total; }
+  double unexplained() const { return m_unexplained.value(); }
+
+  uint64_t events() const { return m_events; }
+
+  bool alarmed() const { return m_alarmed; }
+
+  void report(std::ostream&) const;
+
+private:
+  // one per thread, a cache line each so they don't fight
+  struct alignas(64) Slot {
+    CompensatedSum drift;
+    uint64_t events = 0;
+  };
+  std::vector<Slot, AlignedAllocator<Slot>> m_slots;
+
+  CompensatedSum m_drift;
+  CompensatedSum m_external;
+  CompensatedSum m_unexplained;
+  uint64_t m_events = 0;
+
+  // the last audit, and the drift and external change as of then
+  bool m_audited = false;
+  double m_total = 0;
+  size_t m_audit_step = 0;
+  double m_drift_at_audit = 0;
+  double m_external_at_audit = 0;
+  // and as of the first audit since construction or rebase(), what check() counts from
+  double m_drift_at_base = 0;
+  double m_unexplained_at_base = 0;
+
+  bool m_alarmed = false;
+};
+
+} // Util
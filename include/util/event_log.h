@@ -0,0 +1,115 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <thread>
+
+namespace Util {
+
+/**
+ *  A binary log of simulation events, written in the background.
+ *
+ *  Any thread may push() a record. Records go into a bounded lock-free ring and a writer thread
+ *  drains them to disk in batches, so logging an event costs a copy and a couple of atomics.
+ *  If the writer falls behind and the ring fills up, records are dropped (and counted) rather than
+ *  ever blocking the simulation.
+ *
+ *  The file is a FileHeader followed by EventRecords. Use bin/event_decode to read it.
+ **/
+
+static constexpr char EVENT_LOG_MAGIC[8] = {'S', 'I', 'M', 'E', 'V', 'T', '0', '1'};
+
+enum class EventType : uint8_t {
+  Collision = 1,  ///<< data: ke before, ke after, distance, velocity a (xyz), velocity b (xyz)
+  Bounce,         ///<< data: position (xyz), velocity (xyz). `wall` is the WallIdx
+  Correction,     ///<< data: replay resolution (us). `attempt` counts from 1, `status` is the outcome
+};
+
+// What happened in the end, mirrors the interesting parts of Status
+enum class EventStatus : uint8_t {
+  Success = 0,
+  Corrected,
+  Inconsistent,
+  Failed,
+};
+
+struct EventRecord {
+  EventType type;
+  EventStatus status;
+  uint8_t wall;
+  uint8_t attempt;
+  uint8_t replay;       ///<< always 0 now collisions are swept, kept so old logs still decode
+  uint8_t pad[3];
+  uint64_t step;
+  uint64_t elapsed_us;
+  uint64_t uid_a;
+  uint64_t uid_b;
+  double data[9];
+};
+
+static_assert(sizeof(EventRecord) == 112, "EventRecord is part of the file format, don't change its size by accident");
+
+struct FileHeader {
+  char magic[8];
+  uint32_t record_size;
+  uint32_t reserved;
+};
+
+class EventLog {
+public:
+  // must be a power of 2
+  static constexpr size_t CAPACITY = 1 << 16;
+
+  // The process-wide log
+  static EventLog& get();
+
+  // Start logging to a file
+  // false if the file could not be opened
+  bool open(const std::string& path);
+
+  // Write out everything pending and stop the writer
+  void close();
+
+  bool is_open() const {
+    return m_open.load(std::memory_order_relaxed);
+  }
+
+  // Queue a record, never blocks
+  // false if the ring was full and the record was dropped
+  bool push(const EventRecord&);
+
+  uint64_t dropped() const {
+    return m_dropped.load(std::memory_order_relaxed);
+  }
+
+  ~EventLog();
+
+private:
+  EventLog();
+
+  // single consumer, only the writer thread calls this
+  bool pop(EventRecord&);
+
+  void writer();
+
+  struct Cell {
+    std::atomic<uint64_t> sequence;
+    EventRecord record;
+  };
+
+  std::unique_ptr<Cell[]> m_cells;
+  // keep producers and the consumer off each other's cache lines
+  alignas(64) std::atomic<uint64_t> m_tail;
+  alignas(64) uint64_t m_head;
+
+  std::atomic<bool> m_open;
+  std::atomic<bool> m_stop;
+  std::atomic<uint64_t> m_dropped;
+  std::FILE* m_file;
+  std::thread m_writer;
+};
+
+} // Util
@@ -134,6 +134,9 @@ private:
   int128_t value;
   // value by which this was scaled e.g. 31,415 has a scale of 10,000
   int32_t scalar;
+  // The rest of the int128_t's alignment, zeroed rather than left as padding. Copies carry their padding
+  // with them, and frames of particles are diffed by their bytes (see Util::FrameHistory).
+  int32_t m_unused[3] = {};
   // pre-check input values
   int128_t pre_scale(int64_t value) const {
     return value * DEFAULT_SCALING_FACTOR;
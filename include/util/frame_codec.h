@@ -0,0 +1,179 @@
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+namespace Util {
+
+/**
+ *  The wire format for streaming frames to viewers, see Stream::Server.
+ *
+ *  Each frame is a FrameHeader and then payload_bytes of particles. Positions and radii are quantized to
+ *  1/FRAME_QUANTA of a unit, which is plenty for drawing. A particle which is the same one (uid) at the same
+ *  index as in the last frame the viewer got is just how far it moved, as a pair of zigzag varints, a couple
+ *  of bytes for most. Anyone else is sent whole. A keyframe is every particle sent whole, and starts over.
+ *
+ *  Everything is host byte order, it's meant for localhost (or a tunnel to it).
+ **/
+
+static constexpr char FRAME_MAGIC[4] = {'S', 'I', 'M', 'F'};
+static constexpr uint16_t FRAME_VERSION = 1;
+static constexpr uint16_t FRAME_KEY = 1;
+static constexpr double FRAME_QUANTA = 16;
+// the most a particle can take, sent whole: a tag, then uid, x, y and radius as varints
+static constexpr uint64_t FRAME_MAX_PARTICLE_BYTES = 1 + 10 + 5 + 5 + 5;
+// anything bigger isn't a frame of ours, ten million particles sent whole
+static constexpr uint32_t FRAME_MAX_PAYLOAD = 1u << 28;
+
+struct FrameHeader {
+  char magic[4];
+  uint16_t version;
+  uint16_t flags;           ///<< FRAME_KEY for a keyframe
+  uint64_t sequence;        ///<< counts frames the server has sent anyone, viewers see gaps when they fall behind
+  uint32_t count;           ///<< particles in the frame
+  uint32_t payload_bytes;
+  uint32_t width;           ///<< of the box, centered about the origin
+  uint32_t height;
+};
+
+static_assert(sizeof(FrameHeader) == 32, "FrameHeader is part of the wire format, don't change its size by accident");
+
+struct QuantizedParticle {
+  uint64_t uid;
+  int32_t x;
+  int32_t y;
+  uint32_t radius;
+};
+
+inline int32_t quantize(double v) {
+  return static_cast<int32_t>(std::lround(v * FRAME_QUANTA));
+}
+
+inline double dequantize(int64_t q) {
+  return static_cast<double>(q) / FRAME_QUANTA;
+}
+
+namespace FrameCodec {
+
+inline void put_varint(uint64_t v, std::vector<uint8_t>& out) {
+  while (v >= 0x80) {
+    out.push_back(static_cast<uint8_t>(v | 0x80));
+    v >>= 7;
+  }
+  out.push_back(static_cast<uint8_t>(v));
+}
+
+// false if it runs off the end
+inline bool get_varint(const uint8_t*& p, const uint8_t* end, uint64_t& v) {
+  v = 0;
+  for (unsigned shift = 0; shift < 64; shift += 7) {
+    if (p == end) {
+      return false;
+    }
+    const uint8_t byte = *p++;
+    v |= static_cast<uint64_t>(byte & 0x7F) << shift;
+    if (!(byte & 0x80)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+inline uint64_t zigzag(int64_t v) {
+  return (static_cast<uint64_t>(v) << 1) ^ static_cast<uint64_t>(v >> 63);
+}
+
+inline int64_t unzigzag(uint64_t v) {
+  return static_cast<int64_t>(v >> 1) ^ -static_cast<int64_t>(v & 1);
+}
+
+} // FrameCodec
+
+// Append next to out as a header and payload, relative to base, the last frame the viewer got.
+// An empty base makes a keyframe.
+inline void encode_frame(uint64_t sequence, uint32_t width, uint32_t height,
+                         const std::vector<QuantizedParticle>& base, const std::vector<QuantizedParticle>& next,
+                         std::vector<uint8_t>& out) {
+  using namespace FrameCodec;
+  const size_t start = out.size();
+  out.resize(start + sizeof(FrameHeader));
+
+  for (size_t i = 0; i < next.size(); i++) {
+    const auto& p = next[i];
+    if (i < base.size() and base[i].uid == p.uid and base[i].radius == p.radius) {
+      // low bit clear, the same particle as last time
+      put_varint(zigzag(static_cast<int64_t>(p.x) - base[i].x) << 1, out);
+      put_varint(zigzag(static_cast<int64_t>(p.y) - base[i].y), out);
+    } else {
+      put_varint(1, out);
+      put_varint(p.uid, out);
+      put_varint(zigzag(p.x), out);
+      put_varint(zigzag(p.y), out);
+      put_varint(p.radius, out);
+    }
+  }
+
+  FrameHeader header;
+  std::memcpy(header.magic, FRAME_MAGIC, sizeof(header.magic));
+  header.version = FRAME_VERSION;
+  header.flags = base.empty() ? FRAME_KEY : 0;
+  header.sequence = sequence;
+  header.count = static_cast<uint32_t>(next.size());
+  header.payload_bytes = static_cast<uint32_t>(out.size() - start - sizeof(FrameHeader));
+  header.width = width;
+  header.height = height;
+  std::memcpy(out.data() + start, &header, sizeof(header));
+}
+
+// false unless it's a header we can read, with no more payload than its particles could take
+inline bool check_header(const FrameHeader& header) {
+  return std::memcmp(header.magic, FRAME_MAGIC, sizeof(header.magic)) == 0 and header.version == FRAME_VERSION and
+         header.payload_bytes <= FRAME_MAX_PAYLOAD and
+         header.payload_bytes <= static_cast<uint64_t>(header.count) * FRAME_MAX_PARTICLE_BYTES;
+}
+
+// Bring state up to the frame in this header and payload. state must be the frame before, as far as
+// whoever sent it knows. false if the payload doesn't add up, state is anyone's guess then.
+inline bool decode_frame(const FrameHeader& header, const uint8_t* payload, std::vector<QuantizedParticle>& state) {
+  using namespace FrameCodec;
+  if (header.flags & FRAME_KEY) {
+    state.clear();
+  }
+  const size_t before = state.size();
+  const uint8_t* p = payload;
+  const uint8_t* end = payload + header.payload_bytes;
+
+  for (size_t i = 0; i < header.count; i++) {
+    uint64_t tag;
+    if (!get_varint(p, end, tag)) {
+      return false;
+    }
+    if (i >= state.size()) {
+      state.emplace_back();
+    }
+    auto& q = state[i];
+    if (tag & 1) {
+      uint64_t uid, x, y, radius;
+      if (!get_varint(p, end, uid) or !get_varint(p, end, x) or !get_varint(p, end, y) or !get_varint(p, end, radius)) {
+        return false;
+      }
+      q.uid = uid;
+      q.x = static_cast<int32_t>(unzigzag(x));
+      q.y = static_cast<int32_t>(unzigzag(y));
+      q.radius = static_cast<uint32_t>(radius);
+    } else {
+      uint64_t dy;
+      if (i >= before or !get_varint(p, end, dy)) {
+        return false;
+      }
+      q.x = static_cast<int32_t>(q.x + unzigzag(tag >> 1));
+      q.y = static_cast<int32_t>(q.y + unzigzag(dy));
+    }
+  }
+  state.resize(header.count);
+  return p == end;
+}
+
+} // Util
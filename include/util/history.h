@@ -0,0 +1,354 @@
+#pragma once
+#include "util/status.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <type_traits>
+#include <vector>
+
+namespace Util {
+
+/**
+ *  The last `depth` frames of a container, cheaply.
+ *
+ *  Every so often a frame is kept whole as a keyframe, everything in between is kept as the difference of
+ *  its bytes from the newest keyframe's, 8 at a time. Between two steps most of a particle doesn't change at
+ *  all and what does (position, mostly) only moves a little, so the difference is mostly zero words and
+ *  small numbers. Runs of zero words are stored as a count and everything else as a zigzag varint.
+ *  (A difference rather than an XOR, so a FixedPoint or double which creeps across a power of two or
+ *  through zero stays small.)
+ *
+ *  A new keyframe is taken once a delta would cost more than a quarter of a whole frame, or the number
+ *  of elements changes, so memory grows with depth by deltas rather than by copies. Any frame comes back
+ *  with one copy of its keyframe and one pass over its delta.
+ *
+ *  Frames come and go first in first out, so the deltas live end to end in one ring of bytes and the frames
+ *  in a ring of their own, and retired keyframes are kept to be written over by the next one. Once those
+ *  have grown to fit, push() doesn't allocate.
+ *
+ *  C is a SequenceContainer of trivially copyable elements, like Particle. Frames are reconstructed byte
+ *  for byte, padding and all, and copy() is how to make the frames going in match too.
+ *
+ *  Not thread safe, see ThreadedRingBuffer for that.
+ **/
+template<typename C>
+class FrameHistory {
+typedef typename C::value_type E;
+static_assert(std::is_trivially_copyable<E>::value, "Frames are copied and diffed by their bytes, elements have to be trivially copyable");
+
+public:
+  explicit FrameHistory(size_t depth)
+                       : m_depth(std::max<size_t>(depth, 1))
+                       , m_frames(m_depth)
+                       {}
+
+  // to = from, byte for byte. Copying element by element leaves the padding as whatever was there before,
+  // which would turn up in every delta.
+  static void copy(const C& from, C& to) {
+    to.resize(from.size());
+    if (!from.empty()) {
+      std::memcpy(to.data(), from.data(), frame_bytes(from));
+    }
+  }
+
+  // keep this many frames, dropping the oldest if there are already more
+  void set_depth(size_t depth) {
+    depth = std::max<size_t>(depth, 1);
+    while (m_count > depth) {
+      pop_oldest();
+    }
+    std::vector<Frame> frames(depth);
+    for (size_t i = 0; i < m_count; i++) {
+      frames[i] = m_frames[(m_first + i) % m_depth];
+    }
+    m_frames.swap(frames);
+    m_first = 0;
+    m_depth = depth;
+  }
+
+  size_t depth() const { return m_depth; }
+
+  // frames we can give back right now, at most depth()
+  size_t size() const { return m_count; }
+
+  // add the newest frame
+  void push(const C& frame) {
+    // make room first, the newest keyframe might be going with the oldest frame
+    if (m_count == m_depth) {
+      pop_oldest();
+    }
+
+    Key* key = m_keys.empty() ? nullptr : m_keys.back().get();
+    size_t begin = m_delta_tail;
+    size_t end = m_delta_tail;
+    if (key == nullptr or key->frame.size() != frame.size() or !encode(key->frame, frame, begin, end)) {
+      key = take_key(frame);
+    }
+    key->users++;
+    m_frames[(m_first + m_count) % m_depth] = {key, begin, end};
+    m_count++;
+    m_delta_tail = end;
+  }
+
+  // frame `back` steps before the newest, 0 being the newest
+  // Status::Failure if we don't go back that far
+  Status get(size_t back, C& out) const {
+    if (back >= m_count) {
+      return Status::Failure;
+    }
+    const auto& frame = at(back);
+    copy(frame.key->frame, out);
+    decode(frame, out);
+    return Status::Success;
+  }
+
+  // Turn frame, which has to be the newest, into the one `back` steps before it and forget everything newer.
+  // Against the same keyframe that's one delta off and another on, in place, otherwise it's get().
+  // Status::Failure if we don't go back that far, and frame is left alone
+  Status rewind(size_t back, C& frame) {
+    if (back >= m_count) {
+      return Status::Failure;
+    }
+    const auto& newest = at(0);
+    const auto& target = at(back);
+    if (newest.key == target.key and frame.size() == target.key->frame.size()) {
+      decode(newest, frame, true);
+      decode(target, frame);
+    } else {
+      get(back, frame);
+    }
+
+    for (size_t i = 0; i < back; i++) {
+      pop_newest();
+    }
+    return Status::Success;
+  }
+
+  // roughly what all of this costs, keyframes (spares too) and deltas
+  size_t bytes() const {
+    size_t total = m_deltas.capacity() + m_scratch.capacity() + m_frames.capacity() * sizeof(Frame);
+    for (const auto& key : m_keys) {
+      total += key->frame.capacity() * sizeof(E);
+    }
+    for (const auto& key : m_spare_keys) {
+      total += key->frame.capacity() * sizeof(E);
+    }
+    return total;
+  }
+
+  // how many of those are whole frames, not counting spares
+  size_t keyframes() const { return m_keys.size(); }
+
+  void clear() {
+    while (m_count > 0) {
+      pop_oldest();
+    }
+  }
+
+private:
+  struct Key {
+    C frame;
+    size_t users;                   ///<< frames in the history diffed against this one
+  };
+
+  struct Frame {
+    Key* key;
+    size_t begin;                   ///<< its delta, in m_deltas. Empty for the keyframe itself
+    size_t end;
+  };
+
+  // retired keyframes kept around to be written over, any more than this are let go
+  static constexpr size_t SPARE_KEYS = 2;
+
+  const Frame& at(size_t back) const {
+    return m_frames[(m_first + m_count - 1 - back) % m_depth];
+  }
+
+  static void put_varint(uint8_t*& out, uint64_t v) {
+    while (v >= 0x80) {
+      *out++ = static_cast<uint8_t>(v | 0x80);
+      v >>= 7;
+    }
+    *out++ = static_cast<uint8_t>(v);
+  }
+
+  static uint64_t get_varint(const uint8_t*& p) {
+    uint64_t v = 0;
+    for (unsigned shift = 0;; shift += 7) {
+      const uint8_t byte = *p++;
+      v |= static_cast<uint64_t>(byte & 0x7F) << shift;
+      if (!(byte & 0x80)) {
+        return v;
+      }
+    }
+  }
+
+  // the bytes of a whole frame, as words. An element which isn't a multiple of 8 leaves a short last word.
+  static size_t frame_bytes(const C& c) { return c.size() * sizeof(E); }
+
+  static uint64_t word(const uint8_t* bytes, size_t i, size_t total) {
+    uint64_t w = 0;
+    std::memcpy(&w, bytes + i * 8, std::min<size_t>(8, total - i * 8));
+    return w;
+  }
+
+  // signed to unsigned, small either way
+  static uint64_t zigzag(uint64_t v) { return (v << 1) ^ (0 - (v >> 63)); }
+
+  static uint64_t unzigzag(uint64_t v) { return (v >> 1) ^ (0 - (v & 1)); }
+
+  // Delta of frame against key as (zero words skipped, difference) pairs, into [begin, end) of m_deltas.
+  // false if it isn't worth it.
+  bool encode(const C& key, const C& frame, size_t& begin, size_t& end) {
+    const size_t total = frame_bytes(frame);
+    const size_t words = (total + 7) / 8;
+    const size_t budget = total / 4;
+    const auto* k = reinterpret_cast<const uint8_t*>(key.data());
+    const auto* f = reinterpret_cast<const uint8_t*>(frame.data());
+
+    // a pair is two varints of at most 10 bytes each, which is as far past the budget as we can get
+    if (m_scratch.size() < budget + 20) {
+      m_scratch.resize(budget + 20);
+    }
+    uint8_t* out = m_scratch.data();
+    size_t skipped = 0;
+    for (size_t i = 0; i < words; i++) {
+      const uint64_t x = word(f, i, total) - word(k, i, total);
+      if (x == 0) {
+        skipped++;
+        continue;
+      }
+      put_varint(out, skipped);
+      put_varint(out, zigzag(x));
+      skipped = 0;
+      if (static_cast<size_t>(out - m_scratch.data()) > budget) {
+        return false;
+      }
+    }
+
+    const size_t n = static_cast<size_t>(out - m_scratch.data());
+    begin = reserve_delta(n);
+    end = begin + n;
+    std::copy(m_scratch.begin(), m_scratch.begin() + static_cast<std::ptrdiff_t>(n),
+              m_deltas.begin() + static_cast<std::ptrdiff_t>(begin));
+    return true;
+  }
+
+  // put a delta on top of its keyframe, or with undo take it back off the frame it made
+  void decode(const Frame& frame, C& out, bool undo = false) const {
+    const size_t total = frame_bytes(out);
+    auto* bytes = reinterpret_cast<uint8_t*>(out.data());
+    const uint8_t* p = m_deltas.data() + frame.begin;
+    const uint8_t* end = m_deltas.data() + frame.end;
+    size_t i = 0;
+    while (p < end) {
+      i += get_varint(p);
+      const uint64_t diff = unzigzag(get_varint(p));
+      const uint64_t x = undo ? word(bytes, i, total) - diff : word(bytes, i, total) + diff;
+      std::memcpy(bytes + i * 8, &x, std::min<size_t>(8, total - i * 8));
+      i++;
+    }
+  }
+
+  // Room in m_deltas for n bytes after the newest delta: straight after it, or back at the start if the
+  // oldest has moved on far enough. Failing that everything live is packed into a ring half again as big.
+  // The newest never quite catches up to the oldest, so head == tail only when there's nothing live.
+  size_t reserve_delta(size_t n) {
+    if (m_delta_head <= m_delta_tail) {
+      if (m_delta_tail + n <= m_deltas.size()) {
+        return m_delta_tail;
+      }
+      if (n < m_delta_head) {
+        return 0;
+      }
+    } else if (m_delta_tail + n < m_delta_head) {
+      return m_delta_tail;
+    }
+
+    size_t live = 0;
+    for (size_t i = 0; i < m_count; i++) {
+      const auto& frame = m_frames[(m_first + i) % m_depth];
+      live += frame.end - frame.begin;
+    }
+    std::vector<uint8_t> grown((live + n) * 3 / 2);
+    size_t packed = 0;
+    for (size_t i = 0; i < m_count; i++) {
+      auto& frame = m_frames[(m_first + i) % m_depth];
+      const size_t length = frame.end - frame.begin;
+      std::copy(m_deltas.begin() + static_cast<std::ptrdiff_t>(frame.begin),
+                m_deltas.begin() + static_cast<std::ptrdiff_t>(frame.end),
+                grown.begin() + static_cast<std::ptrdiff_t>(packed));
+      frame.begin = packed;
+      frame.end = packed + length;
+      packed += length;
+    }
+    m_deltas.swap(grown);
+    m_delta_head = 0;
+    m_delta_tail = packed;
+    return packed;
+  }
+
+  // a keyframe holding a copy of frame, written over a spare if there is one
+  Key* take_key(const C& frame) {
+    if (m_spare_keys.empty()) {
+      m_keys.push_back(std::unique_ptr<Key>(new Key{C(), 0}));
+    } else {
+      m_keys.push_back(std::move(m_spare_keys.back()));
+      m_spare_keys.pop_back();
+    }
+    copy(frame, m_keys.back()->frame);
+    return m_keys.back().get();
+  }
+
+  void retire(std::unique_ptr<Key>& key) {
+    if (m_spare_keys.size() < SPARE_KEYS) {
+      m_spare_keys.push_back(std::move(key));
+    }
+  }
+
+  void pop_oldest() {
+    Key* key = m_frames[m_first].key;
+    m_first = (m_first + 1) % m_depth;
+    m_count--;
+    // nobody's left diffing against the oldest keyframe
+    if (--key->users == 0) {
+      retire(m_keys.front());
+      m_keys.erase(m_keys.begin());
+    }
+    if (m_count == 0) {
+      m_delta_head = m_delta_tail = 0;
+    } else {
+      m_delta_head = m_frames[m_first].begin;
+    }
+  }
+
+  void pop_newest() {
+    Key* key = at(0).key;
+    m_count--;
+    if (--key->users == 0) {
+      retire(m_keys.back());
+      m_keys.pop_back();
+    }
+    if (m_count == 0) {
+      m_delta_head = m_delta_tail = 0;
+    } else {
+      m_delta_tail = at(0).end;
+    }
+  }
+
+  size_t m_depth;
+  std::vector<Frame> m_frames;                      ///<< a ring of m_depth, m_count of them from m_first on
+  size_t m_first = 0;
+  size_t m_count = 0;
+  std::vector<std::unique_ptr<Key>> m_keys;         ///<< oldest first
+  std::vector<std::unique_ptr<Key>> m_spare_keys;
+  std::vector<uint8_t> m_deltas;                    ///<< a ring of bytes, live from m_delta_head to m_delta_tail
+  size_t m_delta_head = 0;
+  size_t m_delta_tail = 0;
+  std::vector<uint8_t> m_scratch;                   ///<< encode() works here until it knows the delta is worth it
+};
+
+} // Util
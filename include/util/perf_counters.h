@@ -0,0 +1,110 @@
+#pragma once
+#include "util/profiler.h"
+#include "util/status.h"
+
+#include <array>
+#include <cstdint>
+#include <iostream>
+
+namespace Util {
+
+/**
+ *  Hardware performance counters for the calling thread, via perf_event_open(2).
+ *
+ *  All counters are opened as one group so a single read() samples them together.
+ *  Counters the kernel or hardware refuse (common in containers and VMs) are left out,
+ *  and if none open at all, everything here quietly becomes a no-op.
+ *
+ *  Only the thread which called open() is counted, OpenMP workers are not.
+ **/
+class PerfCounters {
+public:
+  enum Counter {
+    Cycles = 0,
+    Instructions,
+    L1DMisses,
+    LLCMisses,
+    BranchMisses,
+    SIZE
+  };
+
+  typedef std::array<uint64_t, Counter::SIZE> Sample;
+
+  PerfCounters();
+  ~PerfCounters();
+
+  PerfCounters(const PerfCounters&) = delete;
+  PerfCounters& operator=(const PerfCounters&) = delete;
+
+  // Start counting on the calling thread
+  // true if at least one counter is available
+  bool open();
+
+  bool enabled() const { return m_leader >= 0; }
+
+  // Current value of every counter, unavailable counters read as 0
+  // Failure if the kernel didn't give us a sample, which is then all 0 and no use to accumulate()
+  Status read(Sample&) const;
+
+  // Add the counts since `start` to a phase
+  void accumulate(Phase, const Sample& start, const Sample& end);
+
+  // Note a phase which went uncounted, a read() either side of it failed
+  void skip() { m_skipped++; }
+
+  // Note that a step has finished, for per-step averages
+  void end_step() { m_steps++; }
+
+  // Per-step average of each counter in each phase since the last report
+  // Resets the averages
+  void report(std::ostream&);
+
+  static const char* counter_name(Counter);
+
+private:
+  int m_leader;
+  std::array<int, Counter::SIZE> m_fds;
+  // position of each counter in a group read, or -1 if it didn't open
+  std::array<int, Counter::SIZE> m_slot;
+  int m_open_count;
+
+  std::array<Sample, static_cast<size_t>(Phase::SIZE)> m_totals;
+  size_t m_steps;
+  size_t m_skipped;
+};
+
+// Count the enclosing scope into a phase
+class ScopedPerfPhase {
+public:
+  ScopedPerfPhase(PerfCounters& counters, Phase phase)
+                 : m_counters(counters)
+                 , m_phase(phase)
+                 {
+                   if (m_counters.enabled()) {
+                     m_started = m_counters.read(m_start) == Status::Success;
+                   }
+                 }
+
+  ~ScopedPerfPhase() {
+    if (!m_counters.enabled()) {
+      return;
+    }
+    PerfCounters::Sample end;
+    if (m_started and m_counters.read(end) == Status::Success) {
+      m_counters.accumulate(m_phase, m_start, end);
+    } else {
+      m_counters.skip();
+    }
+  }
+
+private:
+  PerfCounters& m_counters;
+  Phase m_phase;
+  PerfCounters::Sample m_start;
+  bool m_started = false;
+};
+
+} // Util
+
+// Count hardware events for the rest of the enclosing scope, when --debug-perf is on
+#define PERF_PHASE(COUNTERS, PHASE) Util::ScopedPerfPhase PROFILE_CONCAT(scoped_perf_, __LINE__)((COUNTERS), (PHASE))
@@ -0,0 +1,113 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+
+namespace Util {
+
+// The phases of a single SimulationContext::run()
+enum class Phase {
+  Gravity = 0,
+  Step,
+  Collision,
+  Bounce,
+  Publish,
+  Settle,
+  Substep,
+  Observe,
+  SIZE
+};
+
+/**
+ *  Accumulates wall time spent in each phase of a step, as a log2 histogram of nanoseconds.
+ *  Recording is a handful of relaxed atomic adds so it's safe to record from parallel loops.
+ *
+ *  Don't use this directly in hot paths, use PROFILE_PHASE below which disappears entirely
+ *  unless we're built with -DPROFILE_PHASES (make profile).
+ **/
+class PhaseProfiler {
+public:
+  // bucket i holds samples in [2^i, 2^(i+1)) ns, the last bucket is everything longer (~4.5 minutes)
+  static constexpr size_t BUCKETS = 48;
+
+  PhaseProfiler() {
+    reset();
+  }
+
+  void record(Phase phase, uint64_t ns) {
+    auto& stats = m_phases[static_cast<size_t>(phase)];
+    stats.count.fetch_add(1, std::memory_order_relaxed);
+    stats.total_ns.fetch_add(ns, std::memory_order_relaxed);
+    stats.histogram[bucket(ns)].fetch_add(1, std::memory_order_relaxed);
+
+    uint64_t max = stats.max_ns.load(std::memory_order_relaxed);
+    while (ns > max and !stats.max_ns.compare_exchange_weak(max, ns, std::memory_order_relaxed)) {}
+  }
+
+  void reset();
+
+  // Human readable summary, one line per phase
+  void report(std::ostream&) const;
+
+  // Machine readable CSV, one row per phase with the raw histogram in the last column
+  void dump(std::ostream&) const;
+
+  // Upper bound of the bucket containing the p'th percentile sample, p in [0, 100]
+  uint64_t percentile_ns(Phase, double p) const;
+
+  static const char* phase_name(Phase);
+
+private:
+  static size_t bucket(uint64_t ns) {
+    size_t b = 0;
+    while (ns > 1 and b < BUCKETS - 1) {
+      ns >>= 1;
+      b++;
+    }
+    return b;
+  }
+
+  struct PhaseStats {
+    std::atomic<uint64_t> count;
+    std::atomic<uint64_t> total_ns;
+    std::atomic<uint64_t> max_ns;
+    std::array<std::atomic<uint64_t>, BUCKETS> histogram;
+  };
+
+  std::array<PhaseStats, static_cast<size_t>(Phase::SIZE)> m_phases;
+};
+
+// Times the enclosing scope into a PhaseProfiler
+class ScopedPhase {
+public:
+  ScopedPhase(PhaseProfiler& profiler, Phase phase)
+             : m_profiler(profiler)
+             , m_phase(phase)
+             , m_start(std::chrono::steady_clock::now())
+             {}
+
+  ~ScopedPhase() {
+    auto elapsed = std::chrono::steady_clock::now() - m_start;
+    m_profiler.record(m_phase, static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count()));
+  }
+
+private:
+  PhaseProfiler& m_profiler;
+  Phase m_phase;
+  std::chrono::steady_clock::time_point m_start;
+};
+
+} // Util
+
+#define PROFILE_CONCAT_INNER(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_INNER(a, b)
+
+// Time the rest of the enclosing scope as the given phase
+#ifdef PROFILE_PHASES
+#define PROFILE_PHASE(PROFILER, PHASE) Util::ScopedPhase PROFILE_CONCAT(scoped_phase_, __LINE__)((PROFILER), (PHASE))
+#else
+#define PROFILE_PHASE(PROFILER, PHASE) do {} while(0)
+#endif
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <cstdint>
+#include <limits>
+
+namespace Util {
+
+// SplitMix64's output function, a good 64 bit mixer
+inline uint64_t mix64(uint64_t z) {
+  z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+  z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+  return z ^ (z >> 31);
+}
+
+/**
+ *  A counter based random number generator.
+ *
+ *  Every draw is a pure function of (seed, index, stream, draw number), there's no state shared between
+ *  generators. Give particle i its own CounterRng(seed, i) and its attributes come out the same no matter
+ *  which thread makes them, or in what order. Streams keep unrelated uses of the same index apart.
+ *
+ *  Meets UniformRandomBitGenerator, so it also works with the <random> distributions.
+ **/
+class CounterRng {
+public:
+  typedef uint64_t result_type;
+
+  CounterRng(uint64_t seed, uint64_t index, uint64_t stream = 0)
+            : m_key(mix64(seed + mix64(stream + GOLDEN)))
+            , m_index(index)
+            , m_counter(0)
+            {}
+
+  uint64_t operator()() {
+    return mix64(m_key ^ mix64(m_index * GOLDEN + m_counter++));
+  }
+
+  // [0, 1)
+  double uniform() {
+    return static_cast<double>((*this)() >> 11) * (1.0 / 9007199254740992.0);
+  }
+
+  // [lo, hi)
+  double uniform(double lo, double hi) {
+    return lo + (hi - lo) * uniform();
+  }
+
+  // [lo, hi], inclusive like std::uniform_int_distribution
+  int64_t uniform_int(int64_t lo, int64_t hi) {
+    const auto range = static_cast<uint64_t>(hi - lo) + 1;
+    // range of 0 means all 64 bits, otherwise the modulo bias is negligible for the ranges we use
+    return (range == 0) ? static_cast<int64_t>((*this)()) : lo + static_cast<int64_t>((*this)() % range);
+  }
+
+  static constexpr uint64_t min() { return 0; }
+  static constexpr uint64_t max() { return std::numeric_limits<uint64_t>::max(); }
+
+private:
+  static constexpr uint64_t GOLDEN = 0x9E3779B97F4A7C15ull;
+
+  uint64_t m_key;
+  uint64_t m_index;
+  uint64_t m_counter;
+};
+
+// Which stream each use of the RNG draws from, so adding one never changes another
+enum RngStream : uint64_t {
+  Attributes = 1,
+  Placement,
+  Color,
+};
+
+} // Util
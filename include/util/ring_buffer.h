@@ -1,135 +1,294 @@
 #pragma once
+#include "util/history.h"
 #include "util/status.h"
+#include "util/trace.h"
 
-#include <algorithm>
-#include <array>
+#include <atomic>
+#include <condition_variable>
+#include <cstring>
 #include <iostream>
 #include <memory>
+#include <mutex>
 #include <thread>
 #include <type_traits>
+#include <vector>
 
 // how many, and what Elemment tyep
 namespace Util {
 /**
- *  A ring buffer with semantics to allow for delayed copying.
- *  Convenient to allow us to read/write to the same memory in high-criticality
- *  sections and defer the copy operations for later.
+ *  Publishes a container one step at a time, without copying it out from under whoever is writing it.
  *
  *  C is a container which must implement the named requirements of SequenceContainer
  *  https://en.cppreference.com/w/cpp/named_req/SequenceContainer
  *
  *  E is the element type
  *
- *  T is the size
+ *  The writer fills a buffer from a pool of recycled ones, next(), reading the last frame out of latest() as
+ *  it goes (carry()), and put() hands it to readers as it is, as an immutable frame. Nothing is copied to
+ *  publish. Readers hold a frame() for as long as they like and it won't change under them, a buffer only
+ *  goes back in the pool once nobody holds it. So the pool stays a few buffers big and nothing allocates
+ *  once it's there.
  *
- *  Technically only loosely thread safe. put() is essesntially atomic as long as there
- *  is only 1 consumer of the ring buffer
+ *  The last `depth` frames are also kept delta compressed in a FrameHistory, and can be had back with
+ *  history() or gone back to with rewind(). That's encoded on a thread of its own, from the published
+ *  frame, while the writer gets on with the next one. There's only ever one frame waiting on it, put()
+ *  waits for the one before if it's still going. A depth of 0 keeps no history, and never starts the thread.
+ *
+ *  One writer, which owns the working buffer and calls put(). frame(), history() and friends are safe from
+ *  any thread.
  *
  **/
-template<typename C, typename E, std::size_t T>
-class ThreadedRingBuffer;
-
-template<typename C, typename E, size_t T>
-void ring_thread(ThreadedRingBuffer<C, E, T>&);
-
-template<typename C, typename E, std::size_t T>
+template<typename C, typename E>
 class ThreadedRingBuffer {
 static_assert(std::is_same<typename C::value_type, E>::value, "Container must have same elements as element type!");
 
 public:
-  ThreadedRingBuffer()
-        : m_current_idx(0)
-        , m_buffer(std::make_shared<C>())
-        , needs_commit(false)
-        , has_latest(false)
-        {}
+  explicit ThreadedRingBuffer(size_t depth = DEFAULT_DEPTH)
+        : m_buffer(std::make_shared<C>())
+        , m_latest(std::make_shared<const C>())
+        , m_history(depth)
+        , m_depth(depth)
+        {
+          m_pool.push_back(m_buffer);
+        }
+
+  ThreadedRingBuffer(const ThreadedRingBuffer&) = delete;
+  ThreadedRingBuffer& operator=(const ThreadedRingBuffer&) = delete;
+
+  ~ThreadedRingBuffer() {
+    if (!m_encoder.joinable()) {
+      return;
+    }
+    {
+      std::lock_guard<std::mutex> lock(m_encode_lock);
+      m_stop = true;
+    }
+    m_encode_ready.notify_all();
+    m_encoder.join();
+  }
+
+  static constexpr size_t DEFAULT_DEPTH = 10;
+
+  // write to the working buffer only, readers see it after publish() or the next put()
+  void push_back(const E& ele) {
+    working().push_back(ele);
+  }
+
+  // make room in the working buffer for this many elements before a lot of push_back()s
+  void reserve(size_t n) {
+    working().reserve(n);
+  }
 
-  // write-through to the working buffer
-  void push_back(E ele) {
-    m_buffer->push_back(ele);
-    m_items[m_current_idx].push_back(ele);
+  // publish the working buffer right now, and start the history over from it
+  void publish() {
+    flush();
+    {
+      std::lock_guard<std::mutex> lock(m_history_lock);
+      m_history.clear();
+    }
+    put();
   }
 
-  // tell the ringbuffer you're ready to commit
+  // publish the working buffer as the newest frame, as it is
   void put() {
-    needs_commit = true;
+    Util::Trace::instant("ring_put");
+    hand_over();
+    if (m_depth == 0) {
+      return;
+    }
+
+    // off to be encoded, once the last one has been
+    if (!m_encoder.joinable()) {
+      m_encoder = std::thread(&ThreadedRingBuffer::encoder, this);
+    }
+    {
+      TRACE_SPAN("ring_history_wait");
+      std::unique_lock<std::mutex> lock(m_encode_lock);
+      m_encode_done.wait(lock, [this]() { return m_encoding == nullptr; });
+      m_encoding = m_latest;
+    }
+    m_encode_ready.notify_one();
+  }
+
+  // the newest frame, which stays as it is for as long as it's held. Safe from any thread.
+  std::shared_ptr<const C> frame() const {
+    return std::atomic_load(&m_latest);
   }
 
-  // get read-only access to the latest item in a good state
+  // The same without the handle, for the writer only. Others might see it recycled out from under them.
   const C& latest() const {
-    return m_items[m_current_idx];
+    return *m_latest;
+  }
+
+  // A buffer for the next frame, the same size as latest() but still holding whatever it held last time
+  // round. Every element has to be written, carry() for the ones which start as they were.
+  C& next() {
+    m_buffer = recycle();
+    m_buffer->resize(m_latest->size());
+    return *m_buffer;
+  }
+
+  // element i of latest() into the same place in the buffer from next(), byte for byte so the history's
+  // deltas don't pick up whatever was in the padding
+  E& carry(size_t i) {
+    E& to = (*m_buffer)[i];
+    std::memcpy(&to, &(*m_latest)[i], sizeof(E));
+    return to;
+  }
+
+  // all of latest() into the buffer from next()
+  void carry() {
+    FrameHistory<C>::copy(*m_latest, *m_buffer);
   }
 
-  static void start(ThreadedRingBuffer& trb) {
-    std::thread th = std::thread(ring_thread, trb);
-    th.detach();
+  // The working buffer, which can be freely written to until put() hands it over. Since the last put()
+  // that's a copy of latest(), made now if next() hasn't been called.
+  C& working() {
+    if (m_buffer == nullptr) {
+      next();
+      carry();
+    }
+    return *m_buffer;
   }
 
-  // gets a writable container
-  // Status::Success if the buffer is valid and ready
-  // Status::NotReady if we're busy
-  // this buffer can be freely written to until put() is called,
-  //   at which point callers must successfully call get_writeable() again
-  Status get_writeable(std::shared_ptr<C>& ptr) {
-    if (needs_commit) {
-      return Status::NotReady;
+  // how many put()s back history() can go, 0 for none at all. For the writer.
+  void set_depth(size_t depth) {
+    flush();
+    std::lock_guard<std::mutex> lock(m_history_lock);
+    if (depth == 0) {
+      m_history.clear();
     } else {
-      ptr = m_buffer;
+      m_history.set_depth(depth);
     }
-    return Status::Success;
+    m_depth = depth;
   }
 
-  size_t size() const { return T; }
+  size_t size() const {
+    std::lock_guard<std::mutex> lock(m_history_lock);
+    return m_depth;
+  }
 
-  size_t get_idx() const { return m_current_idx; }
+  // a copy of what frame() was `back` put()s ago, 0 being frame() itself. Safe from any thread.
+  // Status::Failure if we don't have that far back (yet)
+  Status history(size_t back, C& out) const {
+    flush();
+    std::lock_guard<std::mutex> lock(m_history_lock);
+    return m_history.get(back, out);
+  }
 
-  template<typename Cc, typename Ec, size_t Tc>
-  friend void ring_thread(ThreadedRingBuffer<Cc, Ec, Tc>&);
+  // how many frames history() has right now
+  size_t history_size() const {
+    flush();
+    std::lock_guard<std::mutex> lock(m_history_lock);
+    return m_history.size();
+  }
 
-  template<typename Cc, typename Ec, size_t Tc>
-  friend std::ostream& operator<<(std::ostream&, const ThreadedRingBuffer<Cc, Ec, Tc>&);
+  // memory held for history(), give or take
+  size_t history_bytes() const {
+    std::lock_guard<std::mutex> lock(m_history_lock);
+    return m_history.bytes();
+  }
 
-private:
-  size_t get_next_idx() const {
-    return (m_current_idx + 1) % T;
+  // Roll back to history(back) and forget everything newer, then publish it.
+  // For the writer, between put()s.
+  // Status::Failure if we don't go back that far
+  Status rewind(size_t back) {
+    flush();
+    {
+      std::lock_guard<std::mutex> lock(m_history_lock);
+      const Status status = m_history.rewind(back, working());
+      if (status != Status::Success) {
+        return status;
+      }
+    }
+    // it's history(0) already
+    hand_over();
+    return Status::Success;
   }
 
-  size_t get_last_idx() const {
-    return (m_current_idx == 0) ? T - 1 : m_current_idx - 1;
+  // buffers in the pool, the working one and every frame someone's holding included
+  size_t pool_size() const { return m_pool.size(); }
+
+private:
+  // A buffer nobody else is holding. Only the pool has a hold of those, and nobody can get a new one on a
+  // frame that isn't the latest, so once we see a count of 1 it's ours.
+  std::shared_ptr<C> recycle() {
+    std::shared_ptr<C> next;
+    for (const auto& buffer : m_pool) {
+      if (buffer.use_count() == 1) {
+        next = buffer;
+        break;
+      }
+    }
+    if (next == nullptr) {
+      next = std::make_shared<C>();
+      m_pool.push_back(next);
+    }
+    // whoever let go of it last is done reading it
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return next;
   }
 
-  size_t m_current_idx;
-  std::array<C, T> m_items;
-  std::shared_ptr<C> m_buffer;
-  volatile bool needs_commit;
-  bool has_latest;
-};
+  // readers get the working buffer as it is, and there's no working buffer until next()
+  void hand_over() {
+    working();
+    std::atomic_store(&m_latest, std::shared_ptr<const C>(m_buffer));
+    m_buffer.reset();
+  }
 
-template<typename C, typename E, size_t T>
-std::ostream& operator<<(std::ostream& os, const ThreadedRingBuffer<C, E, T>& buffer) {
-  os << "RingBuffer @ " << &buffer << std::endl;
-  os << "Size: " << buffer.size() << " Current Idx: " << buffer.get_idx() << std::endl;
-  os << "Next Idx: " << buffer.get_next_idx() << " Last Idx: " << buffer.get_last_idx();
-  return os;
-}
+  // wait until history() has everything put()
+  void flush() const {
+    std::unique_lock<std::mutex> lock(m_encode_lock);
+    m_encode_done.wait(lock, [this]() { return m_encoding == nullptr; });
+  }
 
-template<typename C, typename E, size_t T>
-void ring_thread(ThreadedRingBuffer<C, E, T>& trb) {
-  while(true) {
-    while (!trb.needs_commit) {
-      // try to be a good citizen
-      std::this_thread::sleep_for(std::chrono::microseconds(50));
+  // the history's own thread, encoding each frame put() hands it
+  void encoder() {
+    Util::Trace::set_thread_name("ring_history");
+    std::unique_lock<std::mutex> lock(m_encode_lock);
+    while (true) {
+      m_encode_ready.wait(lock, [this]() { return m_stop or m_encoding != nullptr; });
+      if (m_stop) {
+        return;
+      }
+      const auto frame = m_encoding;
+      lock.unlock();
+      {
+        TRACE_SPAN("ring_history");
+        std::lock_guard<std::mutex> history_lock(m_history_lock);
+        m_history.push(*frame);
+      }
+      lock.lock();
+      m_encoding = nullptr;
+      m_encode_done.notify_all();
     }
+  }
 
-    // write to the next idx of the buffer, which we will then mark as ready
-    auto& from = trb.m_buffer;
-    auto& to = trb.m_items[trb.get_next_idx()];
+  std::shared_ptr<C> m_buffer;
+  std::shared_ptr<const C> m_latest;
+  std::vector<std::shared_ptr<C>> m_pool;
+  FrameHistory<C> m_history;
+  // what set_depth() asked for, m_history keeps at least 1
+  size_t m_depth;
+  mutable std::mutex m_history_lock;
 
-    to = (*from);
+  // The frame waiting on (or being encoded by) the encoder, nullptr once it's in the history.
+  // The encoder is only started by the first put() with a depth.
+  std::shared_ptr<const C> m_encoding;
+  bool m_stop = false;
+  mutable std::mutex m_encode_lock;
+  std::condition_variable m_encode_ready;
+  mutable std::condition_variable m_encode_done;
+  std::thread m_encoder;
+};
 
-    trb.m_current_idx = trb.get_next_idx();
-    trb.needs_commit = false;
-  }
+template<typename C, typename E>
+std::ostream& operator<<(std::ostream& os, const ThreadedRingBuffer<C, E>& buffer) {
+  os << "RingBuffer @ " << &buffer << std::endl;
+  os << "Depth: " << buffer.size() << " History: " << buffer.history_size() << " frames, "
+     << buffer.history_bytes() << " bytes" << std::endl;
+  os << "Pool: " << buffer.pool_size() << " buffers";
+  return os;
 }
 
 } // Util
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+
+namespace Util {
+
+/**
+ *  Keeps a loop ticking at a fixed rate without burning a core doing it.
+ *
+ *  wait() sleeps until the next tick is due. The OS is only good for a tick's deadline to within a
+ *  fraction of a millisecond, so we wake up a little early and spin (yielding) the rest of the way.
+ *  When the loop falls behind wait() doesn't sleep at all, it says how many ticks are due so they
+ *  can be run back to back and we catch up. That's capped, anything beyond the cap is dropped rather
+ *  than owed, so one long stall doesn't turn into a long burst of steps at full tilt.
+ *
+ *  Single thread, whoever calls wait().
+ **/
+class TickScheduler {
+public:
+  typedef std::chrono::steady_clock clock;
+
+  // where the time comes from and how we wait for it, the steady clock and the OS unless a test says otherwise
+  class TimeSource {
+  public:
+    virtual ~TimeSource() = default;
+    virtual clock::time_point now() = 0;
+    virtual void sleep_until(clock::time_point) = 0;
+    virtual void yield() = 0;
+  };
+
+  static TimeSource& steady_time();
+
+  // how many ticks to run in one go when we're behind
+  static constexpr size_t DEFAULT_CATCH_UP = 5;
+  // how long before a deadline we stop sleeping and spin
+  static constexpr std::chrono::microseconds DEFAULT_SPIN{200};
+
+  explicit TickScheduler(std::chrono::microseconds period,
+                         size_t max_catch_up = DEFAULT_CATCH_UP,
+                         std::chrono::microseconds spin = DEFAULT_SPIN,
+                         TimeSource& time = steady_time());
+
+  // block until the next tick, and say how many are due: at least 1, at most the catch up cap
+  size_t wait();
+
+  // the first tick is due right now, forgetting anything we were behind by (after a pause, say)
+  void restart();
+
+  void set_catch_up(size_t max_catch_up) { m_max_catch_up = (max_catch_up == 0) ? 1 : max_catch_up; }
+
+  // ticks wait() has handed out
+  uint64_t ticks() const { return m_ticks; }
+
+  // ticks which came due more than a whole period late
+  uint64_t missed() const { return m_missed; }
+
+  // ticks which were past the catch up cap and never ran
+  uint64_t dropped() const { return m_dropped; }
+
+  // fraction of the time since restart() spent waiting rather than working
+  double idle() const;
+
+  void report(std::ostream&) const;
+
+private:
+  std::chrono::microseconds m_period;
+  size_t m_max_catch_up;
+  std::chrono::microseconds m_spin;
+  TimeSource& m_time;
+
+  clock::time_point m_start;
+  clock::time_point m_deadline;
+  clock::duration m_waited;
+
+  uint64_t m_ticks = 0;
+  uint64_t m_missed = 0;
+  uint64_t m_dropped = 0;
+};
+
+} // Util
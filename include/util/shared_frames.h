@@ -0,0 +1,71 @@
+#pragma once
+#include "util/shm_frame.h"
+#include "util/status.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace Util {
+
+/**
+ *  The writing end of util/shm_frame.h, frames out to a POSIX shared memory region other processes can read
+ *  in place while the simulation carries on.
+ *
+ *  Each frame goes begin(), fill in the particles it handed back, commit(). The slot being written is the
+ *  one readers aren't meant to be looking at, and its sequence is odd until commit(), so a reader that was
+ *  too slow finds out from sim_shm_end() rather than getting half of one frame and half of the next. The
+ *  region only ever grows, by doubling, when a frame doesn't fit.
+ *
+ *  Single writer, from the simulation thread.
+ **/
+class SharedFrames {
+public:
+  SharedFrames() = default;
+  SharedFrames(const SharedFrames&) = delete;
+  SharedFrames& operator=(const SharedFrames&) = delete;
+
+  ~SharedFrames() { close(); }
+
+  // Create (or take over) the region, e.g. "/sim-frames", with room for this many particles to begin with.
+  // Already open under the same name is fine and keeps it. Status::Failure if it can't be made.
+  Status open(const std::string& name, size_t capacity);
+
+  // Unmap it, and unlink it so nobody new can open it. Readers who have it mapped keep what they've got.
+  void close();
+
+  bool is_open() const { return m_base != nullptr; }
+  const std::string& name() const { return m_name; }
+
+  // Somewhere to write a frame of count particles, nullptr if the region couldn't be made big enough
+  sim_shm_particle* begin(size_t count);
+
+  // The frame's done, hand it to the readers
+  void commit(uint64_t step, double time, double width, double height);
+
+  // frames committed, and particles each slot has room for right now
+  uint64_t generation() const { return m_generation; }
+  size_t capacity() const { return m_capacity; }
+
+private:
+  // more room, keeping the sequences
+  Status grow(size_t capacity);
+
+  sim_shm_header* header() const { return static_cast<sim_shm_header*>(m_base); }
+  sim_shm_slot* slot(size_t i) const { return sim_shm_slot_at(m_base, m_capacity, i); }
+
+  std::string m_name;
+  int m_fd = -1;
+  void* m_base = nullptr;
+  size_t m_size = 0;
+  size_t m_capacity = 0;
+
+  // where each slot's sequence is at, so it carries on over a resize
+  uint64_t m_sequence[SIM_SHM_SLOTS] = {};
+  uint64_t m_generation = 0;
+  size_t m_latest = 0;
+  size_t m_writing = 0;
+  size_t m_count = 0;
+};
+
+} // Util
@@ -0,0 +1,231 @@
+/*
+ *  Reading the simulation's frames straight out of shared memory, see --shm.
+ *
+ *  Plain C (and C++), POSIX and GCC/Clang atomics only, so it can be dropped into whatever's doing the analysis.
+ *  Link with -lrt on glibc older than 2.34.
+ *
+ *  The region is a sim_shm_header and then two slots, each a sim_shm_slot and room for `capacity` particles.
+ *  The simulation writes each frame into whichever slot isn't the latest, then points `latest` at it, so a
+ *  reader has a whole step to look at a frame before it's written over. Each slot is a seqlock, its sequence
+ *  is odd while it's being written and goes up by 2 per frame. Nothing's copied and nobody takes a lock:
+ *
+ *      sim_shm_reader reader;
+ *      if (sim_shm_open(&reader, "/sim-frames") != 0) { ...errno... }
+ *      sim_shm_view view;
+ *      do {
+ *        if (sim_shm_begin(&reader, &view) != 0) { ...nothing yet, or the simulation has gone... }
+ *        for (uint64_t i = 0; i < view.count; i++) { ...view.particles[i]... }
+ *      } while (!sim_shm_end(&reader, &view));   // written over while we were looking, do it again
+ *      sim_shm_close(&reader);
+ *
+ *  Anything worked out from a view is only good if sim_shm_end() says so. When there are more particles than
+ *  fit, the simulation makes the region bigger, and sim_shm_begin() maps it again.
+ *
+ *  The region's unlinked when the simulation's done with it. One that's killed leaves it in /dev/shm, until
+ *  the next run with the same name replaces it.
+ */
+
+#ifndef SIM_SHM_FRAME_H
+#define SIM_SHM_FRAME_H
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define SIM_SHM_MAGIC 0x3130464D48534D53ull /* "SMSHMF01" */
+#define SIM_SHM_SLOTS 2
+/* how many times sim_shm_begin() looks before giving up on a slot being written */
+#define SIM_SHM_TRIES 1000
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Always double, whatever the simulation runs in */
+struct sim_shm_particle {
+  uint64_t uid;
+  double x;
+  double y;
+  double vx;
+  double vy;
+  double radius;
+  double mass;
+};
+
+struct sim_shm_header {
+  uint64_t magic;
+  uint64_t layout;            /* odd while the region's being resized, up by 2 each time */
+  uint64_t capacity;          /* particles each slot has room for */
+  uint64_t latest;            /* the slot last written */
+  uint64_t generation;        /* frames written so far */
+  uint64_t reserved[3];
+};
+
+struct sim_shm_slot {
+  uint64_t sequence;          /* odd while being written */
+  uint64_t step;
+  uint64_t count;
+  double time;                /* simulated seconds */
+  double width;               /* of the box, centered about the origin */
+  double height;
+  uint64_t reserved[2];
+};
+
+static inline size_t sim_shm_slot_bytes(uint64_t capacity) {
+  return sizeof(struct sim_shm_slot) + (size_t)capacity * sizeof(struct sim_shm_particle);
+}
+
+static inline size_t sim_shm_bytes(uint64_t capacity) {
+  return sizeof(struct sim_shm_header) + SIM_SHM_SLOTS * sim_shm_slot_bytes(capacity);
+}
+
+static inline struct sim_shm_slot* sim_shm_slot_at(void* base, uint64_t capacity, uint64_t slot) {
+  return (struct sim_shm_slot*)((char*)base + sizeof(struct sim_shm_header) + slot * sim_shm_slot_bytes(capacity));
+}
+
+typedef struct sim_shm_reader {
+  int fd;
+  void* base;
+  size_t size;
+  uint64_t capacity;          /* as mapped */
+} sim_shm_reader;
+
+typedef struct sim_shm_view {
+  const struct sim_shm_particle* particles;
+  uint64_t count;
+  uint64_t step;
+  double time;
+  double width;
+  double height;
+  uint64_t generation;
+  /* for sim_shm_end() */
+  const struct sim_shm_slot* slot;
+  uint64_t sequence;
+  uint64_t layout;
+} sim_shm_view;
+
+/* Map whatever's there now. 0 on success, -1 and errno otherwise */
+static inline int sim_shm_map(sim_shm_reader* r) {
+  struct stat st;
+  void* base;
+  if (fstat(r->fd, &st) != 0) {
+    return -1;
+  }
+  if ((size_t)st.st_size < sizeof(struct sim_shm_header)) {
+    errno = EAGAIN;
+    return -1;
+  }
+  base = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, r->fd, 0);
+  if (base == MAP_FAILED) {
+    return -1;
+  }
+  if (r->base != NULL) {
+    munmap(r->base, r->size);
+  }
+  r->base = base;
+  r->size = (size_t)st.st_size;
+  r->capacity = __atomic_load_n(&((const struct sim_shm_header*)base)->capacity, __ATOMIC_ACQUIRE);
+  return 0;
+}
+
+/* 0 on success, -1 and errno otherwise. EPROTO if it's not a region the simulation made */
+static inline int sim_shm_open(sim_shm_reader* r, const char* name) {
+  r->base = NULL;
+  r->size = 0;
+  r->capacity = 0;
+  r->fd = shm_open(name, O_RDONLY, 0);
+  if (r->fd < 0) {
+    return -1;
+  }
+  if (sim_shm_map(r) != 0) {
+    close(r->fd);
+    r->fd = -1;
+    return -1;
+  }
+  if (((const struct sim_shm_header*)r->base)->magic != SIM_SHM_MAGIC) {
+    munmap(r->base, r->size);
+    close(r->fd);
+    r->fd = -1;
+    r->base = NULL;
+    errno = EPROTO;
+    return -1;
+  }
+  return 0;
+}
+
+static inline void sim_shm_close(sim_shm_reader* r) {
+  if (r->base != NULL) {
+    munmap(r->base, r->size);
+    r->base = NULL;
+  }
+  if (r->fd >= 0) {
+    close(r->fd);
+    r->fd = -1;
+  }
+}
+
+/* Look at the latest frame, in place. 0 on success, -1 with errno EAGAIN if there's no frame yet or the
+   simulation's stuck mid-write (gone?), or whatever errno mapping the region again failed with. */
+static inline int sim_shm_begin(sim_shm_reader* r, sim_shm_view* v) {
+  int tries;
+  for (tries = 0; tries < SIM_SHM_TRIES; tries++) {
+    const struct sim_shm_header* header = (const struct sim_shm_header*)r->base;
+    const uint64_t layout = __atomic_load_n(&header->layout, __ATOMIC_ACQUIRE);
+    uint64_t latest;
+    const struct sim_shm_slot* slot;
+    if (layout & 1) {
+      continue;
+    }
+    if (__atomic_load_n(&header->capacity, __ATOMIC_ACQUIRE) != r->capacity ||
+        sim_shm_bytes(r->capacity) > r->size) {
+      /* it's grown */
+      if (sim_shm_map(r) != 0) {
+        return -1;
+      }
+      continue;
+    }
+
+    latest = __atomic_load_n(&header->latest, __ATOMIC_ACQUIRE);
+    slot = sim_shm_slot_at(r->base, r->capacity, latest % SIM_SHM_SLOTS);
+    v->sequence = __atomic_load_n(&slot->sequence, __ATOMIC_ACQUIRE);
+    if (v->sequence == 0 || (v->sequence & 1)) {
+      /* nothing written yet, or it's being written right now */
+      continue;
+    }
+
+    v->slot = slot;
+    v->layout = layout;
+    v->generation = __atomic_load_n(&header->generation, __ATOMIC_RELAXED);
+    v->count = slot->count;
+    v->step = slot->step;
+    v->time = slot->time;
+    v->width = slot->width;
+    v->height = slot->height;
+    v->particles = (const struct sim_shm_particle*)(slot + 1);
+    if (v->count > r->capacity) {
+      /* torn, it's being written over already */
+      continue;
+    }
+    return 0;
+  }
+  errno = EAGAIN;
+  return -1;
+}
+
+/* 1 if nothing read from the view since sim_shm_begin() was written over meanwhile, 0 if it has to be thrown away */
+static inline int sim_shm_end(const sim_shm_reader* r, const sim_shm_view* v) {
+  const struct sim_shm_header* header = (const struct sim_shm_header*)r->base;
+  __atomic_thread_fence(__ATOMIC_ACQUIRE);
+  return __atomic_load_n(&v->slot->sequence, __ATOMIC_RELAXED) == v->sequence &&
+         __atomic_load_n(&header->layout, __ATOMIC_RELAXED) == v->layout;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SIM_SHM_FRAME_H */
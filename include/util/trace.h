@@ -0,0 +1,124 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+namespace Util {
+namespace Trace {
+
+/**
+ *  A timeline of what every thread was doing, written out as Chrome trace JSON
+ *  (load it in chrome://tracing or https://ui.perfetto.dev).
+ *
+ *  Each thread records into its own fixed size buffer, so recording never locks or allocates.
+ *  When a buffer fills it wraps and we keep the most recent events.
+ *  Tracing is off until enable() is called, a disabled span costs one relaxed atomic load.
+ *  write() holds recording off while it reads the buffers, threads carry on regardless but record nothing.
+ **/
+
+// 4MB per thread, a little over a minute of the simulation thread at full tilt
+static constexpr size_t EVENTS_PER_THREAD = 1 << 17;
+
+enum class EventType : uint8_t {
+  Span,     ///<< something that took time
+  Instant,  ///<< something that happened
+};
+
+struct Event {
+  const char* name; ///<< must be a string literal, or otherwise live for the life of the program
+  uint64_t ts_ns;
+  uint64_t dur_ns;
+  EventType type;
+};
+
+extern std::atomic<bool> g_enabled;
+
+// Single writer, the thread which owns it. write() only reads it once recording is off and no push() is under way.
+struct ThreadBuffer {
+  ThreadBuffer(uint32_t id)
+              : tid(id)
+              , name(nullptr)
+              , head(0)
+              , busy(false)
+              , events(std::make_unique<std::array<Event, EVENTS_PER_THREAD>>())
+              {}
+
+  void push(const Event& e) {
+    // Either write() sees we're busy and waits for us, or we see it has turned recording off. Both are seq_cst.
+    busy.store(true);
+    if (g_enabled.load()) {
+      uint64_t idx = head.load(std::memory_order_relaxed);
+      (*events)[idx % EVENTS_PER_THREAD] = e;
+      head.store(idx + 1, std::memory_order_relaxed);
+    }
+    busy.store(false, std::memory_order_release);
+  }
+
+  const uint32_t tid;
+  const char* name;
+  std::atomic<uint64_t> head;
+  std::atomic<bool> busy;
+  std::unique_ptr<std::array<Event, EVENTS_PER_THREAD>> events;
+};
+
+// Start recording
+void enable();
+
+inline bool enabled() {
+  return g_enabled.load(std::memory_order_relaxed);
+}
+
+// This thread's buffer, created on first use
+ThreadBuffer& thread_buffer();
+
+// Label the calling thread in the timeline
+void set_thread_name(const char*);
+
+// nanoseconds since tracing started
+uint64_t now_ns();
+
+// Record that something happened, right now
+inline void instant(const char* name) {
+  if (enabled()) {
+    thread_buffer().push({name, now_ns(), 0, EventType::Instant});
+  }
+}
+
+// Write everything recorded so far as Chrome trace JSON, recording pauses while we do
+// false if the file could not be written
+bool write(const std::string& path);
+
+// Records the lifetime of the enclosing scope
+class Span {
+public:
+  Span(const char* name)
+      : m_name(name)
+      , m_recording(enabled())
+      , m_start(m_recording ? now_ns() : 0)
+      {}
+
+  ~Span() {
+    if (m_recording) {
+      uint64_t end = now_ns();
+      thread_buffer().push({m_name, m_start, end - m_start, EventType::Span});
+    }
+  }
+
+private:
+  const char* m_name;
+  bool m_recording;
+  uint64_t m_start;
+};
+
+} // Trace
+} // Util
+
+#define TRACE_CONCAT_INNER(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_INNER(a, b)
+
+// Record the rest of the enclosing scope as a span named NAME
+#define TRACE_SPAN(NAME) Util::Trace::Span TRACE_CONCAT(trace_span_, __LINE__)(NAME)
@@ -1,16 +1,26 @@
 #pragma once
 #include "context.h"
 
+#include <cstdint>
 #include <tuple>
 #include <vector>
 
+namespace Stream {
+class Client;
+}
+
 namespace Graphics {
 
 // a simple way to convery to main() if this thread is running
 extern bool g_window_running;
 
+// colors are per-particle 0xRRGGBB, e.g. from a scene. Leave empty for the usual coloring.
 template <typename V>
-void SimulationWindowThread(const Simulation::SimulationContext<V>& sim, Simulation::SimSettings<typename V::vector_t> settings);
+void SimulationWindowThread(const Simulation::SimulationContext<V>& sim, Simulation::SimSettings<typename V::vector_t> settings,
+                            const std::vector<uint32_t>& colors);
+
+// the same, for a simulation streaming from elsewhere. Runs until the window's closed.
+void StreamWindowThread(const Stream::Client& client, Simulation::SimSettings<float> settings);
 
 // Get the dimensions of the screen.
 template<typename VT>
@@ -1,8 +1,10 @@
 #include "cli.h"
 #include "component.h"
+#include "stream.h"
 #include "util/fixed_point.h"
 
 #include <iostream>
+#include <random>
 
 // No constexpr std::string until C++20 :(
 static constexpr char help_str[] = "help";
@@ -21,13 +23,35 @@ static constexpr char color_str[] = "color";
 static constexpr char color_range_str[] = "color-range";
 static constexpr char gravity_str[] = "gravity";
 static constexpr char gravity_angle_str[] = "gravity-angle";
+static constexpr char mutual_gravity_str[] = "mutual-gravity";
+static constexpr char gravity_theta_str[] = "gravity-theta";
+static constexpr char gravity_softening_str[] = "gravity-softening";
+static constexpr char max_substep_level_str[] = "max-substep-level";
+static constexpr char history_depth_str[] = "history-depth";
+static constexpr char catch_up_str[] = "catch-up";
+static constexpr char sleep_steps_str[] = "sleep-steps";
+static constexpr char sleep_energy_str[] = "sleep-energy";
 static constexpr char display_str[] = "display";
 static constexpr char delay_str[] = "delay";
+static constexpr char seed_str[] = "seed";
+static constexpr char scene_str[] = "scene";
+static constexpr char ensemble_str[] = "ensemble";
+static constexpr char ensemble_out_str[] = "ensemble-out";
+static constexpr char observables_str[] = "observables";
+static constexpr char observables_every_str[] = "observables-every";
+static constexpr char energy_audit_str[] = "energy-audit";
+static constexpr char energy_drift_str[] = "energy-drift";
+static constexpr char stream_str[] = "stream";
+static constexpr char shm_str[] = "shm";
 static constexpr char no_full_screen_str[] = "no-full-screen";
 static constexpr char debug_no_gui_str[] = "debug-no-gui";
 static constexpr char debug_trace_str[] = "debug-trace";
 static constexpr char debug_extra_trace_str[] = "debug-extra-trace";
 static constexpr char debug_info_str[] = "debug-info";
+static constexpr char debug_profile_dump_str[] = "debug-profile-dump";
+static constexpr char debug_chrome_trace_str[] = "debug-chrome-trace";
+static constexpr char debug_perf_str[] = "debug-perf";
+static constexpr char debug_event_log_str[] = "debug-event-log";
 namespace Cli {
 
 template <typename Vt>
@@ -38,8 +62,7 @@ Status parse_cli_args(int argc, char** argv, po::variables_map& vm, Simulation::
       (help_str, "Display this help message.")
       (p_count_str,
         po::value<size_t>(&settings.number_particles)->default_value(Simulation::DefaultSettings<vector_t>.number_particles),
-        "Total number of particles. Increasing this without decreasing radii may result in an expensive (i.e. long-running) computation "
-        "to ensure particles do not overlap.")
+        "Total number of particles. If they can't all fit on screen without overlapping, the extras are left out.")
       (v_min_str,
         po::value<int>(&settings.vmin)->default_value(Simulation::DefaultSettings<vector_t>.vmin),
         "Minimum starting velocity. Randomized within a default range if unspecified.")
@@ -82,12 +105,75 @@ Status parse_cli_args(int argc, char** argv, po::variables_map& vm, Simulation::
       (gravity_angle_str,
         po::value<float>(&settings.gravity_angle)->default_value(Simulation::DefaultSettings<vector_t>.gravity_angle),
         "Commit crimes against nature. Direction of the gravity vector (in degrees from the horizontal).")
+      (mutual_gravity_str,
+        po::value<vector_t>(&settings.mutual_gravity)->default_value(Simulation::DefaultSettings<vector_t>.mutual_gravity),
+        "Particles attract each other, with this gravitational constant. Works alongside --gravity.")
+      (gravity_theta_str,
+        po::value<float>(&settings.gravity_theta)->default_value(Simulation::DefaultSettings<vector_t>.gravity_theta),
+        "Requires --mutual-gravity. Lower is more accurate and slower, 0 sums every pair exactly.")
+      (gravity_softening_str,
+        po::value<float>(&settings.gravity_softening)->default_value(Simulation::DefaultSettings<vector_t>.gravity_softening),
+        "Requires --mutual-gravity. Distance over which the pull between close particles is smoothed out.")
+      (max_substep_level_str,
+        po::value<size_t>(&settings.max_substep_level)->default_value(Simulation::DefaultSettings<vector_t>.max_substep_level),
+        "Particles fast enough to cover more than the minimum radius in a step are split into up to 2^this sub-steps, "
+        "everyone else still steps once. 0 steps everyone together.")
+      (history_depth_str,
+        po::value<size_t>(&settings.history_depth)->default_value(Simulation::DefaultSettings<vector_t>.history_depth),
+        "How many steps back the simulation can be rewound (left/right in the window, P to carry on from there). "
+        "Old steps are kept as compressed differences, so this is cheap to raise. None are kept without the window.")
+      (catch_up_str,
+        po::value<size_t>(&settings.max_catch_up)->default_value(Simulation::DefaultSettings<vector_t>.max_catch_up),
+        "When a step takes longer than real time allows, run up to this many back to back to catch up. "
+        "Anything more is skipped, so the simulation slows down instead of lurching.")
+      (sleep_steps_str,
+        po::value<size_t>(&settings.sleep_steps)->default_value(Simulation::DefaultSettings<vector_t>.sleep_steps),
+        "Put particles to sleep once they (and everyone touching them) have been still this many steps in a row. "
+        "Sleeping particles cost next to nothing until something knocks them. 0 to keep everyone awake.")
+      (sleep_energy_str,
+        po::value<vector_t>(&settings.sleep_energy)->default_value(Simulation::DefaultSettings<vector_t>.sleep_energy),
+        "Requires --sleep-steps, kinetic energy below which a particle counts as still.")
       (display_str,
         po::bool_switch(&settings.display_mode)->default_value(Simulation::DefaultSettings<vector_t>.display_mode),
         "Zero velocity, just view colors. Useful for checking initial conditions for e.g. making an interesting pattern.")
       (delay_str,
         po::value(&settings.delay)->default_value(Simulation::DefaultSettings<vector_t>.delay),
         "Delay before we start running the simulation, in seconds.")
+      (seed_str,
+        po::value<uint64_t>(&settings.seed)->default_value(Simulation::DefaultSettings<vector_t>.seed),
+        "Seed for the initial conditions and colors. The same seed always gives the same start. Random if 0 or unspecified.")
+      (scene_str,
+        po::value<std::string>(&settings.scene),
+        "Load particles from a scene file instead of generating them. Binary scenes or text lines of x, y, vx, vy, radius, mass[, r, g, b].")
+      (ensemble_str,
+        po::value<std::string>(&settings.ensemble),
+        "Headless, run a simulation for every combination of options in this sweep file, many at once. "
+        "Lines are `--option value...` to sweep over, plus `steps N` and `threads N`. Everything else on the command line applies to every run.")
+      (ensemble_out_str,
+        po::value<std::string>(&settings.ensemble_out)->default_value(Simulation::DefaultSettings<vector_t>.ensemble_out),
+        "Requires --ensemble, write a CSV summary of every run here.")
+      (observables_str,
+        po::value<std::string>(&settings.observables),
+        "Stream kinetic energy, temperature, wall pressure and a histogram of speeds to this file as CSV while running. "
+        "With --ensemble each run gets its own, suffixed with the run number.")
+      (observables_every_str,
+        po::value<size_t>(&settings.observables_every)->default_value(Simulation::DefaultSettings<vector_t>.observables_every),
+        "Requires --observables, steps between samples.")
+      (energy_audit_str,
+        po::value<size_t>(&settings.energy_audit)->default_value(Simulation::DefaultSettings<vector_t>.energy_audit),
+        "Every collision and bounce keeps a running account of the energy, this often (in steps) it's checked against "
+        "a full recount. 0 never recounts, and never warns.")
+      (energy_drift_str,
+        po::value<float>(&settings.energy_drift)->default_value(Simulation::DefaultSettings<vector_t>.energy_drift),
+        "Warn when collisions and bounces have made up or lost this fraction of the system's energy. 0 never warns.")
+      (stream_str,
+        po::value<std::string>(&settings.stream),
+        "Stream frames to viewers (bin/stream_view) at unix:<path> or tcp:<port>, localhost only. Works headless too, "
+        "but not with --ensemble.")
+      (shm_str,
+        po::value<std::string>(&settings.shm),
+        "Export every frame to the POSIX shared memory region with this name (/something), for other processes to "
+        "read in place. See include/util/shm_frame.h.")
       (no_full_screen_str,
         po::bool_switch()->default_value(false),
         "Disable default fullscreen.")
@@ -103,6 +189,18 @@ Status parse_cli_args(int argc, char** argv, po::variables_map& vm, Simulation::
       (debug_info_str,
         po::bool_switch(&settings.info)->default_value(Simulation::DefaultSettings<vector_t>.info),
         "Print out INFO level messages. System stats, etc.")
+      (debug_profile_dump_str,
+        po::value<std::string>(&settings.profile_dump),
+        "Periodically write a CSV of time spent in each phase of a step to this file. Requires a `make profile` build.")
+      (debug_chrome_trace_str,
+        po::value<std::string>(&settings.chrome_trace),
+        "Record what every thread is doing and write it to this file on exit. Open it in chrome://tracing or ui.perfetto.dev.")
+      (debug_perf_str,
+        po::bool_switch(&settings.perf_counters)->default_value(Simulation::DefaultSettings<vector_t>.perf_counters),
+        "Count cycles, instructions, cache and branch misses in each phase of a step. Reported with --debug-info.")
+      (debug_event_log_str,
+        po::value<std::string>(&settings.event_log),
+        "Log collisions, bounces and corrections to this file as binary records instead of printing them. Read it with bin/event_decode.")
       ;
 
   // I normally detest exceptions, but this library throws one reasonably, no point guessing what
@@ -196,6 +294,47 @@ Status parse_cli_args(int argc, char** argv, po::variables_map& vm, Simulation::
       }
     }
 
+    // a few thousand sub-steps is already more than anyone's going to sit through
+    if (settings.max_substep_level > 12) {
+      std::cout << "See --help, --max-substep-level can be at most 12." << std::endl;
+      return Status::Failure;
+    }
+
+    if (settings.history_depth == 0) {
+      std::cout << "See --help, --history-depth must be at least 1." << std::endl;
+      return Status::Failure;
+    }
+    // only the window can rewind, so without it there's no history to keep
+    if (settings.no_gui) {
+      settings.history_depth = 0;
+    }
+
+    if (settings.observables_every == 0) {
+      std::cout << "See --help, --observables-every must be at least 1." << std::endl;
+      return Status::Failure;
+    }
+
+    if (!settings.stream.empty() and Stream::check_address(settings.stream) != Status::Success) {
+      std::cout << "See --help, --stream must be unix:<path> or tcp:<port>." << std::endl;
+      return Status::Failure;
+    }
+    // one address can't serve a whole sweep of runs
+    if (!settings.stream.empty() and !settings.ensemble.empty()) {
+      std::cout << "See --help, --stream can't be used with --ensemble." << std::endl;
+      return Status::Failure;
+    }
+
+    if (!settings.shm.empty() and (settings.shm.size() < 2 or settings.shm[0] != '/' or
+                                   settings.shm.find('/', 1) != std::string::npos)) {
+      std::cout << "See --help, --shm must be a / and then a name, with no other /." << std::endl;
+      return Status::Failure;
+    }
+
+    if (settings.max_catch_up == 0) {
+      std::cout << "See --help, --catch-up must be at least 1." << std::endl;
+      return Status::Failure;
+    }
+
     // Graphical settings
     if (!vm[no_full_screen_str].defaulted()) {
       settings.screen_mode = Simulation::ScreenMode::DEFAULT;
@@ -235,10 +374,23 @@ Status parse_cli_args(int argc, char** argv, po::variables_map& vm, Simulation::
       settings.color_range = vm[color_range_str].as<std::vector<int>>();
     }
 
+    // Pick a seed, and say which so this run can be repeated
+    if (settings.seed == 0) {
+      std::random_device rd;
+      settings.seed = (static_cast<uint64_t>(rd()) << 32) | rd();
+      std::cout << "Using seed " << settings.seed << ", pass --seed " << settings.seed << " to repeat this run." << std::endl;
+    }
+
     // Debug settings
     if (vm.count(debug_trace_str)) {
       settings.trace = vm[debug_trace_str].as<std::vector<size_t>>();
     }
+
+#ifndef PROFILE_PHASES
+    if (vm.count(debug_profile_dump_str)) {
+      std::cout << "--debug-profile-dump has no effect, this build has phase profiling compiled out. See `make profile`." << std::endl;
+    }
+#endif
   } catch (const std::exception& e) {
     std::cout << e.what() << std::endl;
     std::cout << desc << std::endl;
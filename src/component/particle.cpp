@@ -5,6 +5,7 @@ namespace Component {
 template<typename V>
 void Particle<V>::set_velocity(const V& v, EnergyInvalidationPolicy ep) {
   m_velocity = v;
+  is_wall_time_valid = false;
   if (ep == EnergyInvalidationPolicy::INVALIDATE) {
     this->is_kinetic_energy_valid = false;
   }
@@ -15,6 +16,15 @@ void Particle<V>::set_position(const V& p) {
   m_position = p;
 }
 
+template<typename V>
+void Particle<V>::sleep(size_t island) {
+  m_island = island;
+  m_velocity = V(0, 0, 0);
+  m_kinetic_energy = 0;
+  is_kinetic_energy_valid = true;
+  is_wall_time_valid = false;
+}
+
 template<typename V>
 const typename V::vector_t& Particle<V>::kinetic_energy() {
   if (!this->is_kinetic_energy_valid) {
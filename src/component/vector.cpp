@@ -32,11 +32,10 @@ Vector<T> Vector<T>::collinear_vector(T mag) const {
 
 template<typename T>
 const T& Vector<T>::magnitude() {
-  if (!this->is_mag_valid) {
+  if (this->m_magnitude < static_cast<T>(0)) {
     this->m_magnitude = sqrt(pow(m_x, static_cast<T>(2)) +
                              pow(m_y, static_cast<T>(2)) +
                              pow(m_z, static_cast<T>(2)));
-    this->is_mag_valid = true;
   }
   return m_magnitude;
 }
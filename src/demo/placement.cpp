@@ -0,0 +1,188 @@
+#include "demo/placement.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <numeric>
+#include <random>
+
+namespace Demo {
+
+// Darts thrown near a disk's suggested spot, then into empty parts of the box, before we give up on it
+static constexpr size_t LOCAL_DARTS = 32;
+static constexpr size_t GLOBAL_DARTS = 1000;
+
+// Buckets of placed disks. Cells are at least one max diameter wide so a disk can only
+// ever touch disks in its own cell or the 8 around it.
+class DiskGrid {
+public:
+  DiskGrid(const std::vector<Disk>& disks, double x_width, double y_width, double max_radius)
+          : m_disks(disks)
+          , m_x_min(-x_width / 2)
+          , m_y_min(-y_width / 2) {
+    // don't let a huge, sparse box allocate an absurd number of cells
+    const double min_cell = std::sqrt(x_width * y_width / static_cast<double>(4 * disks.size() + 1));
+    m_cell = std::max(2 * max_radius, min_cell);
+    m_columns = static_cast<int64_t>(x_width / m_cell) + 1;
+    m_rows = static_cast<int64_t>(y_width / m_cell) + 1;
+    m_head.assign(static_cast<size_t>(m_columns * m_rows), -1);
+    m_next.assign(disks.size(), -1);
+
+    m_empty.resize(m_head.size());
+    m_empty_slot.resize(m_head.size());
+    std::iota(m_empty.begin(), m_empty.end(), 0);
+    std::iota(m_empty_slot.begin(), m_empty_slot.end(), 0);
+  }
+
+  bool fits(double x, double y, double radius) const {
+    const int64_t cx = column(x);
+    const int64_t cy = row(y);
+    for (int64_t j = std::max<int64_t>(cy - 1, 0); j <= std::min(cy + 1, m_rows - 1); j++) {
+      for (int64_t i = std::max<int64_t>(cx - 1, 0); i <= std::min(cx + 1, m_columns - 1); i++) {
+        for (int64_t k = m_head[static_cast<size_t>(j * m_columns + i)]; k >= 0; k = m_next[static_cast<size_t>(k)]) {
+          const auto& other = m_disks[static_cast<size_t>(k)];
+          const double dx = other.x - x;
+          const double dy = other.y - y;
+          const double min_dist = other.radius + radius;
+          if (dx * dx + dy * dy < min_dist * min_dist) {
+            return false;
+          }
+        }
+      }
+    }
+    return true;
+  }
+
+  void insert(size_t i) {
+    const auto cell = static_cast<size_t>(row(m_disks[i].y) * m_columns + column(m_disks[i].x));
+    if (m_head[cell] < 0) {
+      // no longer empty, swap it out of the empty list
+      const auto slot = m_empty_slot[cell];
+      m_empty[slot] = m_empty.back();
+      m_empty_slot[m_empty[slot]] = slot;
+      m_empty.pop_back();
+    }
+    m_next[i] = m_head[cell];
+    m_head[cell] = static_cast<int64_t>(i);
+  }
+
+  // A random point in a random empty cell, which is where free space is most likely
+  // false if there are no empty cells left
+  bool empty_point(Util::CounterRng& gen, double& x, double& y) const {
+    if (m_empty.empty()) {
+      return false;
+    }
+    std::uniform_int_distribution<size_t> pick(0, m_empty.size() - 1);
+    std::uniform_real_distribution<double> within(0, m_cell);
+    const auto cell = static_cast<int64_t>(m_empty[pick(gen)]);
+    x = m_x_min + static_cast<double>(cell % m_columns) * m_cell + within(gen);
+    y = m_y_min + static_cast<double>(cell / m_columns) * m_cell + within(gen);
+    return true;
+  }
+
+private:
+  int64_t column(double x) const {
+    return std::min(std::max(static_cast<int64_t>((x - m_x_min) / m_cell), int64_t(0)), m_columns - 1);
+  }
+
+  int64_t row(double y) const {
+    return std::min(std::max(static_cast<int64_t>((y - m_y_min) / m_cell), int64_t(0)), m_rows - 1);
+  }
+
+  const std::vector<Disk>& m_disks;
+  double m_x_min;
+  double m_y_min;
+  double m_cell;
+  int64_t m_columns;
+  int64_t m_rows;
+  // intrusive linked list per cell, indices into m_disks
+  std::vector<int64_t> m_head;
+  std::vector<int64_t> m_next;
+  // cells nobody is in yet, and where each cell sits in that list
+  std::vector<size_t> m_empty;
+  std::vector<size_t> m_empty_slot;
+};
+
+size_t place_disks(std::vector<Disk>& disks, double x_width, double y_width, Util::CounterRng& gen) {
+  if (disks.empty()) {
+    return 0;
+  }
+
+  double max_radius = 0;
+  for (const auto& d : disks) {
+    max_radius = std::max(max_radius, d.radius);
+  }
+
+  DiskGrid grid(disks, x_width, y_width, max_radius);
+
+  auto in_bounds = [&](double x, double y, double radius) {
+    return std::abs(x) + radius <= x_width / 2 and std::abs(y) + radius <= y_width / 2;
+  };
+
+  // big ones are the hardest to fit, give them first pick
+  std::vector<size_t> order(disks.size());
+  std::iota(order.begin(), order.end(), 0);
+  std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+    return disks[a].radius > disks[b].radius;
+  });
+
+  std::vector<bool> placed(disks.size(), true);
+  std::uniform_real_distribution<double> unit(-1, 1);
+
+  for (auto i : order) {
+    auto& d = disks[i];
+    const double x_range = x_width / 2 - d.radius;
+    const double y_range = y_width / 2 - d.radius;
+    if (x_range < 0 or y_range < 0) {
+      placed[i] = false;
+      continue;
+    }
+
+    // keep it where it asked to be if we can
+    if (in_bounds(d.x, d.y, d.radius) and grid.fits(d.x, d.y, d.radius)) {
+      grid.insert(i);
+      continue;
+    }
+
+    // claim a spot if it's free, clamped so we stay inside the walls
+    auto try_at = [&](double x, double y) {
+      x = std::min(std::max(x, -x_range), x_range);
+      y = std::min(std::max(y, -y_range), y_range);
+      if (!grid.fits(x, y, d.radius)) {
+        return false;
+      }
+      d.x = x;
+      d.y = y;
+      grid.insert(i);
+      return true;
+    };
+
+    bool found = false;
+    for (size_t dart = 0; dart < LOCAL_DARTS + GLOBAL_DARTS and !found; dart++) {
+      double x = 0, y = 0;
+      if (dart < LOCAL_DARTS) {
+        // stay close to home first, this keeps the starting layout recognisable
+        const double reach = 4 * max_radius;
+        x = d.x + unit(gen) * reach;
+        y = d.y + unit(gen) * reach;
+      } else if (!grid.empty_point(gen, x, y)) {
+        x = unit(gen) * x_range;
+        y = unit(gen) * y_range;
+      }
+      found = try_at(x, y);
+    }
+    placed[i] = found;
+  }
+
+  size_t kept = 0;
+  for (size_t i = 0; i < disks.size(); i++) {
+    if (placed[i]) {
+      disks[kept++] = disks[i];
+    }
+  }
+  const size_t removed = disks.size() - kept;
+  disks.resize(kept);
+  return removed;
+}
+
+} // Demo
@@ -0,0 +1,275 @@
+#include "demo/scene.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <memory>
+
+namespace Demo {
+
+// Records read per fread, a few hundred KB
+static constexpr size_t SCENE_CHUNK = 8192;
+
+template<typename V>
+static void add_scene_particle(Simulation::SimulationContext<V>& sim,
+                               double x, double y, double z, double vx, double vy, double vz,
+                               double radius, double mass) {
+  typedef typename V::vector_t vector_t;
+  sim.add_particle(Component::Particle<V>(vector_t(radius), vector_t(mass),
+                                          V(vector_t(vx), vector_t(vy), vector_t(vz)),
+                                          V(vector_t(x), vector_t(y), vector_t(z))));
+}
+
+template<typename V>
+static Status load_binary_scene(std::FILE* f, const std::string& path,
+                                Simulation::SimulationContext<V>& sim, SceneInfo& info) {
+  SceneHeader header;
+  if (std::fread(&header, sizeof(header), 1, f) != 1) {
+    std::cout << path << ": truncated scene header." << std::endl;
+    return Status::Failure;
+  }
+  if (header.record_size != sizeof(SceneRecord)) {
+    std::cout << path << ": has " << header.record_size << " byte records, expected " << sizeof(SceneRecord) << "." << std::endl;
+    return Status::Failure;
+  }
+
+  if (header.flags & SceneFlags::HasBox) {
+    info.has_box = true;
+    info.box = {{header.box[0], header.box[1], header.box[2]}};
+  }
+
+  // The count's whatever the file says, don't reserve for it until we know the records are really there.
+  // If we can't tell how big the file is (a pipe?), read what's there and find out the hard way.
+  const bool has_colors = header.flags & SceneFlags::HasColors;
+  const long start = std::ftell(f);
+  if (start >= 0 and std::fseek(f, 0, SEEK_END) == 0) {
+    const long end = std::ftell(f);
+    if (end < start or std::fseek(f, start, SEEK_SET) != 0) {
+      std::cout << path << ": couldn't get back to the particles after finding the end of the file." << std::endl;
+      return Status::Failure;
+    }
+    const uint64_t records = static_cast<uint64_t>(end - start) / sizeof(SceneRecord);
+    if (header.count > records) {
+      std::cout << path << ": says it has " << header.count << " particles but there's only room for " << records
+                << "." << std::endl;
+      return Status::Failure;
+    }
+    if (has_colors) {
+      info.colors.reserve(header.count);
+    }
+    sim.reserve_particles(header.count);
+  } else {
+    std::clearerr(f);
+  }
+
+  std::unique_ptr<SceneRecord[]> chunk(new SceneRecord[SCENE_CHUNK]);
+  uint64_t remaining = header.count;
+  while (remaining > 0) {
+    const size_t want = static_cast<size_t>(std::min<uint64_t>(remaining, SCENE_CHUNK));
+    const size_t got = std::fread(chunk.get(), sizeof(SceneRecord), want, f);
+
+    for (size_t i = 0; i < got; i++) {
+      const auto& r = chunk[i];
+      add_scene_particle(sim, r.position[0], r.position[1], r.position[2],
+                         r.velocity[0], r.velocity[1], r.velocity[2], r.radius, r.mass);
+      if (has_colors) {
+        info.colors.push_back(static_cast<uint32_t>(r.rgb[0]) << 16 | static_cast<uint32_t>(r.rgb[1]) << 8 | r.rgb[2]);
+      }
+    }
+    info.count += got;
+    remaining -= got;
+
+    if (got < want) {
+      std::cout << path << ": expected " << header.count << " particles but the file ends after " << info.count << "." << std::endl;
+      return Status::Failure;
+    }
+  }
+  return Status::Success;
+}
+
+// Parse up to `max` comma separated numbers from a line, returns how many were found
+// -1 if something in there isn't a number
+static int parse_numbers(const char* line, double* out, int max) {
+  int n = 0;
+  const char* p = line;
+  while (*p != '\0' and *p != '\n' and *p != '\r') {
+    if (n == max) {
+      return -1;
+    }
+    char* end;
+    errno = 0;
+    out[n] = std::strtod(p, &end);
+    if (end == p or errno != 0) {
+      return -1;
+    }
+    n++;
+    p = end;
+    while (*p == ' ' or *p == '\t') {
+      p++;
+    }
+    if (*p == ',') {
+      p++;
+    } else if (*p != '\0' and *p != '\n' and *p != '\r') {
+      return -1;
+    }
+  }
+  return n;
+}
+
+template<typename V>
+static Status load_text_scene(std::FILE* f, const std::string& path,
+                              Simulation::SimulationContext<V>& sim, SceneInfo& info) {
+  // long enough for any sane line, getline would allocate on every call
+  char line[1024];
+  size_t line_number = 0;
+  bool seen_data = false;
+
+  while (std::fgets(line, sizeof(line), f) != nullptr) {
+    line_number++;
+
+    const char* p = line;
+    while (*p == ' ' or *p == '\t') {
+      p++;
+    }
+    if (*p == '\0' or *p == '\n' or *p == '\r') {
+      continue;
+    }
+
+    if (*p == '#') {
+      double box[3] = {0, 0, 0};
+      int n = std::sscanf(p, "# box %lf %lf %lf", &box[0], &box[1], &box[2]);
+      if (n >= 2) {
+        info.has_box = true;
+        info.box = {{box[0], box[1], (n == 3) ? box[2] : 0}};
+      }
+      continue;
+    }
+
+    // x, y, vx, vy, radius, mass, r, g, b
+    double v[9];
+    const int n = parse_numbers(p, v, 9);
+    if (n < 0 and !seen_data and line_number == 1) {
+      // column names
+      continue;
+    }
+    if (n != 6 and n != 9) {
+      std::cout << path << ":" << line_number << ": expected x, y, vx, vy, radius, mass[, r, g, b]." << std::endl;
+      return Status::Failure;
+    }
+    seen_data = true;
+
+    add_scene_particle(sim, v[0], v[1], 0, v[2], v[3], 0, v[4], v[5]);
+
+    if (n == 9) {
+      // colors are all or nothing, fill in anyone we skipped so indices line up
+      info.colors.resize(info.count, 0xFFFFFF);
+      auto channel = [](double c) {
+        return static_cast<uint32_t>(std::min(std::max(c, 0.0), 255.0));
+      };
+      info.colors.push_back(channel(v[6]) << 16 | channel(v[7]) << 8 | channel(v[8]));
+    }
+    info.count++;
+  }
+
+  if (!info.colors.empty()) {
+    info.colors.resize(info.count, 0xFFFFFF);
+  }
+  return Status::Success;
+}
+
+template<typename V>
+Status load_scene(const std::string& path, Simulation::SimulationContext<V>& sim, SceneInfo& info) {
+  std::FILE* f = std::fopen(path.c_str(), "rb");
+  if (f == nullptr) {
+    std::cout << "Unable to open scene " << path << ": " << std::strerror(errno) << std::endl;
+    return Status::Failure;
+  }
+
+  char magic[sizeof(SCENE_MAGIC)] = {};
+  const bool is_binary = std::fread(magic, 1, sizeof(magic), f) == sizeof(magic) and
+                         std::memcmp(magic, SCENE_MAGIC, sizeof(magic)) == 0;
+  std::rewind(f);
+
+  Status s = is_binary ? load_binary_scene(f, path, sim, info) : load_text_scene(f, path, sim, info);
+  std::fclose(f);
+
+  if (s == Status::Success and info.count == 0) {
+    std::cout << path << ": has no particles." << std::endl;
+    return Status::Failure;
+  }
+  return s;
+}
+
+template<typename V>
+bool write_scene(const std::string& path, const std::vector<Component::Particle<V>>& particles,
+                 const std::array<double, 3>& box, const std::vector<uint32_t>& colors) {
+  std::FILE* f = std::fopen(path.c_str(), "wb");
+  if (f == nullptr) {
+    return false;
+  }
+
+  SceneHeader header;
+  std::memset(&header, 0, sizeof(header));
+  std::memcpy(header.magic, SCENE_MAGIC, sizeof(header.magic));
+  header.record_size = sizeof(SceneRecord);
+  header.count = particles.size();
+  header.flags = 0;
+  if (!colors.empty() and colors.size() == particles.size()) {
+    header.flags |= SceneFlags::HasColors;
+  }
+  if (box[0] > 0 and box[1] > 0) {
+    header.flags |= SceneFlags::HasBox;
+  }
+  for (size_t i = 0; i < 3; i++) {
+    header.box[i] = static_cast<float>(box[i]);
+  }
+  std::fwrite(&header, sizeof(header), 1, f);
+
+  for (size_t i = 0; i < particles.size(); i++) {
+    const auto& p = particles[i];
+    SceneRecord r;
+    std::memset(&r, 0, sizeof(r));
+    r.position[0] = static_cast<float>(p.position().x());
+    r.position[1] = static_cast<float>(p.position().y());
+    r.position[2] = static_cast<float>(p.position().z());
+    r.velocity[0] = static_cast<float>(p.velocity().x());
+    r.velocity[1] = static_cast<float>(p.velocity().y());
+    r.velocity[2] = static_cast<float>(p.velocity().z());
+    r.radius = static_cast<float>(p.radius());
+    r.mass = static_cast<float>(p.mass());
+    if (header.flags & SceneFlags::HasColors) {
+      r.rgb[0] = static_cast<uint8_t>(colors[i] >> 16);
+      r.rgb[1] = static_cast<uint8_t>(colors[i] >> 8);
+      r.rgb[2] = static_cast<uint8_t>(colors[i]);
+    }
+    std::fwrite(&r, sizeof(r), 1, f);
+  }
+
+  return std::fclose(f) == 0;
+}
+
+template
+Status load_scene(const std::string&, Simulation::SimulationContext<Component::Vector<float>>&, SceneInfo&);
+
+template
+Status load_scene(const std::string&, Simulation::SimulationContext<Component::Vector<double>>&, SceneInfo&);
+
+template
+Status load_scene(const std::string&, Simulation::SimulationContext<Component::Vector<Util::FixedPoint>>&, SceneInfo&);
+
+template
+bool write_scene(const std::string&, const std::vector<Component::Particle<Component::Vector<float>>>&,
+                 const std::array<double, 3>&, const std::vector<uint32_t>&);
+
+template
+bool write_scene(const std::string&, const std::vector<Component::Particle<Component::Vector<double>>>&,
+                 const std::array<double, 3>&, const std::vector<uint32_t>&);
+
+template
+bool write_scene(const std::string&, const std::vector<Component::Particle<Component::Vector<Util::FixedPoint>>>&,
+                 const std::array<double, 3>&, const std::vector<uint32_t>&);
+
+} // Demo
@@ -0,0 +1,282 @@
+#include "ensemble.h"
+#include "cli.h"
+#include "demo/demo.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <mutex>
+#include <sstream>
+#include <thread>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+#ifdef PARALLELIZE_FOR_LOOPS
+#include <omp.h>
+#endif
+
+namespace Ensemble {
+
+namespace chrono = std::chrono;
+
+Status load_sweep(std::istream& in, Sweep& sweep) {
+  std::string line;
+  size_t line_number = 0;
+  while (std::getline(in, line)) {
+    line_number++;
+    line = line.substr(0, line.find('#'));
+
+    std::istringstream tokens(line);
+    std::string key;
+    if (!(tokens >> key)) {
+      continue;
+    }
+
+    auto fail = [&](const std::string& why) {
+      std::cout << "Sweep line " << line_number << ": " << why << std::endl;
+      return Status::Failure;
+    };
+
+    if (key == "steps" or key == "threads") {
+      size_t value;
+      std::string extra;
+      if (!(tokens >> value) or (tokens >> extra)) {
+        return fail(key + " takes a single number");
+      }
+      ((key == "steps") ? sweep.steps : sweep.threads) = value;
+    } else if (key.compare(0, 2, "--") == 0) {
+      std::vector<std::string> values;
+      std::string value;
+      while (tokens >> value) {
+        values.push_back(value);
+      }
+      if (values.empty()) {
+        return fail(key + " has nothing to sweep over");
+      }
+      auto same = [&](const std::pair<std::string, std::vector<std::string>>& axis) { return axis.first == key; };
+      if (std::any_of(sweep.axes.begin(), sweep.axes.end(), same)) {
+        return fail(key + " is already swept, put all its values on one line");
+      }
+      sweep.axes.emplace_back(key, std::move(values));
+    } else {
+      return fail("expected steps, threads or a --option, not " + key);
+    }
+  }
+
+  if (sweep.steps == 0) {
+    std::cout << "Sweep has 0 steps, nothing would happen." << std::endl;
+    return Status::Failure;
+  }
+  return Status::Success;
+}
+
+std::vector<std::vector<std::string>> expand(const Sweep& sweep) {
+  std::vector<std::vector<std::string>> runs(1);
+  for (const auto& axis : sweep.axes) {
+    std::vector<std::vector<std::string>> next;
+    next.reserve(runs.size() * axis.second.size());
+    for (const auto& run : runs) {
+      for (const auto& value : axis.second) {
+        next.push_back(run);
+        next.back().push_back(axis.first);
+        next.back().push_back(value);
+      }
+    }
+    runs = std::move(next);
+  }
+  return runs;
+}
+
+template<typename V>
+static double total_energy(const std::vector<Component::Particle<V>>& particles) {
+  double energy = 0;
+  for (auto p : particles) {
+    energy += static_cast<double>(p.kinetic_energy());
+  }
+  return energy;
+}
+
+template<typename V>
+Summary run_one(const Simulation::SimSettings<typename V::vector_t>& settings, size_t steps) {
+  Summary summary{};
+  summary.seed = settings.seed;
+  const auto start = chrono::steady_clock::now();
+
+  Simulation::SimulationContext<V> sim(settings);
+  if (!settings.scene.empty()) {
+    std::vector<uint32_t> colors;
+    if (Demo::set_scene_conditions<V>(sim, settings, colors) != Status::Success) {
+      return summary;
+    }
+  } else {
+    Demo::set_initial_conditions<V>(sim, settings);
+  }
+  sim.commit_particles();
+  sim.set_physics_context(Simulation::PhysicsContext<V>(settings));
+  sim.set_free_run(true);
+
+  summary.particles = sim.get_particles().size();
+  summary.energy_start = total_energy(sim.get_particles());
+  for (size_t i = 0; i < steps; i++) {
+    sim.run();
+  }
+
+  summary.completed = true;
+  summary.steps = sim.get_step();
+  summary.collisions = sim.get_collision_count();
+  summary.bounces = sim.get_bounce_count();
+  summary.asleep = sim.get_sleeping_count();
+  summary.energy_end = total_energy(sim.get_particles());
+  summary.wall_us = chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - start).count();
+  return summary;
+}
+
+// keep a pool thread on one core, so its simulation's caches stay warm. Best effort.
+static void pin_to_core(std::thread& thread, size_t core) {
+#ifdef __linux__
+  cpu_set_t cpus;
+  CPU_ZERO(&cpus);
+  CPU_SET(core, &cpus);
+  pthread_setaffinity_np(thread.native_handle(), sizeof(cpus), &cpus);
+#else
+  (void)thread;
+  (void)core;
+#endif
+}
+
+static bool has_option(const std::vector<std::string>& args, const std::string& option) {
+  return std::any_of(args.begin(), args.end(), [&](const std::string& arg) {
+    return arg == option or arg.compare(0, option.size() + 1, option + "=") == 0;
+  });
+}
+
+template<typename V>
+Status run(int argc, char** argv, const Simulation::SimSettings<typename V::vector_t>& settings) {
+  typedef typename V::vector_t vector_t;
+
+  std::ifstream file(settings.ensemble);
+  if (!file) {
+    std::cout << "Unable to open sweep " << settings.ensemble << std::endl;
+    return Status::Failure;
+  }
+  Sweep sweep;
+  if (load_sweep(file, sweep) != Status::Success) {
+    return Status::Failure;
+  }
+
+  // Every run's settings up front, so a typo shows up before we've spent an hour on the runs before it.
+  // Unless the seed is swept every run starts from the one we already picked, so only what's swept differs.
+  std::vector<std::string> base(argv, argv + argc);
+  const bool seed_swept = std::any_of(sweep.axes.begin(), sweep.axes.end(),
+                                      [](const std::pair<std::string, std::vector<std::string>>& axis) {
+                                        return axis.first == "--seed";
+                                      });
+  if (!seed_swept and !has_option(base, "--seed")) {
+    base.push_back("--seed");
+    base.push_back(std::to_string(settings.seed));
+  }
+
+  const auto combinations = expand(sweep);
+  std::vector<Simulation::SimSettings<vector_t>> run_settings;
+  run_settings.reserve(combinations.size());
+  for (const auto& combination : combinations) {
+    std::vector<std::string> args = base;
+    args.insert(args.end(), combination.begin(), combination.end());
+    std::vector<char*> run_argv;
+    for (auto& arg : args) {
+      run_argv.push_back(&arg[0]);
+    }
+
+    po::variables_map vm;
+    auto run = Simulation::DefaultSettings<vector_t>;
+    if (Cli::parse_cli_args<vector_t>(static_cast<int>(run_argv.size()), run_argv.data(), vm, run) != Status::Success) {
+      std::cout << "Unable to set up run " << run_settings.size() << ", terminating." << std::endl;
+      return Status::Failure;
+    }
+    run.no_gui = true;
+    run.ensemble.clear();
+    // nobody can rewind a headless run, so it keeps no history
+    run.history_depth = 0;
+    if (!run.observables.empty()) {
+      run.observables += "." + std::to_string(run_settings.size());
+    }
+    if (!run.shm.empty()) {
+      run.shm += "." + std::to_string(run_settings.size());
+    }
+    run_settings.push_back(run);
+  }
+
+  const size_t cores = std::max<size_t>(std::thread::hardware_concurrency(), 1);
+  const size_t threads = std::min((sweep.threads == 0) ? cores : sweep.threads, run_settings.size());
+  std::cout << "Running " << run_settings.size() << " simulations of " << sweep.steps << " steps, "
+            << threads << " at a time." << std::endl;
+
+  std::vector<Summary> summaries(run_settings.size());
+  std::atomic<size_t> next{0};
+  size_t done = 0;
+  std::mutex progress_lock;
+
+  auto worker = [&]() {
+#ifdef PARALLELIZE_FOR_LOOPS
+    // the runs are what's parallel here, a team per run would only fight over the cores
+    omp_set_num_threads(1);
+#endif
+    for (size_t i = next++; i < run_settings.size(); i = next++) {
+      summaries[i] = run_one<V>(run_settings[i], sweep.steps);
+      std::ostringstream args;
+      for (size_t a = 0; a < combinations[i].size(); a++) {
+        args << ((a == 0) ? "" : " ") << combinations[i][a];
+      }
+      summaries[i].args = args.str();
+
+      std::lock_guard<std::mutex> lock(progress_lock);
+      done++;
+      std::cout << "[" << done << "/" << summaries.size() << "] " << summaries[i].args
+                << (summaries[i].completed ? "" : " failed to start") << std::endl;
+    }
+  };
+
+  std::vector<std::thread> pool;
+  for (size_t t = 0; t < threads; t++) {
+    pool.emplace_back(worker);
+    pin_to_core(pool.back(), t % cores);
+  }
+  for (auto& thread : pool) {
+    thread.join();
+  }
+
+  std::ofstream out(settings.ensemble_out, std::ios::trunc);
+  if (!out) {
+    std::cout << "Unable to write " << settings.ensemble_out << std::endl;
+    return Status::Failure;
+  }
+  write_summaries(out, summaries);
+  std::cout << "Wrote " << summaries.size() << " runs to " << settings.ensemble_out << std::endl;
+  return Status::Success;
+}
+
+void write_summaries(std::ostream& os, const std::vector<Summary>& summaries) {
+  os << "run,args,completed,seed,particles,steps,collisions,bounces,asleep,energy_start,energy_end,wall_us" << std::endl;
+  os << std::setprecision(17);
+  for (size_t i = 0; i < summaries.size(); i++) {
+    const auto& s = summaries[i];
+    os << i << ",\"" << s.args << "\"," << s.completed << "," << s.seed << "," << s.particles << "," << s.steps << ","
+       << s.collisions << "," << s.bounces << "," << s.asleep << "," << s.energy_start << "," << s.energy_end << ","
+       << s.wall_us << std::endl;
+  }
+}
+
+template Summary run_one<Component::Vector<float>>(const Simulation::SimSettings<float>&, size_t);
+template Summary run_one<Component::Vector<double>>(const Simulation::SimSettings<double>&, size_t);
+template Summary run_one<Component::Vector<Util::FixedPoint>>(const Simulation::SimSettings<Util::FixedPoint>&, size_t);
+
+template Status run<Component::Vector<float>>(int, char**, const Simulation::SimSettings<float>&);
+template Status run<Component::Vector<double>>(int, char**, const Simulation::SimSettings<double>&);
+template Status run<Component::Vector<Util::FixedPoint>>(int, char**, const Simulation::SimSettings<Util::FixedPoint>&);
+
+} // Ensemble
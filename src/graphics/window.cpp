@@ -1,11 +1,14 @@
 #include "sim_settings.h"
+#include "stream.h"
+#include "util/random.h"
+#include "util/trace.h"
 #include "window.h"
 
 #include <SFML/Graphics.hpp>
 
 #include <algorithm>
+#include <atomic>
 #include <memory>
-#include <time.h>
 #include <vector>
 
 #pragma GCC diagnostic push
@@ -14,13 +17,15 @@
 
 volatile bool g_pause = false;
 volatile bool g_step = false;
+std::atomic<size_t> g_rewind{0};
 
 namespace Graphics {
 
 struct DrawParticle {
   sf::CircleShape particle;
-  float x_draw_offset;
-  float y_draw_offset;
+  float x_draw_offset = 0;
+  float y_draw_offset = 0;
+  size_t uid = 0;                 ///<< who this is drawing, 0 for nobody yet
 
   operator sf::CircleShape&() {return particle;}
 
@@ -31,11 +36,14 @@ struct DrawParticle {
 
 bool g_window_running;
 
-template <typename V>
-void SimulationWindowThread(const Simulation::SimulationContext<V>& sim,
-                            Simulation::SimSettings<typename V::vector_t> settings) {
+// Draws whatever frames sim hands out, a simulation here or one streamed from elsewhere.
+// Anything with get_frame() and get_history() like SimulationContext's.
+template <typename V, typename Source>
+static void draw_frames(const Source& sim, Simulation::SimSettings<typename V::vector_t> settings,
+                        const std::vector<uint32_t>& colors) {
   std::vector<DrawParticle> draw_particles;
 
+  Util::Trace::set_thread_name("window");
   g_window_running = true;
   bool user_color = false;
   bool user_color_range = false;
@@ -64,57 +72,61 @@ void SimulationWindowThread(const Simulation::SimulationContext<V>& sim,
   }
 
   // block on the simulation having run at least 1 loop or we're just going to draw garbage
-  auto& sim_particles = sim.get_particles();
-
-  for (const auto& p : sim_particles) {
-    sf::CircleShape tshape(static_cast<float>(p.radius()));
-    draw_particles.push_back({tshape,
-                              (desktop_mode.width / 2) - static_cast<float>(p.radius()),
-                              (desktop_mode.height / 2) - static_cast<float>(p.radius())});
-  }
-
-  if (settings.trace.size() > 0) {
-    for (size_t i = 0; i < draw_particles.size(); i++) {
-      if (std::find(settings.trace.begin(), settings.trace.end(), i + 1) != settings.trace.end()) {
-        static_cast<sf::CircleShape&>(draw_particles[i]).setFillColor(sf::Color::Red);
-      } else {
-        static_cast<sf::CircleShape&>(draw_particles[i]).setFillColor(sf::Color::White);
-      }
-    }
-  } else if (!user_color) {
-    srand (time(NULL));
-    for (sf::CircleShape& p : draw_particles) {
-      int rgb[3] = {rand() % 256, rand() % 256, rand() % 256};
+  const size_t initial_count = std::max<size_t>(sim.get_frame()->size(), 1);
+
+  // colors stick to a particle's uid, so they follow it around as others come and go
+  auto particle_color = [&](size_t uid) {
+    const size_t slot = Simulation::uid_slot(uid);
+    if (settings.trace.size() > 0) {
+      const bool traced = std::find(settings.trace.begin(), settings.trace.end(), uid) != settings.trace.end();
+      return traced ? sf::Color::Red : sf::Color::White;
+    } else if (!user_color and slot < colors.size()) {
+      // the scene said what it wants
+      return sf::Color((colors[slot] >> 16) & 0xFF, (colors[slot] >> 8) & 0xFF, colors[slot] & 0xFF);
+    } else if (!user_color) {
+      // same seed, same colors
+      Util::CounterRng gen(settings.seed, uid - 1, Util::RngStream::Color);
+      int rgb[3] = {static_cast<int>(gen() % 256), static_cast<int>(gen() % 256), static_cast<int>(gen() % 256)};
 
       // don't draw invisible particles
       if (std::max(rgb[0], std::max(rgb[1], rgb[2])) < 10) {
-        auto boost_color = rand() % 3;
-        rgb[boost_color] += std::max(rand() % 256, 80);
+        auto boost_color = gen() % 3;
+        rgb[boost_color] += std::max(static_cast<int>(gen() % 256), 80);
       }
-      p.setFillColor(sf::Color(rgb[0], rgb[1], rgb[2]));
-    }
-  } else if (!user_color_range) {
-    for (sf::CircleShape& p : draw_particles) {
-      p.setFillColor(sf::Color(color[0], color[1], color[2]));
+      return sf::Color(rgb[0], rgb[1], rgb[2]);
+    } else if (!user_color_range) {
+      return sf::Color(color[0], color[1], color[2]);
     }
-  } else {
-    float r_step = static_cast<float>(color_range[0] - color[0]) / static_cast<float>(draw_particles.size());
-    float g_step = static_cast<float>(color_range[1] - color[1]) / static_cast<float>(draw_particles.size());
-    float b_step = static_cast<float>(color_range[2] - color[2]) / static_cast<float>(draw_particles.size());
 
+    // step from color to color_range across the particles we started with, latecomers wrap around
     // float to avoid integer rounding when stepping, but ultimately we need to stop on some int rgb value...
-    float red = color[0];
-    float grn = color[1];
-    float blu = color[2];
-
-    for (sf::CircleShape& p : draw_particles) {
-      p.setFillColor(sf::Color(static_cast<int>(red), static_cast<int>(grn), static_cast<int>(blu)));
-      red += r_step;
-      grn += g_step;
-      blu += b_step;
+    const float t = static_cast<float>(slot % initial_count) / static_cast<float>(initial_count);
+    return sf::Color(static_cast<int>(color[0] + t * static_cast<float>(color_range[0] - color[0])),
+                     static_cast<int>(color[1] + t * static_cast<float>(color_range[1] - color[1])),
+                     static_cast<int>(color[2] + t * static_cast<float>(color_range[2] - color[2])));
+  };
+
+  auto setup_draw_particle = [&](DrawParticle& dp, const Component::Particle<V>& p) {
+    const float radius = static_cast<float>(p.radius());
+    dp.particle.setRadius(radius);
+    dp.particle.setFillColor(particle_color(p.uid.get()));
+    dp.x_draw_offset = (desktop_mode.width / 2) - radius;
+    dp.y_draw_offset = (desktop_mode.height / 2) - radius;
+    dp.uid = p.uid.get();
+  };
+
+  // How far back we've scrubbed through the history while paused, 0 being live. Nothing changes in the
+  // simulation until we carry on from there.
+  size_t scrub = 0;
+  std::vector<Component::Particle<V>> scrubbed;
+  auto seek = [&](size_t back) {
+    back = std::min<size_t>(back, settings.history_depth - 1);
+    // the history might not go back that far yet
+    while (back > 0 and sim.get_history(back, scrubbed) != Status::Success) {
+      back--;
     }
-
-  }
+    scrub = back;
+  };
 
   // get the clock now
   sf::Clock clock;
@@ -122,7 +134,7 @@ void SimulationWindowThread(const Simulation::SimulationContext<V>& sim,
   sf::Time last_draw = clock.getElapsedTime();
   // run the program as long as the window is open
   while (window->isOpen()) {
-    const auto& sim_particles = sim.get_particles();
+    TRACE_SPAN("render_frame");
 
     sf::Time now = clock.getElapsedTime();
     // check all the window's events that were triggered since the last iteration of the loop
@@ -134,23 +146,53 @@ void SimulationWindowThread(const Simulation::SimulationContext<V>& sim,
           window->close();
           return;
       } else if (event.type == sf::Event::KeyPressed) {
+        // left and right scrub back and forth a frame at a time, 10 with shift
+        const size_t stride = event.key.shift ? 10 : 1;
         if (event.key.code == sf::Keyboard::P) {
+          // carry on from wherever we scrubbed back to
+          if (g_pause && scrub > 0) {
+            g_rewind = scrub;
+            scrub = 0;
+          }
           g_pause = !g_pause;
         } else if (g_pause && event.key.code == sf::Keyboard::Period) {
+          g_rewind = scrub;
+          scrub = 0;
           g_step = true;
+        } else if (event.key.code == sf::Keyboard::Left) {
+          g_pause = true;
+          seek(scrub + stride);
+        } else if (g_pause && event.key.code == sf::Keyboard::Right) {
+          if (scrub > 0) {
+            seek(scrub - std::min(scrub, stride));
+          } else {
+            // past the end of the history, make some more
+            g_step = true;
+          }
         }
       }
     }
 
+    // hold on to this step while we draw it, the simulation's already on to the next
+    const auto frame = sim.get_frame();
+    const auto& sim_particles = (scrub > 0) ? scrubbed : *frame;
+
     window->clear(sf::Color::Black);
 
+    // particles come and go at runtime, and removals shuffle the order. catch up with whatever changed
+    draw_particles.resize(sim_particles.size());
+
     // draw everything here...
     size_t idx = 0;
     for (const auto& p : sim_particles) {
       auto pos = p.position();
+      auto& dp = draw_particles[idx];
 
-      draw_particles[idx].set_position(static_cast<float>(pos.one()), -static_cast<float>(pos.two()));
-      window->draw(draw_particles[idx]);
+      if (dp.uid != p.uid.get()) {
+        setup_draw_particle(dp, p);
+      }
+      dp.set_position(static_cast<float>(pos.one()), -static_cast<float>(pos.two()));
+      window->draw(dp);
       idx++;
     }
 
@@ -160,15 +202,29 @@ void SimulationWindowThread(const Simulation::SimulationContext<V>& sim,
   }
 }
 
+template <typename V>
+void SimulationWindowThread(const Simulation::SimulationContext<V>& sim,
+                            Simulation::SimSettings<typename V::vector_t> settings,
+                            const std::vector<uint32_t>& colors) {
+  draw_frames<V>(sim, settings, colors);
+}
+
+void StreamWindowThread(const Stream::Client& client, Simulation::SimSettings<float> settings) {
+  draw_frames<Stream::Client::V>(client, settings, {});
+}
+
 template <typename VT>
 std::tuple<size_t, size_t, size_t> get_window_size() {
   auto desktop_mode = sf::VideoMode::getDesktopMode();
   return std::make_tuple(desktop_mode.width, desktop_mode.height, Simulation::DefaultSettings<VT>.z_width);
 }
 
-template void SimulationWindowThread(const Simulation::SimulationContext<Component::Vector<float>>&, Simulation::SimSettings<float>);
-template void SimulationWindowThread(const Simulation::SimulationContext<Component::Vector<double>>&, Simulation::SimSettings<double>);
-template void SimulationWindowThread(const Simulation::SimulationContext<Component::Vector<Util::FixedPoint>>&, Simulation::SimSettings<Util::FixedPoint>);
+template void SimulationWindowThread(const Simulation::SimulationContext<Component::Vector<float>>&, Simulation::SimSettings<float>,
+                                     const std::vector<uint32_t>&);
+template void SimulationWindowThread(const Simulation::SimulationContext<Component::Vector<double>>&, Simulation::SimSettings<double>,
+                                     const std::vector<uint32_t>&);
+template void SimulationWindowThread(const Simulation::SimulationContext<Component::Vector<Util::FixedPoint>>&, Simulation::SimSettings<Util::FixedPoint>,
+                                     const std::vector<uint32_t>&);
 
 template std::tuple<size_t, size_t, size_t> get_window_size<float>();
 template std::tuple<size_t, size_t, size_t> get_window_size<double>();
@@ -1,12 +1,27 @@
 #include "cli.h"
 #include "demo/demo.h"
+#include "ensemble.h"
+#include "stream.h"
+#include "util/event_log.h"
+#include "util/trace.h"
 #include "window.h"
 
+#include <atomic>
+#include <chrono>
+#include <csignal>
+
 // change to run the system with different underlying types!
 typedef Component::Vector<Util::FixedPoint> sim_t;
 //typedef Component::Vector<double> sim_t;
 //typedef Component::Vector<float> sim_t;
 
+// headless runs go until interrupted, this lets us clean up on the way out
+static std::atomic<bool> g_interrupted(false);
+
+static void on_interrupt(int) {
+  g_interrupted = true;
+}
+
 int main(int argc, char** argv) {
   Simulation::SimulationContext<sim_t> sim;
   Simulation::SimSettings<typename sim_t::vector_t> settings = Simulation::DefaultSettings<typename sim_t::vector_t>;
@@ -24,24 +39,89 @@ int main(int argc, char** argv) {
       break;
   }
 
-  Demo::set_initial_conditions<sim_t>(sim, settings);
+  // a whole sweep of headless runs instead of the one
+  if (!settings.ensemble.empty()) {
+    return (Ensemble::run<sim_t>(argc, argv, settings) == Status::Success) ? 0 : 1;
+  }
+
+  if (!settings.chrome_trace.empty()) {
+    Util::Trace::enable();
+    Util::Trace::set_thread_name("main");
+  }
+
+  if (!settings.event_log.empty() and !Util::EventLog::get().open(settings.event_log)) {
+    std::cout << "Unable to open event log " << settings.event_log << ", terminating." << std::endl;
+    return 1;
+  }
+
+  // headless runs with something to write out need to stop cleanly
+  const bool write_on_exit = !settings.chrome_trace.empty() or !settings.event_log.empty();
+  if (write_on_exit) {
+    std::signal(SIGINT, on_interrupt);
+  }
+
+  // fit the box to the screen, if there is one
+  if (!settings.no_gui) {
+    const auto boundaries = Graphics::get_window_size<typename sim_t::vector_t>();
+    settings.x_width = std::get<0>(boundaries);
+    settings.y_width = std::get<1>(boundaries);
+    settings.z_width = std::get<2>(boundaries);
+  }
+
+  std::vector<uint32_t> scene_colors;
+  if (!settings.scene.empty()) {
+    if (Demo::set_scene_conditions<sim_t>(sim, settings, scene_colors) != Status::Success) {
+      std::cout << "Failed to load scene, terminating." << std::endl;
+      return 1;
+    }
+  } else {
+    Demo::set_initial_conditions<sim_t>(sim, settings);
+  }
+  // readers can see the particles from here on
+  sim.commit_particles();
   Simulation::PhysicsContext<sim_t> physics_context(settings);
 
   sim.set_physics_context(physics_context);
 
+  // for viewers elsewhere, see tools/stream_view.cpp
+  Stream::Server<sim_t> stream_server(sim);
+  if (!settings.stream.empty()) {
+    if (stream_server.start(settings.stream) != Status::Success) {
+      std::cout << "Unable to stream to " << settings.stream << ", terminating." << std::endl;
+      return 1;
+    }
+    std::cout << "Streaming to " << settings.stream << std::endl;
+  }
+
   std::thread window_thread;
   std::thread sim_thread(Simulation::SimulationContextThread<sim_t>, std::ref(sim), settings);
 
-  if (settings.no_gui) {
+  if (settings.no_gui and !write_on_exit) {
     // start the sim thread only, and run until it's done
     sim_thread.join();
+  } else if (settings.no_gui) {
+    // the sim never finishes on its own, run until ctrl+c so we get to write the trace and log
+    while (!g_interrupted) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    }
+    sim_thread.detach();
   } else {
     // start both threads, and run until the window thread is closed
-    window_thread = std::thread(Graphics::SimulationWindowThread<sim_t>, std::ref(sim), settings);
+    window_thread = std::thread(Graphics::SimulationWindowThread<sim_t>, std::ref(sim), settings, std::cref(scene_colors));
     window_thread.join();
     sim_thread.detach();
   }
 
+  if (!settings.chrome_trace.empty()) {
+    if (Util::Trace::write(settings.chrome_trace)) {
+      std::cout << "Wrote trace to " << settings.chrome_trace << std::endl;
+    } else {
+      std::cout << "Unable to write trace to " << settings.chrome_trace << std::endl;
+    }
+  }
+
+  Util::EventLog::get().close();
+
   std::cout << "Goodbye!" << std::endl;
   return 0;
 }
\ No newline at end of file
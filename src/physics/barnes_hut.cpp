@@ -0,0 +1,242 @@
+#include "physics/barnes_hut.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace Simulation {
+
+// Spread the low 16 bits of v out to the even bits, to interleave two of them into a morton key
+static uint32_t spread_bits(uint32_t v) {
+  v &= 0xFFFF;
+  v = (v | (v << 8)) & 0x00FF00FF;
+  v = (v | (v << 4)) & 0x0F0F0F0F;
+  v = (v | (v << 2)) & 0x33333333;
+  v = (v | (v << 1)) & 0x55555555;
+  return v;
+}
+
+// Plummer softened pull of a mass at (dx, dy) away
+static inline void pull(double dx, double dy, double mass, double softening2, double& ax, double& ay) {
+  const double r2 = dx * dx + dy * dy + softening2;
+  const double f = mass / (r2 * std::sqrt(r2));
+  ax += f * dx;
+  ay += f * dy;
+}
+
+void BarnesHut::build(const std::vector<Body>& bodies) {
+  m_nodes.clear();
+  m_levels.clear();
+
+  const size_t n = bodies.size();
+  if (n == 0) {
+    return;
+  }
+
+  // smallest square around everyone
+  double x_min = std::numeric_limits<double>::max();
+  double y_min = std::numeric_limits<double>::max();
+  double x_max = std::numeric_limits<double>::lowest();
+  double y_max = std::numeric_limits<double>::lowest();
+#ifdef PARALLELIZE_FOR_LOOPS
+  #pragma omp parallel for reduction(min: x_min, y_min) reduction(max: x_max, y_max)
+#endif
+  for (size_t i = 0; i < n; i++) {
+    x_min = std::min(x_min, bodies[i].x);
+    y_min = std::min(y_min, bodies[i].y);
+    x_max = std::max(x_max, bodies[i].x);
+    y_max = std::max(y_max, bodies[i].y);
+  }
+  const double width = std::max(std::max(x_max - x_min, y_max - y_min), std::numeric_limits<double>::min());
+  const double scale = 65536.0 / width;
+
+  // sort into morton order, then every node is a contiguous range of bodies
+  m_scratch.resize(n);
+#ifdef PARALLELIZE_FOR_LOOPS
+  #pragma omp parallel for
+#endif
+  for (size_t i = 0; i < n; i++) {
+    const auto cx = static_cast<uint32_t>(std::min((bodies[i].x - x_min) * scale, 65535.0));
+    const auto cy = static_cast<uint32_t>(std::min((bodies[i].y - y_min) * scale, 65535.0));
+    m_scratch[i] = {spread_bits(cx) | spread_bits(cy) << 1, static_cast<uint32_t>(i)};
+  }
+  std::sort(m_scratch.begin(), m_scratch.end());
+
+  m_sorted.resize(n);
+  m_order.resize(n);
+  m_keys.resize(n);
+#ifdef PARALLELIZE_FOR_LOOPS
+  #pragma omp parallel for
+#endif
+  for (size_t i = 0; i < n; i++) {
+    m_keys[i] = m_scratch[i].first;
+    m_order[i] = m_scratch[i].second;
+    m_sorted[i] = bodies[m_scratch[i].second];
+  }
+
+  // Split a level at a time: count everyone's children, hand out room for them, then fill them in.
+  // Counting and filling are independent per node.
+  m_nodes.push_back({0, 0, 0, width, 0, static_cast<uint32_t>(n), 0, 0});
+  m_levels.push_back(0);
+  m_levels.push_back(1);
+
+  for (uint32_t depth = 0; depth < MAX_DEPTH; depth++) {
+    const size_t level_begin = m_levels[depth];
+    const size_t level_size = m_levels[depth + 1] - level_begin;
+    const uint32_t shift = 2 * (MAX_DEPTH - 1 - depth);
+
+    auto quadrant_start = [this, shift](uint32_t begin, uint32_t end, uint32_t quadrant) {
+      return static_cast<uint32_t>(std::partition_point(m_keys.begin() + begin, m_keys.begin() + end,
+                                                        [shift, quadrant](uint32_t key) {
+                                                          return ((key >> shift) & 3) < quadrant;
+                                                        }) - m_keys.begin());
+    };
+
+    m_child_counts.assign(level_size, 0);
+#ifdef PARALLELIZE_FOR_LOOPS
+    #pragma omp parallel for
+#endif
+    for (size_t i = 0; i < level_size; i++) {
+      const auto& node = m_nodes[level_begin + i];
+      if (node.end - node.begin <= LEAF_SIZE) {
+        continue;
+      }
+      for (uint32_t q = 0; q < 4; q++) {
+        if (quadrant_start(node.begin, node.end, q) != quadrant_start(node.begin, node.end, q + 1)) {
+          m_child_counts[i]++;
+        }
+      }
+    }
+
+    size_t next = m_nodes.size();
+    for (size_t i = 0; i < level_size; i++) {
+      auto& node = m_nodes[level_begin + i];
+      node.first_child = (m_child_counts[i] > 0) ? static_cast<uint32_t>(next) : 0;
+      node.child_count = m_child_counts[i];
+      next += m_child_counts[i];
+    }
+    if (next == m_nodes.size()) {
+      break;
+    }
+    m_nodes.resize(next);
+
+#ifdef PARALLELIZE_FOR_LOOPS
+    #pragma omp parallel for
+#endif
+    for (size_t i = 0; i < level_size; i++) {
+      const auto node = m_nodes[level_begin + i];
+      if (node.child_count == 0) {
+        continue;
+      }
+      uint32_t child = node.first_child;
+      for (uint32_t q = 0; q < 4; q++) {
+        const uint32_t begin = quadrant_start(node.begin, node.end, q);
+        const uint32_t end = quadrant_start(node.begin, node.end, q + 1);
+        if (begin != end) {
+          m_nodes[child++] = {0, 0, 0, node.width / 2, begin, end, 0, 0};
+        }
+      }
+    }
+    m_levels.push_back(m_nodes.size());
+  }
+
+  // mass and centre of mass, from the leaves up
+  for (size_t level = m_levels.size() - 1; level-- > 0;) {
+#ifdef PARALLELIZE_FOR_LOOPS
+    #pragma omp parallel for
+#endif
+    for (size_t i = m_levels[level]; i < m_levels[level + 1]; i++) {
+      auto& node = m_nodes[i];
+      double mass = 0;
+      double mx = 0;
+      double my = 0;
+      if (node.child_count == 0) {
+        for (uint32_t j = node.begin; j < node.end; j++) {
+          mass += m_sorted[j].mass;
+          mx += m_sorted[j].mass * m_sorted[j].x;
+          my += m_sorted[j].mass * m_sorted[j].y;
+        }
+      } else {
+        for (uint32_t c = node.first_child; c < node.first_child + node.child_count; c++) {
+          mass += m_nodes[c].mass;
+          mx += m_nodes[c].mass * m_nodes[c].x;
+          my += m_nodes[c].mass * m_nodes[c].y;
+        }
+      }
+      node.mass = mass;
+      node.x = (mass > 0) ? mx / mass : 0;
+      node.y = (mass > 0) ? my / mass : 0;
+    }
+  }
+}
+
+void BarnesHut::accelerations(double g, double theta, double softening, std::vector<Accel>& out) const {
+  const size_t n = m_sorted.size();
+  out.assign(n, {{0, 0}});
+  if (n == 0) {
+    return;
+  }
+
+  const double theta2 = theta * theta;
+  const double softening2 = softening * softening;
+
+  // neighbours in morton order walk mostly the same nodes, keep them on the same thread
+#ifdef PARALLELIZE_FOR_LOOPS
+  #pragma omp parallel for schedule(dynamic, 64)
+#endif
+  for (size_t s = 0; s < n; s++) {
+    const auto& body = m_sorted[s];
+    double ax = 0;
+    double ay = 0;
+
+    // each open node swaps itself for at most 4 children, so this is as deep as it goes
+    uint32_t stack[4 * MAX_DEPTH + 4];
+    size_t top = 0;
+    stack[top++] = 0;
+
+    while (top > 0) {
+      const auto& node = m_nodes[stack[--top]];
+      const double dx = node.x - body.x;
+      const double dy = node.y - body.y;
+
+      if (node.child_count == 0) {
+        for (uint32_t j = node.begin; j < node.end; j++) {
+          if (j != s) {
+            pull(m_sorted[j].x - body.x, m_sorted[j].y - body.y, m_sorted[j].mass, softening2, ax, ay);
+          }
+        }
+      } else if (node.width * node.width < theta2 * (dx * dx + dy * dy)) {
+        // far enough away to be one body
+        pull(dx, dy, node.mass, softening2, ax, ay);
+      } else {
+        for (uint32_t c = node.first_child; c < node.first_child + node.child_count; c++) {
+          stack[top++] = c;
+        }
+      }
+    }
+
+    out[m_order[s]] = {{g * ax, g * ay}};
+  }
+}
+
+void BarnesHut::direct(const std::vector<Body>& bodies, double g, double softening, std::vector<Accel>& out) {
+  const size_t n = bodies.size();
+  const double softening2 = softening * softening;
+  out.assign(n, {{0, 0}});
+
+#ifdef PARALLELIZE_FOR_LOOPS
+  #pragma omp parallel for
+#endif
+  for (size_t i = 0; i < n; i++) {
+    double ax = 0;
+    double ay = 0;
+    for (size_t j = 0; j < n; j++) {
+      if (j != i) {
+        pull(bodies[j].x - bodies[i].x, bodies[j].y - bodies[i].y, bodies[j].mass, softening2, ax, ay);
+      }
+    }
+    out[i] = {{g * ax, g * ay}};
+  }
+}
+
+} // Simulation
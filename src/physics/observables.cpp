@@ -0,0 +1,101 @@
+#include "physics/observables.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+
+namespace Simulation {
+
+template<typename V>
+constexpr size_t Observables<V>::SPEED_BINS;
+
+template<typename V>
+Status Observables<V>::open(const std::string& path) {
+  m_file.close();
+  m_file.open(path, std::ios::trunc);
+  if (!m_file) {
+    return Status::Failure;
+  }
+
+  m_file << "step,time,particles,kinetic_energy,temperature,pressure,bin_width";
+  for (size_t b = 0; b < SPEED_BINS; b++) {
+    m_file << ",speed_" << b;
+  }
+  m_file << std::endl;
+  m_file << std::setprecision(10);
+  return Status::Success;
+}
+
+template<typename V>
+const typename Observables<V>::Sample& Observables<V>::measure(const std::vector<Component::Particle<V>>& particles,
+                                                               size_t step, double time,
+                                                               double wall_impulse, double wall_length) {
+  const size_t n = particles.size();
+  m_speeds.resize(n);
+
+  // energy and speeds first, the bins depend on how fast everyone's going
+  double energy = 0;
+  double speed_sq = 0;
+#ifdef PARALLELIZE_FOR_LOOPS
+  #pragma omp parallel for reduction(+:energy, speed_sq)
+#endif
+  for (size_t i = 0; i < n; i++) {
+    const auto& v = particles[i].velocity();
+    const double x = static_cast<double>(v.x());
+    const double y = static_cast<double>(v.y());
+    const double z = static_cast<double>(v.z());
+    const double s2 = x * x + y * y + z * z;
+    m_speeds[i] = std::sqrt(s2);
+    energy += 0.5 * static_cast<double>(particles[i].mass()) * s2;
+    speed_sq += s2;
+  }
+
+  const double rms = (n == 0) ? 0 : std::sqrt(speed_sq / static_cast<double>(n));
+  const double bin_width = 4 * rms / static_cast<double>(SPEED_BINS);
+
+  std::array<uint64_t, SPEED_BINS> bins{};
+  uint64_t* counts = bins.data();
+#ifdef PARALLELIZE_FOR_LOOPS
+  #pragma omp parallel for reduction(+:counts[:SPEED_BINS])
+#endif
+  for (size_t i = 0; i < n; i++) {
+    // everyone's still, or the fastest few
+    const double bin = (bin_width > 0) ? m_speeds[i] / bin_width : 0;
+    counts[std::min(static_cast<size_t>(bin), SPEED_BINS - 1)]++;
+  }
+
+  const double elapsed = time - m_last_time;
+  m_last_time = time;
+
+  m_sample.step = step;
+  m_sample.time = time;
+  m_sample.particles = n;
+  m_sample.kinetic_energy = energy;
+  m_sample.temperature = (n == 0) ? 0 : 2 * energy / static_cast<double>(DIMENSIONS * n);
+  m_sample.pressure = (elapsed > 0 and wall_length > 0) ? wall_impulse / (elapsed * wall_length) : 0;
+  m_sample.bin_width = bin_width;
+  m_sample.speeds = bins;
+  return m_sample;
+}
+
+template<typename V>
+void Observables<V>::write() {
+  if (!m_file.is_open()) {
+    return;
+  }
+  const auto& s = m_sample;
+  m_file << s.step << "," << s.time << "," << s.particles << "," << s.kinetic_energy << "," << s.temperature << ","
+         << s.pressure << "," << s.bin_width;
+  for (auto count : s.speeds) {
+    m_file << "," << count;
+  }
+  // a line at a time, so whoever's following the file never sees half a sample
+  m_file << "\n";
+  m_file.flush();
+}
+
+template class Observables<Component::Vector<float>>;
+template class Observables<Component::Vector<double>>;
+template class Observables<Component::Vector<Util::FixedPoint>>;
+
+} // Simulation
@@ -1,28 +1,68 @@
 #include "context.h"
 #include "debug.h"
 
+#include <algorithm>
 #include <array>
+#include <cmath>
+#include <limits>
 #include <tuple>
 
 namespace Simulation {
 
 template<typename V>
-Status PhysicsContext<V>::collide(Component::Particle<V>& a, Component::Particle<V>& b) {
-  return collide_internal(a, b, true);
+void PhysicsContext<V>::prepare_collisions(const std::vector<Component::Particle<V>>& particles,
+                                          const std::vector<uint8_t>& levels) {
+  // just the fastest on either axis, comparisons are cheap and multiplies aren't (looking at you FixedPoint)
+  // The sub-stepped have had their collisions, but whoever they hit on the way is here going however fast
+  // they left it, which can be well past the first sub-step limit. So it's the speeds as they are now.
+  vector_t fastest = 0;
+  for (size_t i = 0; i < particles.size(); i++) {
+    if (i < levels.size() and levels[i] != 0) {
+      continue;
+    }
+    fastest = std::max(fastest, abs(particles[i].velocity().one()));
+    fastest = std::max(fastest, abs(particles[i].velocity().two()));
+  }
+  // head on, both of them that fast
+  m_reach = (fastest + fastest) * time_scalar<vector_t>(SIM_RESOLUTION_US);
+}
+
+template<typename V>
+size_t PhysicsContext<V>::substep_level(const Component::Particle<V>& p) const {
+  // summing the axes overestimates the speed a little, and saves a square root
+  const auto& v = p.velocity();
+  const auto speed = abs(v.x()) + abs(v.y()) + abs(v.z());
+  size_t level = 0;
+  while (level + 1 < m_substep_limits.size() and speed > m_substep_limits[level]) {
+    level++;
+  }
+  return level;
 }
 
+// The kinetic energy a sleeper at rest would come away from an impulse with, worked out the way the particle
+// itself would so it agrees with SimulationContext::knock() about whether that's enough to wake it
 template<typename V>
-Status PhysicsContext<V>::collide_internal(Component::Particle<V>& a, Component::Particle<V>& b, bool retry) {
-  // are these particles even close enough for this?
-  // define a vector from the other object's COM to ours
+static typename V::vector_t knocked_energy(const V& impulse, const Component::Particle<V>& sleeper) {
+  using vector_t = typename V::vector_t;
+  using std::pow;
+  auto v = impulse / sleeper.mass();
+  return static_cast<vector_t>(0.5) * sleeper.mass() * pow(v.magnitude(), static_cast<vector_t>(2));
+}
 
-  auto min_dist = a.radius() + b.radius();
+template<typename V>
+Status PhysicsContext<V>::sweep(Component::Particle<V>& a, Component::Particle<V>& b, double window_s, const vector_t& reach) {
+  // a sleeping pile is already as settled as it's going to get
+  if (a.asleep() and b.asleep()) {
+    return Status::None;
+  }
+
+  const auto min_dist = a.radius() + b.radius() + reach;
 
   // TODO TODO TODO
   // THIS OBVIOUSLY NEEDS EXTENDED TO 3D WHEN WE START DRAWING THAT
   // SINCE EVERYTHING IS 2D NOW, THIS WOULD BE A USELESS CHECK FOR THE Z PLANE
   // Since, if any the Manhattan distance components between us are greater than the combined radiii
-  // of these two particles, there is no way the magnitude of the distance vector could be smaller.
+  // of these two particles plus however far any pair could have closed in over the step, there's no way they touched.
   // This prevents us from having to compute the expensive actual distance, which involves squaring 3x,
   // summing the 3 squares, and taking their root.
   // This early bail-out for example when using the FixedPoint type took the median run time of the run() loop
@@ -32,208 +72,243 @@ Status PhysicsContext<V>::collide_internal(Component::Particle<V>& a, Component:
     return Status::None;
   }
 
-  const auto& dist = a.position() - b.position();
+  // Swept spheres. Over the window the separation was d + w * s for s in [-window_s, 0], d and w being the separation
+  // and relative velocity now. They touch where |d + w * s| = R, the earlier root is when they met.
+  // Worked in double whatever we're simulating in, it's a handful of operations and a square root.
+  const double dx = static_cast<double>(a.position().x() - b.position().x());
+  const double dy = static_cast<double>(a.position().y() - b.position().y());
+  const double dz = static_cast<double>(a.position().z() - b.position().z());
+  const double wx = static_cast<double>(a.velocity().x() - b.velocity().x());
+  const double wy = static_cast<double>(a.velocity().y() - b.velocity().y());
+  const double wz = static_cast<double>(a.velocity().z() - b.velocity().z());
+  const double r = static_cast<double>(a.radius() + b.radius());
+
+  const double dd = dx * dx + dy * dy + dz * dz;
+  const double dw = dx * wx + dy * wy + dz * wz;
+  const double ww = wx * wx + wy * wy + wz * wz;
+  const double gap = dd - r * r;
+
+  // nope, never within reach of each other
+  const double disc = dw * dw - ww * gap;
+  if (ww == 0 or disc < 0) {
+    return Status::None;
+  }
 
-  // nope too far away
-  if (const_cast<V&>(dist).magnitude() > min_dist) {
+  double contact_s = (-dw - std::sqrt(disc)) / ww;
+  if (contact_s > 0) {
+    // they'll meet, just not yet
     return Status::None;
+  } else if (contact_s < -window_s) {
+    // already overlapping at the start of the step (or they passed each other before it). Only push apart
+    // what's still pushing in, what's leaving can see itself out.
+    if (gap > 0 or dw >= 0) {
+      return Status::None;
+    }
+    contact_s = 0;
   }
 
   const auto va_before = a.velocity();
   const auto vb_before = b.velocity();
   const auto ka_before = a.kinetic_energy();
   const auto kb_before = b.kinetic_energy();
-
-  // Got some work to do.
   const auto v_delta_before = (va_before - vb_before);
+  const double energy_before = ledger_energy(a) + ledger_energy(b);
+
+  // back to the moment they touched
+  const auto rewind = static_cast<vector_t>(contact_s);
+  a.set_position(a.position() + va_before * rewind);
+  b.set_position(b.position() + vb_before * rewind);
+  const auto dist = a.position() - b.position();
 
   // get the impulse unit vector
-  const auto impulse_unit_vector = (dist).unit_vector();
+  const auto impulse_unit_vector = dist.unit_vector();
 
-  // the impulse vector is the dot product of its unit vector and the difference in velocities, multiplied by the unit vector
-  // I am not completely sure why, but we seem to need to use the absolute value of the dot product lest it be negative and
-  // flip the direction of our impulse
-  const auto dot_product_abs = abs(impulse_unit_vector ^ v_delta_before);
-  const auto impulse_vector = 2 * impulse_unit_vector * (dot_product_abs / (a.inverse_mass() + b.inverse_mass()));
+  // the impulse vector is the relative velocity along the unit vector, scaled by the reduced mass. They're
+  // approaching along it, so the dot product is negative, and the impulse pushes a away from b.
+  const auto closing = -(impulse_unit_vector ^ v_delta_before);
+  const auto impulse_vector = 2 * impulse_unit_vector * (closing / (a.inverse_mass() + b.inverse_mass()));
 
   DEBUG_MSG(COLLISION_DETECTED);
 
-  // now that we have our impulse vector accounted for, we can calculate post-collision velocities
-  a.set_velocity(a.velocity() + impulse_vector / a.mass());
-  b.set_velocity(b.velocity() - impulse_vector / b.mass());
-
-  // KE is not always conserved in our system.
-  // This is likely due to a number of factors I haven't run down yet including
-  //   * Insufficient resolution in the system
-  //   * Losses in precision due to intermediate values of floats
-  //   * Inability to represent irraitonal numbers fully
-  // The correction algorithm is able to correct roughly half of erroneous collisions in
-  // the random case, but otherwise we simply bail and restore the original velocities.
-  const auto ka_after = a.kinetic_energy();
-  const auto kb_after = b.kinetic_energy();
-  const auto k_delta = abs((ka_before + kb_before) - (ka_after + kb_after));
-
-  // energy must be conserved
-  // for my own sanity, for now, I allow a small delta in collisions. With any form of number representation I have had
-  // issues with inexact results yielding slight errors here. Entropy will build in the system but perhaps at an acceptable
-  // rate if this number is sufficiently low.
-  if (k_delta > 0.1) {
-    if (retry) {
-      DEBUG_MSG(IMPOSSIBLE_COLLISION_WARNING);
-
-      in_replay_mode = true;
-      Status s = correct_collision(a, b);
-      in_replay_mode = false;
-
-      // We weren't able to correct these particles... restore their original state
-      // and allow them to clip without a collision.
-      if (s != Status::Corrected) {
-        a.set_velocity(va_before);
-        b.set_velocity(vb_before);
-
-        DEBUG_MSG(UNABLE_TO_CORRECT_COLLISION);
-        DEBUG_MSG(POST_COLLISION_REPORT);
-        return Status::Inconsistent;
-      }
-      DEBUG_MSG(POST_COLLISION_REPORT);
-
-      return Status::Corrected;
-    }
-    DEBUG_MSG(IMPOSSIBLE_COLLISION_WARNING);
-    DEBUG_MSG(POST_COLLISION_REPORT);
+  // A sleeper only gives if it'd come away with more than sleep_energy (and SimulationContext::knock() wakes
+  // its island). Anything gentler and it's as immovable as whatever it's resting on, the other one bounces
+  // straight back off it and nobody loses anything.
+  const auto& sleep_energy = m_settings.get().sleep_energy;
+  const bool a_held = a.asleep() and !(knocked_energy(impulse_vector, a) > sleep_energy);
+  const bool b_held = b.asleep() and !(knocked_energy(impulse_vector, b) > sleep_energy);
 
-    return Status::Inconsistent;
+  // now that we have our impulse vector accounted for, we can calculate post-collision velocities
+  if (b_held) {
+    a.set_velocity(a.velocity() + 2 * impulse_unit_vector * closing);
+  } else if (a_held) {
+    b.set_velocity(b.velocity() - 2 * impulse_unit_vector * closing);
+  } else {
+    a.set_velocity(a.velocity() + impulse_vector / a.mass());
+    b.set_velocity(b.velocity() - impulse_vector / b.mass());
   }
 
+  // and on to the end of the step, going their new ways
+  a.set_position(a.position() - a.velocity() * rewind);
+  b.set_position(b.position() - b.velocity() * rewind);
+
+  // which ought to be nothing, see EnergyLedger
+  m_ledger.record(ledger_energy(a) + ledger_energy(b) - energy_before);
+
   DEBUG_MSG(POST_COLLISION_REPORT);
+  LOG_COLLISION(Util::EventStatus::Success);
 
   // that's it!
   return Status::Success;
 }
 
+// The walls on each axis, low then high
+static constexpr std::array<std::array<Component::WallIdx, 2>, 3> WALL_AXES = {{
+  {{Component::WallIdx::LEFT, Component::WallIdx::RIGHT}},
+  {{Component::WallIdx::BOTTOM, Component::WallIdx::TOP}},
+  {{Component::WallIdx::BACK, Component::WallIdx::FRONT}},
+}};
+
 template<typename V>
-Status PhysicsContext<V>::correct_collision(Component::Particle<V>& a, Component::Particle<V>& b) {
-  // two particles, gone astray. let's see if we can put them on the right course with some mandatory re-education
-  const auto& last_state = m_outer_sim->get_particles();
-
-  // get the problem particles in their good days
-  const auto& a_old = last_state[a.uid.get() - 1];
-  const auto& b_old = last_state[b.uid.get() - 1];
-
-  DEBUG_MSG(COLLISION_CORRECTION_REPORT);
-
-  // This gets a lot more expensive to fix as we go to finer resolutions
-  // We'll try half-speed, then quarter-speed, then tenth-speed, then hundreth speed
-  std::array<std::tuple<chrono::microseconds, uint8_t>, 4> scales = {
-    std::make_tuple(chrono::microseconds(SIM_RESOLUTION_US.count() / 2), 2),
-    std::make_tuple(chrono::microseconds(SIM_RESOLUTION_US.count() / 4), 4),
-    std::make_tuple(chrono::microseconds(SIM_RESOLUTION_US.count() / 10), 10),
-    std::make_tuple(chrono::microseconds(SIM_RESOLUTION_US.count() / 100), 100)
-  };
-
-  size_t attempt = 0;
-  for (auto scale : scales) {
-    attempt++;
-    auto a_working = a_old;
-    auto b_working = b_old;
-
-    DEBUG_MSG(CORRECTION_ATTEMPT_REPORT);
-
-    // we know a collision will occur at some point soon...
-    size_t steps = 0;
-    Status s;
-    do {
-      // replay everything that these particles had happen, at the higher resolution
-      gravity(a_working, std::get<0>(scale));
-      gravity(b_working, std::get<0>(scale));
-
-      step(a_working, std::get<0>(scale));
-      step(b_working, std::get<0>(scale));
-
-      s = collide_internal(a_working, b_working, false);
-
-      for (const auto& wall : m_outer_sim->get_boundaries()) {
-        bounce(a_working, wall);
-        bounce(b_working, wall);
-      }
-
-      steps++;
-      // Going more steps than our time division factor would actually put us ahead of the current frame.
-      // If these particles keep going they may never necessarily collide again.
-    } while(s == Status::None and steps < std::get<1>(scale));
-
-    if (s == Status::Inconsistent) {
-      // we failed to correct. try a higher resolution or give up
-      DEBUG_MSG(CORRECTION_ATTEMPT_FAILED);
-      continue;
-    } else if (s == Status::Success) {
-      // we did it! correct the particles and let the caller know
-      a = a_working;
-      b = b_working;
+static std::array<double, 3> as_doubles(const V& v) {
+  return {{static_cast<double>(v.x()), static_cast<double>(v.y()), static_cast<double>(v.z())}};
+}
 
-      DEBUG_MSG(CORRECTION_ATTEMPT_SUCCESS);
-      return Status::Corrected;
+// How long until a particle touches a wall, flying as it is. Negative if it's already past one.
+template<typename V>
+static double time_to_wall(const Component::Particle<V>& p, const std::array<Component::Wall<V>, Component::WallIdx::SIZE>& walls) {
+  const auto x = as_doubles(p.position());
+  const auto v = as_doubles(p.velocity());
+  const double r = static_cast<double>(p.radius());
+
+  double t = std::numeric_limits<double>::infinity();
+  for (size_t axis = 0; axis < WALL_AXES.size(); axis++) {
+    if (v[axis] > 0) {
+      t = std::min(t, (static_cast<double>(walls[WALL_AXES[axis][1]].position()) - r - x[axis]) / v[axis]);
+    } else if (v[axis] < 0) {
+      t = std::min(t, (static_cast<double>(walls[WALL_AXES[axis][0]].position()) + r - x[axis]) / v[axis]);
     }
   }
-  return Status::Failure;
+  return t;
 }
 
 template<typename V>
-Status PhysicsContext<V>::bounce(Component::Particle<V>& p, const Component::Wall<V>& wall) {
+size_t PhysicsContext<V>::bounce(Component::Particle<V>& p, const std::array<Component::Wall<V>, Component::WallIdx::SIZE>& walls,
+                                 double now) {
   //using Component::Particle<V>::EnergyInvalidationPolicy;
   using Component::EnergyInvalidationPolicy;
 
-  // are we traveling toward this wall?
-  // velocity sign in relevant direction must oppose normal vector of wall
-  auto v_relative = p.velocity() * wall.normal().absolute();
-
-  // since this is now a 1D vector, its sum is just the relevant portion... check if signs are opposite
-  if ((v_relative.sum() < 0) == (wall.normal().sum() < 0)) {
-    return Status::None;
+  if (p.asleep()) {
+    return 0;
   }
 
-  // Ok we're traveling at the wall, but are we close enough for a collision?
-  auto distance = abs((p.position() * wall.normal().absolute()).sum() - wall.position());
+  // time of impact only changes with velocity, so most of the time this is all there is to it
+  if (!p.wall_time_valid()) {
+    p.set_wall_time(now + time_to_wall(p, walls));
+  }
+  if (p.wall_time() > now) {
+    return 0;
+  }
 
-  if (distance <= static_cast<vector_t>(p.radius())) {
-    // energy is retained solely to this particle in a bounce, no need to recalculate
-    p.set_velocity(p.velocity() * wall.inverse(), EnergyInvalidationPolicy::KEEP);
+  // Fold it back inside along any axis it's gone out of, as if by a mirror on the wall. However far it
+  // went in one step, it lands where it would have been had it bounced at the right moment.
+  auto x = as_doubles(p.position());
+  const auto v = as_doubles(p.velocity());
+  const double r = static_cast<double>(p.radius());
+
+  const double energy_before = ledger_energy(p);
+  size_t bounces = 0;
+  for (size_t axis = 0; axis < WALL_AXES.size(); axis++) {
+    const double lo = static_cast<double>(walls[WALL_AXES[axis][0]].position()) + r;
+    const double hi = static_cast<double>(walls[WALL_AXES[axis][1]].position()) - r;
+    // bigger than the box, nothing sensible to do
+    if (hi <= lo) {
+      continue;
+    }
+    if (!((x[axis] <= lo and v[axis] < 0) or (x[axis] >= hi and v[axis] > 0))) {
+      continue;
+    }
+    const auto& wall = walls[WALL_AXES[axis][v[axis] > 0]];
+
+    // every box width travelled past the wall is another bounce, off alternating walls
+    const double width = hi - lo;
+    const double u = x[axis] - lo;
+    const auto reflections = static_cast<size_t>(std::max(1.0, std::abs(std::floor(u / width))));
+    double folded = std::fmod(u, 2 * width);
+    if (folded < 0) {
+      folded += 2 * width;
+    }
+    x[axis] = lo + ((folded <= width) ? folded : 2 * width - folded);
+    // each reflection turns this axis of its momentum around
+    m_wall_impulse += 2 * static_cast<double>(p.mass()) * std::abs(v[axis]) * static_cast<double>(reflections);
+
+    const auto fold = static_cast<vector_t>(x[axis]);
+    const auto& pos = p.position();
+    p.set_position(V(axis == 0 ? fold : pos.x(), axis == 1 ? fold : pos.y(), axis == 2 ? fold : pos.z()));
+    if (reflections % 2 == 1) {
+      // energy is retained solely to this particle in a bounce, no need to recalculate
+      p.set_velocity(p.velocity() * wall.inverse(), EnergyInvalidationPolicy::KEEP);
+    }
+    bounces += reflections;
 
     DEBUG_MSG(BOUNCE_DETECTION);
+    LOG_BOUNCE;
+  }
 
-    return Status::Success;
+  if (bounces > 0) {
+    m_ledger.record(ledger_energy(p) - energy_before);
   }
-  return Status::None;
-}
 
-template<typename V>
-void PhysicsContext<V>::gravity(Component::Particle<V>& p, US_T us) {
-  vector_t time_scalar = chrono::duration_cast<chrono::duration<vector_t>>(us).count();
-  p.set_velocity(p.velocity() + (m_gravity.get() * time_scalar));
+  p.set_wall_time(now + time_to_wall(p, walls));
+  return bounces;
 }
 
-// TODO FFS fix this
-template <>
-void PhysicsContext<Component::Vector<Util::FixedPoint>>::gravity(Component::Particle<Component::Vector<Util::FixedPoint>>& p, US_T us) {
-  (void)us;
-  Util::FixedPoint time_scalar(0.01);
-  p.set_velocity(p.velocity() + (m_gravity.get() * time_scalar));
+template<typename V>
+void PhysicsContext<V>::gravity(Component::Particle<V>& p, FRAC_US_T us) {
+  if (p.asleep()) {
+    return;
+  }
+  p.set_velocity(p.velocity() + (m_gravity.get() * time_scalar<vector_t>(us)));
 }
 
 template<typename V>
-void PhysicsContext<V>::step(Component::Particle<V>& p, US_T us) {
-  // move the amount we would expect, with our given velocity
-  vector_t time_scalar = chrono::duration_cast<chrono::duration<vector_t>>(us).count();
-  p.set_position(p.position() + (p.velocity() * time_scalar));
+void PhysicsContext<V>::mutual_gravity(std::vector<Component::Particle<V>>& particles, US_T us) {
+  const auto& settings = m_settings.get();
+  const auto g = static_cast<double>(settings.mutual_gravity);
+  if (g == 0) {
+    return;
+  }
+
+  m_bodies.resize(particles.size());
+  for (size_t i = 0; i < particles.size(); i++) {
+    const auto& p = particles[i];
+    m_bodies[i] = {static_cast<double>(p.position().x()), static_cast<double>(p.position().y()), static_cast<double>(p.mass())};
+  }
+
+  if (settings.gravity_theta > 0) {
+    m_tree.build(m_bodies);
+    m_tree.accelerations(g, settings.gravity_theta, settings.gravity_softening, m_accel);
+  } else {
+    BarnesHut::direct(m_bodies, g, settings.gravity_softening, m_accel);
+  }
+
+  // sleepers still pull on everyone else, they just don't get pulled
+  const double dt = chrono::duration_cast<chrono::duration<double>>(us).count();
+  for (size_t i = 0; i < particles.size(); i++) {
+    auto& p = particles[i];
+    if (p.asleep()) {
+      continue;
+    }
+    p.set_velocity(p.velocity() + V(static_cast<vector_t>(m_accel[i][0] * dt), static_cast<vector_t>(m_accel[i][1] * dt), 0));
+  }
 }
 
-// TODO FFS fix this
-template <>
-void PhysicsContext<Component::Vector<Util::FixedPoint>>::step(Component::Particle<Component::Vector<Util::FixedPoint>>& p, US_T us) {
-  (void)us;
+template<typename V>
+void PhysicsContext<V>::step(Component::Particle<V>& p, FRAC_US_T us) {
+  if (p.asleep()) {
+    return;
+  }
   // move the amount we would expect, with our given velocity
-  Util::FixedPoint time_scalar(0.01);
-  p.set_position(p.position() + (p.velocity() * time_scalar));
+  p.set_position(p.position() + (p.velocity() * time_scalar<vector_t>(us)));
 }
 
 template class PhysicsContext<Component::Vector<float>>;
@@ -0,0 +1,265 @@
+#include "physics/spatial_index.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <utility>
+
+namespace Simulation {
+
+template<typename V>
+SpatialIndex<V>::SpatialIndex(std::shared_ptr<const Frame> frame)
+                             : m_frame(std::move(frame)) {
+  const auto& particles = *m_frame;
+  const size_t n = particles.size();
+  if (n == 0) {
+    m_starts.assign(2, 0);
+    return;
+  }
+
+  double x_min = std::numeric_limits<double>::max();
+  double y_min = x_min;
+  double x_max = std::numeric_limits<double>::lowest();
+  double y_max = x_max;
+  for (const auto& p : particles) {
+    const double x = static_cast<double>(p.position().x());
+    const double y = static_cast<double>(p.position().y());
+    x_min = std::min(x_min, x);
+    x_max = std::max(x_max, x);
+    y_min = std::min(y_min, y);
+    y_max = std::max(y_max, y);
+    m_max_radius = std::max(m_max_radius, static_cast<double>(p.radius()));
+  }
+
+  // the grid covers everyone's edges too, so a ray that misses it misses everyone
+  m_x0 = x_min - m_max_radius;
+  m_y0 = y_min - m_max_radius;
+  const double width = x_max - x_min + 2 * m_max_radius;
+  const double height = y_max - y_min + 2 * m_max_radius;
+
+  // about one particle a cell, but no narrower than a particle can reach out of it
+  m_cell = std::max(m_max_radius, std::sqrt(width * height / static_cast<double>(n)));
+  if (!(m_cell > 0)) {
+    // everyone's a point, in the same place
+    m_cell = 1;
+  }
+  m_cells_x = std::max<size_t>(1, static_cast<size_t>(std::ceil(width / m_cell)));
+  m_cells_y = std::max<size_t>(1, static_cast<size_t>(std::ceil(height / m_cell)));
+
+  // counting sort into cells
+  std::vector<size_t> cells(n);
+  m_starts.assign(cell_count() + 1, 0);
+  for (size_t i = 0; i < n; i++) {
+    const auto& pos = particles[i].position();
+    cells[i] = cell_y(static_cast<double>(pos.y())) * m_cells_x + cell_x(static_cast<double>(pos.x()));
+    m_starts[cells[i] + 1]++;
+  }
+  for (size_t c = 0; c < cell_count(); c++) {
+    m_starts[c + 1] += m_starts[c];
+  }
+
+  std::vector<size_t> next(m_starts.begin(), m_starts.end() - 1);
+  m_entries.resize(n);
+  for (size_t i = 0; i < n; i++) {
+    const auto& p = particles[i];
+    m_entries[next[cells[i]]++] = {static_cast<double>(p.position().x()), static_cast<double>(p.position().y()),
+                                   static_cast<double>(p.radius()), i};
+  }
+}
+
+template<typename V>
+size_t SpatialIndex<V>::cell_x(double x) const {
+  const double c = std::floor((x - m_x0) / m_cell);
+  return (c <= 0) ? 0 : std::min(static_cast<size_t>(c), m_cells_x - 1);
+}
+
+template<typename V>
+size_t SpatialIndex<V>::cell_y(double y) const {
+  const double c = std::floor((y - m_y0) / m_cell);
+  return (c <= 0) ? 0 : std::min(static_cast<size_t>(c), m_cells_y - 1);
+}
+
+template<typename V>
+void SpatialIndex<V>::within(double x, double y, double radius, std::vector<size_t>& out) const {
+  if (m_entries.empty() or radius < 0) {
+    return;
+  }
+  const double radius_sq = radius * radius;
+  const size_t x_end = cell_x(x + radius);
+  const size_t y_end = cell_y(y + radius);
+  for (size_t cy = cell_y(y - radius); cy <= y_end; cy++) {
+    // a row of cells is one run of entries
+    const size_t row = cy * m_cells_x;
+    for (size_t i = m_starts[row + cell_x(x - radius)]; i < m_starts[row + x_end + 1]; i++) {
+      const auto& e = m_entries[i];
+      const double ex = e.x - x;
+      const double ey = e.y - y;
+      if (ex * ex + ey * ey <= radius_sq) {
+        out.push_back(e.index);
+      }
+    }
+  }
+}
+
+template<typename V>
+void SpatialIndex<V>::nearest(double x, double y, size_t k, std::vector<Hit>& out) const {
+  out.clear();
+  k = std::min(k, m_entries.size());
+  if (k == 0) {
+    return;
+  }
+
+  // out is a max heap on squared distance until the end, the furthest of the best k so far on top
+  auto further = [](const Hit& l, const Hit& r) { return l.distance < r.distance; };
+  auto visit = [&](ptrdiff_t cx, ptrdiff_t cy) {
+    if (cx < 0 or cy < 0 or cx >= static_cast<ptrdiff_t>(m_cells_x) or cy >= static_cast<ptrdiff_t>(m_cells_y)) {
+      return;
+    }
+    const size_t c = static_cast<size_t>(cy) * m_cells_x + static_cast<size_t>(cx);
+    for (size_t i = m_starts[c]; i < m_starts[c + 1]; i++) {
+      const auto& e = m_entries[i];
+      const double ex = e.x - x;
+      const double ey = e.y - y;
+      const double d = ex * ex + ey * ey;
+      if (out.size() < k) {
+        out.push_back({e.index, d});
+        std::push_heap(out.begin(), out.end(), further);
+      } else if (d < out.front().distance) {
+        std::pop_heap(out.begin(), out.end(), further);
+        out.back() = {e.index, d};
+        std::push_heap(out.begin(), out.end(), further);
+      }
+    }
+  };
+
+  // Rings of cells further and further out. Anything beyond ring r is at least r cells away, even from a
+  // point off the grid, so once the best k are all closer than that we're done.
+  const auto cx = static_cast<ptrdiff_t>(cell_x(x));
+  const auto cy = static_cast<ptrdiff_t>(cell_y(y));
+  const auto last_ring = static_cast<ptrdiff_t>(std::max({static_cast<size_t>(cx), m_cells_x - 1 - static_cast<size_t>(cx),
+                                                          static_cast<size_t>(cy), m_cells_y - 1 - static_cast<size_t>(cy)}));
+  for (ptrdiff_t r = 0; r <= last_ring; r++) {
+    if (r == 0) {
+      visit(cx, cy);
+    } else {
+      for (ptrdiff_t i = -r; i <= r; i++) {
+        visit(cx + i, cy - r);
+        visit(cx + i, cy + r);
+      }
+      for (ptrdiff_t i = 1 - r; i < r; i++) {
+        visit(cx - r, cy + i);
+        visit(cx + r, cy + i);
+      }
+    }
+    const double reach = static_cast<double>(r) * m_cell;
+    if (out.size() == k and out.front().distance <= reach * reach) {
+      break;
+    }
+  }
+
+  std::sort_heap(out.begin(), out.end(), further);
+  for (auto& hit : out) {
+    hit.distance = std::sqrt(hit.distance);
+  }
+}
+
+template<typename V>
+bool SpatialIndex<V>::ray_cast(double x, double y, double dx, double dy, double max_distance, Hit& hit) const {
+  const double length = std::sqrt(dx * dx + dy * dy);
+  if (m_entries.empty() or !(length > 0) or max_distance < 0) {
+    return false;
+  }
+  const double ux = dx / length;
+  const double uy = dy / length;
+  const double inf = std::numeric_limits<double>::infinity();
+
+  // clip the ray to the grid, nobody's outside it
+  double t_enter = 0;
+  double t_exit = max_distance;
+  const double lo[2] = {m_x0, m_y0};
+  const double hi[2] = {m_x0 + static_cast<double>(m_cells_x) * m_cell, m_y0 + static_cast<double>(m_cells_y) * m_cell};
+  const double origin[2] = {x, y};
+  const double dir[2] = {ux, uy};
+  for (size_t axis = 0; axis < 2; axis++) {
+    if (dir[axis] == 0) {
+      if (origin[axis] < lo[axis] or origin[axis] > hi[axis]) {
+        return false;
+      }
+      continue;
+    }
+    double t0 = (lo[axis] - origin[axis]) / dir[axis];
+    double t1 = (hi[axis] - origin[axis]) / dir[axis];
+    if (t0 > t1) {
+      std::swap(t0, t1);
+    }
+    t_enter = std::max(t_enter, t0);
+    t_exit = std::min(t_exit, t1);
+  }
+  if (t_enter > t_exit) {
+    return false;
+  }
+
+  // Walk the cells along the ray. Anyone the ray touches in a cell has their centre in it or a neighbour, and
+  // once the best hit so far is no further than where we leave a cell, nobody further on can beat it.
+  auto ix = static_cast<ptrdiff_t>(cell_x(x + ux * t_enter));
+  auto iy = static_cast<ptrdiff_t>(cell_y(y + uy * t_enter));
+  const ptrdiff_t step_x = (ux > 0) ? 1 : -1;
+  const ptrdiff_t step_y = (uy > 0) ? 1 : -1;
+  const double delta_x = (ux == 0) ? inf : m_cell / std::abs(ux);
+  const double delta_y = (uy == 0) ? inf : m_cell / std::abs(uy);
+  double next_x = (ux == 0) ? inf : (m_x0 + static_cast<double>(ix + (ux > 0)) * m_cell - x) / ux;
+  double next_y = (uy == 0) ? inf : (m_y0 + static_cast<double>(iy + (uy > 0)) * m_cell - y) / uy;
+
+  bool found = false;
+  hit.distance = inf;
+  for (;;) {
+    for (ptrdiff_t ny = std::max<ptrdiff_t>(iy - 1, 0); ny <= std::min<ptrdiff_t>(iy + 1, static_cast<ptrdiff_t>(m_cells_y) - 1); ny++) {
+      const size_t row = static_cast<size_t>(ny) * m_cells_x;
+      const size_t begin = m_starts[row + static_cast<size_t>(std::max<ptrdiff_t>(ix - 1, 0))];
+      const size_t end = m_starts[row + static_cast<size_t>(std::min<ptrdiff_t>(ix + 1, static_cast<ptrdiff_t>(m_cells_x) - 1)) + 1];
+      for (size_t i = begin; i < end; i++) {
+        const auto& e = m_entries[i];
+        // |origin + t u - centre| = radius, the nearer root
+        const double fx = x - e.x;
+        const double fy = y - e.y;
+        const double b = fx * ux + fy * uy;
+        const double c = fx * fx + fy * fy - e.radius * e.radius;
+        double t = 0;
+        if (c > 0) {
+          const double discriminant = b * b - c;
+          if (discriminant < 0 or b > 0) {
+            // missed, or it's behind us
+            continue;
+          }
+          t = -b - std::sqrt(discriminant);
+        }
+        if (t <= max_distance and t < hit.distance) {
+          hit = {e.index, t};
+          found = true;
+        }
+      }
+    }
+
+    const double leave = std::min({next_x, next_y, t_exit});
+    if ((found and hit.distance <= leave) or leave >= t_exit) {
+      break;
+    }
+    if (next_x < next_y) {
+      ix += step_x;
+      next_x += delta_x;
+    } else {
+      iy += step_y;
+      next_y += delta_y;
+    }
+    if (ix < 0 or iy < 0 or ix >= static_cast<ptrdiff_t>(m_cells_x) or iy >= static_cast<ptrdiff_t>(m_cells_y)) {
+      break;
+    }
+  }
+  return found;
+}
+
+template class SpatialIndex<Component::Vector<float>>;
+template class SpatialIndex<Component::Vector<double>>;
+template class SpatialIndex<Component::Vector<Util::FixedPoint>>;
+
+} // Simulation
@@ -3,7 +3,9 @@
 #include "info.h"
 
 #include <algorithm>
+#include <cmath>
 #include <limits>
+#include <numeric>
 #include <thread>
 
 namespace Simulation {
@@ -29,13 +31,329 @@ void SimulationContext<V>::add_particle(const V& v, const V& p) {
   add_particle(Component::Particle<V>(v, p));
 }
 
+template<typename V>
+void SimulationContext<V>::add_particles(const std::vector<Component::Particle<V>>& particles) {
+  reserve_particles(m_particle_count + particles.size());
+  for (auto p : particles) {
+    add_particle_internal(p);
+  }
+}
+
+template<typename V>
+void SimulationContext<V>::commit_particles() {
+  m_particle_buffer.publish();
+  m_uncommitted = false;
+  export_frame(get_particles(), get_step_time());
+}
+
 template<typename V>
 void SimulationContext<V>::add_particle_internal(Component::Particle<V>& p) {
-  p.uid.latch(m_particle_count + 1);
-  // TODO we don't support adding particles at runtime (properly yet)
-  // you can do it, it just might look weird
+  assign_uid(p, m_particle_count);
   m_particle_count++;
+  m_physics_context.ledger().external(PhysicsContext<V>::ledger_energy(p));
   m_particle_buffer.push_back(p);
+  m_uncommitted = true;
+}
+
+template<typename V>
+void SimulationContext<V>::assign_uid(Component::Particle<V>& p, size_t idx) {
+  size_t slot;
+  if (!m_free_slots.empty()) {
+    slot = m_free_slots.back();
+    m_free_slots.pop_back();
+  } else {
+    slot = m_slot_generation.size();
+    m_slot_generation.push_back(0);
+    m_slot_index.push_back(idx);
+  }
+  m_slot_index[slot] = idx;
+
+  // whatever uid it came in with belonged to someone else, e.g. it was copied out of get_particles()
+  p.uid = Util::LatchingValue<size_t>(make_uid(slot, m_slot_generation[slot]));
+  // and so did its island
+  p.wake();
+}
+
+template<typename V>
+void SimulationContext<V>::queue_add(std::vector<Component::Particle<V>> particles) {
+  std::lock_guard<std::mutex> lock(m_pending_lock);
+  m_pending_add.insert(m_pending_add.end(), particles.begin(), particles.end());
+  m_has_pending = true;
+}
+
+template<typename V>
+void SimulationContext<V>::queue_remove(std::vector<size_t> uids) {
+  std::lock_guard<std::mutex> lock(m_pending_lock);
+  m_pending_remove.insert(m_pending_remove.end(), uids.begin(), uids.end());
+  m_has_pending = true;
+}
+
+template<typename V>
+void SimulationContext<V>::apply_pending(std::vector<Component::Particle<V>>& particles) {
+  std::vector<Component::Particle<V>> adds;
+  std::vector<size_t> removes;
+  {
+    std::lock_guard<std::mutex> lock(m_pending_lock);
+    adds.swap(m_pending_add);
+    removes.swap(m_pending_remove);
+    m_has_pending = false;
+  }
+
+  // removals first so their slots go straight to the additions
+  for (auto uid : removes) {
+    const size_t slot = uid_slot(uid);
+    if (uid == 0 or slot >= m_slot_index.size() or
+        m_slot_index[slot] == REMOVED or uid_generation(uid) != m_slot_generation[slot]) {
+      continue;
+    }
+
+    // swap the last particle into the gap, O(1) and the buffer stays dense
+    const size_t idx = m_slot_index[slot];
+    m_physics_context.ledger().external(-PhysicsContext<V>::ledger_energy(particles[idx]));
+    if (idx != particles.size() - 1) {
+      particles[idx] = std::move(particles.back());
+      m_slot_index[uid_slot(particles[idx].uid.get())] = idx;
+    }
+    particles.pop_back();
+
+    m_slot_index[slot] = REMOVED;
+    m_slot_generation[slot]++;
+    m_free_slots.push_back(slot);
+    m_particle_count--;
+  }
+
+  particles.reserve(particles.size() + adds.size());
+  for (auto& p : adds) {
+    m_physics_context.ledger().external(PhysicsContext<V>::ledger_energy(p));
+    assign_uid(p, particles.size());
+    particles.push_back(p);
+    m_particle_count++;
+  }
+}
+
+template<typename V>
+void SimulationContext<V>::knock(Component::Particle<V>& p) {
+  if (!p.asleep()) {
+    return;
+  }
+
+  // too gentle and the collision left it where it was, the other particle just bounced off
+  if (p.kinetic_energy() > m_settings.get().sleep_energy) {
+    m_woken_islands.push_back(p.island());
+    p.wake();
+  }
+}
+
+template<typename V>
+void SimulationContext<V>::wake_islands(std::vector<Component::Particle<V>>& particles) {
+  std::sort(m_woken_islands.begin(), m_woken_islands.end());
+  for (auto& p : particles) {
+    if (p.asleep() and std::binary_search(m_woken_islands.begin(), m_woken_islands.end(), p.island())) {
+      p.wake();
+    }
+  }
+  m_woken_islands.clear();
+}
+
+template<typename V>
+void SimulationContext<V>::settle(std::vector<Component::Particle<V>>& particles) {
+  const auto& settings = m_settings.get();
+  const auto rest_limit = static_cast<uint32_t>(std::min<size_t>(settings.sleep_steps, std::numeric_limits<uint32_t>::max()));
+
+  size_t sleeping = 0;
+  bool any_ready = false;
+  for (auto& p : particles) {
+    if (p.asleep()) {
+      sleeping++;
+    } else if (p.kinetic_energy() < settings.sleep_energy) {
+      p.set_rest_steps(std::min(p.rest_steps() + 1, rest_limit));
+      any_ready |= p.rest_steps() == rest_limit;
+    } else {
+      p.set_rest_steps(0);
+    }
+  }
+  m_sleeping_count = sleeping;
+
+  // nobody new could fall asleep, skip finding islands
+  if (!any_ready) {
+    return;
+  }
+
+  // Islands are particles touching (or within a hair of it), found through a grid of cells as big as the
+  // biggest particle so neighbours are always in neighbouring cells. 2D only, like the rest of the system for now.
+  static constexpr double CONTACT_SLOP = 1.05;
+  double cell = 0;
+  for (const auto& p : particles) {
+    cell = std::max(cell, 2 * static_cast<double>(p.radius()) * CONTACT_SLOP);
+  }
+  if (cell <= 0) {
+    return;
+  }
+
+  auto cell_of = [cell](double x) {
+    return static_cast<uint32_t>(static_cast<int64_t>(std::floor(x / cell)));
+  };
+  auto key_of = [](uint32_t cx, uint32_t cy) {
+    return static_cast<uint64_t>(cx) << 32 | cy;
+  };
+
+  const size_t n = particles.size();
+  m_settle_cells.resize(n);
+  for (size_t i = 0; i < n; i++) {
+    const auto& pos = particles[i].position();
+    m_settle_cells[i] = {key_of(cell_of(static_cast<double>(pos.x())), cell_of(static_cast<double>(pos.y()))), i};
+  }
+  std::sort(m_settle_cells.begin(), m_settle_cells.end());
+
+  m_island_parent.resize(n);
+  std::iota(m_island_parent.begin(), m_island_parent.end(), 0);
+  auto find = [this](size_t i) {
+    while (m_island_parent[i] != i) {
+      m_island_parent[i] = m_island_parent[m_island_parent[i]];
+      i = m_island_parent[i];
+    }
+    return i;
+  };
+
+  for (size_t i = 0; i < n; i++) {
+    const auto& a = particles[i];
+    const double ax = static_cast<double>(a.position().x());
+    const double ay = static_cast<double>(a.position().y());
+    const uint32_t cx = cell_of(ax);
+    const uint32_t cy = cell_of(ay);
+
+    for (uint32_t dx = cx - 1; dx != cx + 2; dx++) {
+      for (uint32_t dy = cy - 1; dy != cy + 2; dy++) {
+        auto range = std::equal_range(m_settle_cells.begin(), m_settle_cells.end(), std::make_pair(key_of(dx, dy), size_t(0)),
+                                      [](const std::pair<uint64_t, size_t>& l, const std::pair<uint64_t, size_t>& r) {
+                                        return l.first < r.first;
+                                      });
+        for (auto it = range.first; it != range.second; it++) {
+          const size_t j = it->second;
+          if (j <= i) {
+            continue;
+          }
+          const auto& b = particles[j];
+          const double x = static_cast<double>(b.position().x()) - ax;
+          const double y = static_cast<double>(b.position().y()) - ay;
+          const double reach = (static_cast<double>(a.radius()) + static_cast<double>(b.radius())) * CONTACT_SLOP;
+          if (x * x + y * y <= reach * reach) {
+            m_island_parent[find(i)] = find(j);
+          }
+        }
+      }
+    }
+  }
+
+  // an island sleeps only once everyone awake in it has been still long enough
+  m_island_ready.assign(n, 1);
+  for (size_t i = 0; i < n; i++) {
+    const auto& p = particles[i];
+    if (!p.asleep() and p.rest_steps() < rest_limit) {
+      m_island_ready[find(i)] = 0;
+    }
+  }
+
+  // the whole island shares one label, including anyone already asleep in it, so it all wakes together
+  for (size_t i = 0; i < n; i++) {
+    const size_t root = find(i);
+    if (!m_island_ready[root]) {
+      continue;
+    }
+    auto& p = particles[i];
+    if (!p.asleep()) {
+      sleeping++;
+    }
+    m_physics_context.ledger().external(-PhysicsContext<V>::ledger_energy(p));
+    p.sleep(particles[root].uid.get());
+  }
+  m_sleeping_count = sleeping;
+}
+
+template<typename V>
+void SimulationContext<V>::reserve_scratch(size_t n) {
+  m_substep_levels.reserve(n);
+  m_fast.reserve(n);
+  m_moved_on.reserve(n);
+  m_moved.reserve(n);
+  m_woken_islands.reserve(n);
+  m_awake.reserve(n);
+  if (m_settings.get().sleep_steps > 0) {
+    m_settle_cells.reserve(n);
+    m_island_parent.reserve(n);
+    m_island_ready.reserve(n);
+  }
+}
+
+// Block time-stepping for the few who need it. The step is cut into 2^finest ticks, and a particle at level L
+// moves on every 2^(finest - L)th of them. After moving it's checked against everyone, over the finer of the two
+// sub-steps, so nobody skips past anyone. Slow particles have already stepped and stand where they'll end up,
+// which is within radius_min of where they are at any point in the step.
+template<typename V>
+void SimulationContext<V>::substep(std::vector<Component::Particle<V>>& particles) {
+  size_t finest = 0;
+  for (auto i : m_fast) {
+    finest = std::max<size_t>(finest, m_substep_levels[i]);
+  }
+  const size_t ticks = 1UL << finest;
+  const double start = get_step_time();
+
+  m_moved_on.assign(particles.size(), 0);
+  for (size_t tick = 1; tick <= ticks; tick++) {
+    m_moved.clear();
+    for (auto i : m_fast) {
+      const size_t level = m_substep_levels[i];
+      if (tick % (ticks >> level) != 0) {
+        continue;
+      }
+      const FRAC_US_T h = FRAC_US_T(SIM_RESOLUTION_US) / static_cast<double>(1UL << level);
+      m_physics_context.gravity(particles[i], h);
+      m_physics_context.step(particles[i], h);
+      m_moved_on[i] = tick;
+      m_moved.push_back(i);
+    }
+
+    for (auto i : m_moved) {
+      for (size_t j = 0; j < particles.size(); j++) {
+        // pairs who both moved this tick only go once
+        if (j == i or (m_moved_on[j] == tick and j < i)) {
+          continue;
+        }
+        auto& a = particles[i];
+        auto& b = particles[j];
+        const bool either_asleep = a.asleep() or b.asleep();
+        const Status s = m_physics_context.collide(a, b, std::max(m_substep_levels[i], m_substep_levels[j]));
+        if (either_asleep and s != Status::None) {
+          knock(a);
+          knock(b);
+        }
+        if (s == Status::Success) {
+          m_collision_count++;
+        }
+      }
+      m_bounce_count += m_physics_context.bounce(particles[i], m_boundaries,
+                                                 start + SIM_RESOLUTION_S * static_cast<double>(tick) / static_cast<double>(ticks));
+    }
+  }
+}
+
+template<typename V>
+const Component::Particle<V>* SimulationContext<V>::find_particle(size_t uid) const {
+  const auto& latest = get_particles();
+
+  // usually it's where the slot says, unless something moved it this step
+  const size_t slot = uid_slot(uid);
+  if (slot < m_slot_index.size() and m_slot_index[slot] < latest.size() and
+      latest[m_slot_index[slot]].uid.get() == uid) {
+    return &latest[m_slot_index[slot]];
+  }
+
+  for (const auto& p : latest) {
+    if (p.uid.get() == uid) {
+      return &p;
+    }
+  }
+  return nullptr;
 }
 
 template<typename V>
@@ -52,69 +370,254 @@ void SimulationContext<V>::run() {
     return;
   }
 
-  // whistle and wait
-  std::shared_ptr<std::vector<Component::Particle<V>>> particles;
-  while (m_particle_buffer.get_writeable(particles) == Status::NotReady) {}
+  TRACE_SPAN("run");
+
+  // get_particles() has to hold what we're about to step
+  if (m_uncommitted) {
+    commit_particles();
+  }
+
+  // check the ledger against a full recount every so often, as of the end of the last step
+  const size_t audit_every = m_settings.get().energy_audit;
+  if (audit_every > 0 and m_step % audit_every == 0) {
+    audit_energy(m_particle_buffer.latest());
+  }
+
+  // This step goes in a buffer of its own while readers keep the last one, and each particle is read out of
+  // the last step as gravity gets to it. Unless there are sources and sinks, which have to go in first.
+  // Readers see the result once this step is put().
+  auto* particles = &m_particle_buffer.next();
+  const bool carried = m_has_pending;
+  if (carried) {
+    m_particle_buffer.carry();
+    apply_pending(*particles);
+  }
 
   should_calc_next_step = false;
   m_tock = chrono::time_point_cast<US_T>(now);
 
-  // Gravity rides everything
-  for (auto& p : *particles) {
-    m_physics_context.gravity(p, SIM_RESOLUTION_US);
+  reserve_scratch(particles->size());
+
+  // Gravity rides everything. Anyone fast enough to need sub-steps gets theirs a sub-step at a time, in substep()
+  {
+    PROFILE_PHASE(m_profiler, Util::Phase::Gravity);
+    PERF_PHASE(m_perf_counters, Util::Phase::Gravity);
+    TRACE_SPAN("gravity");
+    m_substep_levels.resize(particles->size());
+    m_fast.clear();
+    for (size_t i = 0; i < particles->size(); i++) {
+      auto& p = carried ? (*particles)[i] : m_particle_buffer.carry(i);
+      const size_t level = m_physics_context.substep_level(p);
+      m_substep_levels[i] = static_cast<uint8_t>(level);
+      if (level == 0) {
+        m_physics_context.gravity(p, SIM_RESOLUTION_US);
+      } else {
+        m_fast.push_back(i);
+      }
+    }
+    m_physics_context.mutual_gravity(*particles, SIM_RESOLUTION_US);
   }
 
   // run particles
-  for (auto& p : *particles) {
-    m_physics_context.step(p, SIM_RESOLUTION_US);
+  {
+    PROFILE_PHASE(m_profiler, Util::Phase::Step);
+    PERF_PHASE(m_perf_counters, Util::Phase::Step);
+    TRACE_SPAN("step");
+    for (size_t i = 0; i < particles->size(); i++) {
+      if (m_substep_levels[i] == 0) {
+        m_physics_context.step((*particles)[i], SIM_RESOLUTION_US);
+      }
+    }
+  }
+
+  if (!m_fast.empty()) {
+    PROFILE_PHASE(m_profiler, Util::Phase::Substep);
+    PERF_PHASE(m_perf_counters, Util::Phase::Substep);
+    TRACE_SPAN("substep");
+    substep(*particles);
   }
 
   // now check for collisions
   // we only allow 1 collision per 2 partcles per frame so the
   // one with the lower index will always "collide" first
+  // sub-stepped particles have already had theirs
+  {
+    PROFILE_PHASE(m_profiler, Util::Phase::Collision);
+    PERF_PHASE(m_perf_counters, Util::Phase::Collision);
+    TRACE_SPAN("collision");
+    const bool any_fast = !m_fast.empty();
+    m_physics_context.prepare_collisions(*particles, m_substep_levels);
+    // two sleepers have nothing to say to each other, so a sleeper only needs checking against who's awake
+    m_awake.clear();
+    for (size_t i = 0; i < particles->size(); i++) {
+      if (!(*particles)[i].asleep() and !(any_fast and m_substep_levels[i] != 0)) {
+        m_awake.push_back(i);
+      }
+    }
+    auto check = [this, &particles](size_t j, size_t k) {
+      auto& a = (*particles)[j];
+      auto& b = (*particles)[k];
+      const bool either_asleep = a.asleep() or b.asleep();
+      Status s = m_physics_context.collide(a, b);
+      if (either_asleep and s != Status::None) {
 #ifdef PARALLELIZE_FOR_LOOPS
-  #pragma omp parallel
+        #pragma omp critical
 #endif
-  for (size_t j = 0; j < particles->size(); j++) {
-    for (size_t k = j + 1; k < particles->size(); k++) {
-      Status s = m_physics_context.collide((*particles)[j], (*particles)[k]);
-      switch(s) {
-        case Status::None:
-        break;
-        case Status::Inconsistent:
-          m_inconsistent_count++;
-          m_collision_count++;
-        break;
-        case Status::Corrected:
-          m_correction_count++;
-          m_collision_count++;
-        break;
-        case Status::Success:
-          m_collision_count++;
-        break;
-        default:
-        break;
+        {
+          knock(a);
+          knock(b);
+        }
+      }
+      if (s == Status::Success) {
+        m_collision_count++;
+      }
+    };
+#ifdef PARALLELIZE_FOR_LOOPS
+    #pragma omp parallel
+#endif
+    for (size_t j = 0; j < particles->size(); j++) {
+      if (any_fast and m_substep_levels[j] != 0) {
+        continue;
+      }
+      if ((*particles)[j].asleep()) {
+        for (auto k = std::upper_bound(m_awake.begin(), m_awake.end(), j); k != m_awake.end(); ++k) {
+          check(j, *k);
+        }
+        continue;
+      }
+      for (size_t k = j + 1; k < particles->size(); k++) {
+        if (any_fast and m_substep_levels[k] != 0) {
+          continue;
+        }
+        check(j, k);
       }
     }
   }
 
+  if (!m_woken_islands.empty()) {
+    wake_islands(*particles);
+  }
+
   // check if anyone has hit a wall
-  for (auto& p : *particles) {
-    for (const auto& w : m_boundaries) {
-      // we allow multiple bounces per frame in case e.g. a particle goes into a corner
-      if (m_physics_context.bounce(p, w) == Status::Success) {
-        m_bounce_count++;
-      }
+  {
+    PROFILE_PHASE(m_profiler, Util::Phase::Bounce);
+    PERF_PHASE(m_perf_counters, Util::Phase::Bounce);
+    TRACE_SPAN("bounce");
+    // positions are for the end of this step now
+    const double now = get_step_time() + SIM_RESOLUTION_S;
+    for (auto& p : *particles) {
+      m_bounce_count += m_physics_context.bounce(p, m_boundaries, now);
     }
   }
 
+  // put anyone who's stopped moving to sleep
+  if (m_settings.get().sleep_steps > 0) {
+    PROFILE_PHASE(m_profiler, Util::Phase::Settle);
+    PERF_PHASE(m_perf_counters, Util::Phase::Settle);
+    TRACE_SPAN("settle");
+    settle(*particles);
+  }
+
+  // everything collisions and bounces did to the energy this step, and whether it's adding up to much
+  m_physics_context.ledger().merge();
+  if (audit_every > 0 and m_settings.get().energy_drift > 0) {
+    m_physics_context.ledger().check(static_cast<double>(m_settings.get().energy_drift));
+  }
+
+  // temperature and friends for whoever's following along, as of the end of this step
+  if (m_observables.is_open() and m_step % m_settings.get().observables_every == 0) {
+    PROFILE_PHASE(m_profiler, Util::Phase::Observe);
+    PERF_PHASE(m_perf_counters, Util::Phase::Observe);
+    TRACE_SPAN("observe");
+    const double x = static_cast<double>(m_boundaries[Component::WallIdx::RIGHT].position() -
+                                         m_boundaries[Component::WallIdx::LEFT].position());
+    const double y = static_cast<double>(m_boundaries[Component::WallIdx::TOP].position() -
+                                         m_boundaries[Component::WallIdx::BOTTOM].position());
+    m_observables.measure(*particles, m_step, get_step_time() + SIM_RESOLUTION_S,
+                          m_physics_context.take_wall_impulse(), 2 * (x + y));
+    m_observables.write();
+  }
+
   INFO_MSG(SYSTEM_STATUS);
+  INFO_MSG(PROFILE_DUMP);
   DEBUG_MSG(SYSTEM_REPORT);
 
-  m_particle_buffer.put();
+  // readers get this step as it is, the next one goes in another buffer
+  {
+    PROFILE_PHASE(m_profiler, Util::Phase::Publish);
+    PERF_PHASE(m_perf_counters, Util::Phase::Publish);
+    TRACE_SPAN("publish");
+    m_particle_buffer.put();
+    export_frame(get_particles(), get_step_time() + SIM_RESOLUTION_S);
+  }
+  m_perf_counters.end_step();
   m_step++;
 }
 
+template<typename V>
+std::shared_ptr<const SpatialIndex<V>> SimulationContext<V>::query() const {
+  auto frame = get_frame();
+  auto index = std::atomic_load(&m_index);
+  // the index holds its frame, so the buffer can't have been recycled into a newer one with the same address
+  if (index != nullptr and index->frame() == frame) {
+    return index;
+  }
+
+  // if someone else is already building it, wait for theirs rather than build it twice
+  std::lock_guard<std::mutex> lock(m_index_lock);
+  index = std::atomic_load(&m_index);
+  if (index != nullptr and index->frame() == frame) {
+    return index;
+  }
+  TRACE_SPAN("spatial_index");
+  index = std::make_shared<const SpatialIndex<V>>(std::move(frame));
+  std::atomic_store(&m_index, index);
+  return index;
+}
+
+template<typename V>
+Status SimulationContext<V>::rewind(size_t back) {
+  TRACE_SPAN("rewind");
+
+  // anything added has to be in the history before we can go back from it
+  if (m_uncommitted) {
+    commit_particles();
+  }
+
+  const Status status = m_particle_buffer.rewind(back);
+  if (status != Status::Success) {
+    return status;
+  }
+  m_step -= std::min(back, m_step);
+  const auto* particles = &m_particle_buffer.latest();
+  // the energy went back with them, the ledger can't follow that
+  m_physics_context.ledger().rebase();
+  // and the clock, pressure starts over from here without what the walls took in the future we threw away
+  m_observables.restart(get_step_time());
+  m_physics_context.take_wall_impulse();
+
+  // whoever's back owns their slot again, at their own generation. Everyone else's slot is free.
+  std::fill(m_slot_index.begin(), m_slot_index.end(), REMOVED);
+  m_sleeping_count = 0;
+  for (size_t i = 0; i < particles->size(); i++) {
+    const auto& p = (*particles)[i];
+    const size_t slot = uid_slot(p.uid.get());
+    m_slot_index[slot] = i;
+    m_slot_generation[slot] = static_cast<uint32_t>(uid_generation(p.uid.get()));
+    m_sleeping_count += p.asleep();
+  }
+  m_free_slots.clear();
+  for (size_t slot = 0; slot < m_slot_index.size(); slot++) {
+    if (m_slot_index[slot] == REMOVED) {
+      m_free_slots.push_back(slot);
+    }
+  }
+  m_particle_count = particles->size();
+  m_woken_islands.clear();
+  export_frame(get_particles(), get_step_time());
+  return Status::Success;
+}
+
 // stand up for yourself
 template<typename V>
 void SimulationContext<V>::set_boundaries(size_t x, size_t y, size_t z) {
@@ -162,6 +665,78 @@ void SimulationContext<V>::set_free_run(bool free_run) {
 template<typename V>
 void SimulationContext<V>::set_settings(const SimSettings<vector_t>& settings) {
   m_settings = Util::LatchingValue<SimSettings<typename V::vector_t>>(settings);
+  open_observables();
+  open_shared_frames();
+}
+
+template<typename V>
+void SimulationContext<V>::audit_energy(const std::vector<Component::Particle<V>>& particles) {
+  TRACE_SPAN("energy_audit");
+  Util::CompensatedSum total;
+#ifdef PARALLELIZE_FOR_LOOPS
+  #pragma omp parallel
+  {
+    Util::CompensatedSum mine;
+    #pragma omp for nowait
+    for (size_t i = 0; i < particles.size(); i++) {
+      mine.add(PhysicsContext<V>::ledger_energy(particles[i]));
+    }
+    #pragma omp critical
+    total.add(mine);
+  }
+#else
+  for (const auto& p : particles) {
+    total.add(PhysicsContext<V>::ledger_energy(p));
+  }
+#endif
+
+  // gravity does work the ledger doesn't see, so there's no telling what's unexplained
+  const auto& settings = m_settings.get();
+  const bool closed = settings.gravity == 0 and settings.mutual_gravity == 0;
+  m_physics_context.ledger().audit(total.value(), m_step, closed);
+}
+
+template<typename V>
+void SimulationContext<V>::open_observables() {
+  const auto& path = m_settings.get().observables;
+  if (!path.empty() and m_observables.open(path) != Status::Success) {
+    std::cout << "Unable to open " << path << " for observables, carrying on without them." << std::endl;
+  }
+}
+
+template<typename V>
+void SimulationContext<V>::open_shared_frames() {
+  const auto& name = m_settings.get().shm;
+  if (!name.empty() and m_shared_frames.open(name, std::max<size_t>(m_particle_count, 1)) != Status::Success) {
+    std::cout << "Unable to open shared memory " << name << " for frames, carrying on without it." << std::endl;
+  }
+}
+
+template<typename V>
+void SimulationContext<V>::export_frame(const std::vector<Component::Particle<V>>& particles, double time) {
+  if (!m_shared_frames.is_open()) {
+    return;
+  }
+  TRACE_SPAN("export_frame");
+  auto* out = m_shared_frames.begin(particles.size());
+  if (out == nullptr) {
+    return;
+  }
+#ifdef PARALLELIZE_FOR_LOOPS
+  #pragma omp parallel for
+#endif
+  for (size_t i = 0; i < particles.size(); i++) {
+    const auto& p = particles[i];
+    out[i] = {p.uid.get(),
+              static_cast<double>(p.position().x()), static_cast<double>(p.position().y()),
+              static_cast<double>(p.velocity().x()), static_cast<double>(p.velocity().y()),
+              static_cast<double>(p.radius()), static_cast<double>(p.mass())};
+  }
+  const double width = static_cast<double>(m_boundaries[Component::WallIdx::RIGHT].position() -
+                                           m_boundaries[Component::WallIdx::LEFT].position());
+  const double height = static_cast<double>(m_boundaries[Component::WallIdx::TOP].position() -
+                                            m_boundaries[Component::WallIdx::BOTTOM].position());
+  m_shared_frames.commit(m_step, time, width, height);
 }
 
 template<typename V>
@@ -171,35 +746,42 @@ const SimSettings<typename V::vector_t>& SimulationContext<V>::get_settings() co
 
 template<typename V>
 void SimulationContextThread(SimulationContext<V>& sim, SimSettings<typename V::vector_t> settings) {
+  Util::Trace::set_thread_name("simulation");
   sim.set_settings(settings);
 
+  // counters follow the thread which opens them, so this has to happen here
+  if (settings.perf_counters) {
+    sim.m_perf_counters.open();
+  }
+
+  // nothing to do but keep the window company
   if (settings.display_mode) {
-    while(true) {}
+    while(true) {
+      std::this_thread::sleep_for(chrono::hours(1));
+    }
   }
 
   if (settings.delay > 0) {
-    auto start = chrono::steady_clock::now();
-    chrono::duration<float> elapsed;
-    do {
-      auto now = chrono::steady_clock::now();
-      elapsed = now - start;
-    } while (elapsed.count() < settings.delay);
+    std::this_thread::sleep_for(chrono::duration<float>(settings.delay));
   }
 
-  // startup the buffer-copy thread
-  std::thread ring_buffer_copy_thread =
-        std::thread(Util::ring_thread<std::vector<Component::Particle<V>>,
-                                      Component::Particle<V>,
-                                      SimSettings<typename V::vector_t>::RingBufferSize>,
-                                      std::ref(sim.m_particle_buffer));
-  ring_buffer_copy_thread.detach();
-
-  // make 2 copies of the simulation at the start.. allows for corrections if an error occurs on the first frame
-  sim.m_particle_buffer.put();
+  // the scheduler keeps time from here, every run() is a step
+  sim.set_free_run(true);
+  auto& scheduler = sim.m_scheduler;
+  scheduler.set_catch_up(settings.max_catch_up);
+  scheduler.restart();
 
   while(true) {
+    const size_t due = scheduler.wait();
+
+    const size_t back = g_rewind.exchange(0);
+    if (back > 0) {
+      sim.rewind(back);
+    }
     if (!g_pause) {
-      sim.run();
+      for (size_t i = 0; i < due; i++) {
+        sim.run();
+      }
     } else {
       if (g_step) {
         sim.run();
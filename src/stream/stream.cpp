@@ -0,0 +1,382 @@
+#include "stream.h"
+#include "util/trace.h"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+
+namespace Stream {
+
+static constexpr char UNIX_PREFIX[] = "unix:";
+static constexpr char TCP_PREFIX[] = "tcp:";
+
+namespace {
+
+struct Address {
+  int family;
+  sockaddr_un un;
+  sockaddr_in in;
+  std::string unix_path;
+
+  const sockaddr* get() const {
+    return (family == AF_UNIX) ? reinterpret_cast<const sockaddr*>(&un) : reinterpret_cast<const sockaddr*>(&in);
+  }
+
+  socklen_t length() const {
+    return (family == AF_UNIX) ? sizeof(un) : sizeof(in);
+  }
+};
+
+Status parse(const std::string& address, Address& out) {
+  std::memset(&out.un, 0, sizeof(out.un));
+  std::memset(&out.in, 0, sizeof(out.in));
+
+  if (address.compare(0, sizeof(UNIX_PREFIX) - 1, UNIX_PREFIX) == 0) {
+    out.unix_path = address.substr(sizeof(UNIX_PREFIX) - 1);
+    // and room for the terminator
+    if (out.unix_path.empty() or out.unix_path.size() >= sizeof(out.un.sun_path)) {
+      return Status::Failure;
+    }
+    out.family = AF_UNIX;
+    out.un.sun_family = AF_UNIX;
+    std::memcpy(out.un.sun_path, out.unix_path.c_str(), out.unix_path.size() + 1);
+    return Status::Success;
+  }
+
+  if (address.compare(0, sizeof(TCP_PREFIX) - 1, TCP_PREFIX) == 0) {
+    const std::string port = address.substr(sizeof(TCP_PREFIX) - 1);
+    if (port.empty() or port.size() > 5 or port.find_first_not_of("0123456789") != std::string::npos) {
+      return Status::Failure;
+    }
+    const unsigned long number = std::stoul(port);
+    if (number == 0 or number > 65535) {
+      return Status::Failure;
+    }
+    out.family = AF_INET;
+    out.in.sin_family = AF_INET;
+    out.in.sin_port = htons(static_cast<uint16_t>(number));
+    // localhost only, anyone further away can tunnel
+    out.in.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    return Status::Success;
+  }
+
+  return Status::Failure;
+}
+
+} // namespace
+
+Status check_address(const std::string& address) {
+  Address parsed;
+  return parse(address, parsed);
+}
+
+template<typename V>
+Status Server<V>::start(const std::string& address) {
+  stop();
+
+  Address parsed;
+  if (parse(address, parsed) != Status::Success) {
+    return Status::Failure;
+  }
+
+  m_listen_fd = ::socket(parsed.family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  if (m_listen_fd < 0) {
+    return Status::Failure;
+  }
+
+  if (parsed.family == AF_UNIX) {
+    // left behind by a run that didn't get to clean up. Only ever a socket though, not whatever else is there
+    struct stat st;
+    if (::stat(parsed.unix_path.c_str(), &st) == 0 and S_ISSOCK(st.st_mode)) {
+      ::unlink(parsed.unix_path.c_str());
+    }
+    m_unix_path = parsed.unix_path;
+  } else {
+    const int yes = 1;
+    ::setsockopt(m_listen_fd, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+  }
+
+  if (::bind(m_listen_fd, parsed.get(), parsed.length()) != 0 or ::listen(m_listen_fd, 16) != 0) {
+    ::close(m_listen_fd);
+    m_listen_fd = -1;
+    m_unix_path.clear();
+    return Status::Failure;
+  }
+
+  const auto& walls = m_sim.get_boundaries();
+  m_width = static_cast<uint32_t>(std::lround(static_cast<double>(walls[Component::WallIdx::RIGHT].position() -
+                                                                  walls[Component::WallIdx::LEFT].position())));
+  m_height = static_cast<uint32_t>(std::lround(static_cast<double>(walls[Component::WallIdx::TOP].position() -
+                                                                   walls[Component::WallIdx::BOTTOM].position())));
+
+  m_stop = false;
+  m_thread = std::thread(&Server<V>::serve, this);
+  return Status::Success;
+}
+
+template<typename V>
+void Server<V>::stop() {
+  if (m_thread.joinable()) {
+    m_stop = true;
+    m_thread.join();
+  }
+  while (!m_connections.empty()) {
+    hang_up(m_connections.size() - 1);
+  }
+  if (m_listen_fd >= 0) {
+    ::close(m_listen_fd);
+    m_listen_fd = -1;
+  }
+  if (!m_unix_path.empty()) {
+    ::unlink(m_unix_path.c_str());
+    m_unix_path.clear();
+  }
+  m_last_frame.reset();
+  m_current.reset();
+  m_encoded.clear();
+  m_client_count = 0;
+}
+
+template<typename V>
+void Server<V>::serve() {
+  Util::Trace::set_thread_name("stream");
+  const auto interval = std::chrono::milliseconds(FRAME_INTERVAL_MS);
+  auto next_frame = std::chrono::steady_clock::now();
+  std::vector<pollfd> fds;
+
+  while (!m_stop.load()) {
+    fds.clear();
+    fds.push_back({m_listen_fd, POLLIN, 0});
+    for (const auto& c : m_connections) {
+      // writable only matters to someone with something left to send
+      fds.push_back({c.fd, static_cast<short>(POLLIN | ((c.sent < c.pending.size()) ? POLLOUT : 0)), 0});
+    }
+
+    const auto wait = std::chrono::duration_cast<std::chrono::milliseconds>(next_frame - std::chrono::steady_clock::now());
+    const int timeout = static_cast<int>(std::max<std::chrono::milliseconds::rep>(0, wait.count()));
+    if (::poll(fds.data(), fds.size(), timeout) < 0 and errno != EINTR) {
+      std::cout << "Stream server stopped, poll failed: " << std::strerror(errno) << std::endl;
+      return;
+    }
+
+    // back to front, hanging up swaps the last connection into the gap and we've already seen it
+    for (size_t i = fds.size() - 1; i-- > 0;) {
+      auto& c = m_connections[i];
+      const short events = fds[i + 1].revents;
+      bool alive = !(events & (POLLERR | POLLHUP | POLLNVAL));
+      if (alive and (events & POLLIN)) {
+        // viewers have nothing to say, but this is how we hear they've gone
+        char discard[256];
+        const ssize_t n = ::recv(c.fd, discard, sizeof(discard), MSG_DONTWAIT);
+        alive = n > 0 or (n < 0 and (errno == EAGAIN or errno == EWOULDBLOCK or errno == EINTR));
+      }
+      if (alive and (events & POLLOUT)) {
+        alive = flush(c);
+      }
+      if (!alive) {
+        hang_up(i);
+      }
+    }
+
+    if (fds[0].revents & POLLIN) {
+      int fd;
+      while ((fd = ::accept4(m_listen_fd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0) {
+        m_connections.push_back({fd, nullptr, {}, 0});
+        std::cout << "Stream viewer connected, " << m_connections.size() << " watching" << std::endl;
+      }
+    }
+    m_client_count = m_connections.size();
+
+    const auto now = std::chrono::steady_clock::now();
+    if (now >= next_frame) {
+      next_frame = now + interval;
+      TRACE_SPAN("stream_publish");
+      auto frame = m_sim.get_frame();
+      // we're holding the last one, so a new pointer is a new frame and not the same buffer recycled
+      const bool fresh = (frame != m_last_frame);
+      m_last_frame = std::move(frame);
+      if (fresh) {
+        publish(*m_last_frame);
+      }
+      // newcomers get a keyframe of the current one even if nothing's moved
+      deliver(fresh);
+    }
+  }
+}
+
+template<typename V>
+void Server<V>::publish(const std::vector<Component::Particle<V>>& particles) {
+  auto next = std::make_shared<std::vector<Util::QuantizedParticle>>();
+  next->reserve(particles.size());
+  for (const auto& p : particles) {
+    next->push_back({p.uid.get(),
+                     Util::quantize(static_cast<double>(p.position().x())),
+                     Util::quantize(static_cast<double>(p.position().y())),
+                     static_cast<uint32_t>(std::max(0, Util::quantize(static_cast<double>(p.radius()))))});
+  }
+  m_current = std::move(next);
+  m_sequence++;
+  m_encoded.clear();
+}
+
+template<typename V>
+void Server<V>::deliver(bool fresh) {
+  static const std::vector<Util::QuantizedParticle> nothing;
+  for (auto& c : m_connections) {
+    if (c.base == m_current) {
+      // up to date
+      continue;
+    }
+    if (c.sent < c.pending.size()) {
+      // still working through the last one, this one's skipped and the next is a delta from what they have
+      m_frames_skipped += fresh;
+      continue;
+    }
+
+    // everyone with the same base gets the same bytes
+    const void* key = c.base.get();
+    auto encoded = std::find_if(m_encoded.begin(), m_encoded.end(),
+                                [key](const std::pair<const void*, std::vector<uint8_t>>& e) { return e.first == key; });
+    if (encoded == m_encoded.end()) {
+      m_encoded.emplace_back(key, std::vector<uint8_t>());
+      encoded = m_encoded.end() - 1;
+      Util::encode_frame(m_sequence, m_width, m_height, c.base ? *c.base : nothing, *m_current, encoded->second);
+    }
+
+    c.pending = encoded->second;
+    c.sent = 0;
+    c.base = m_current;
+    m_frames_sent++;
+    // if they've hung up we'll hear about it from poll()
+    flush(c);
+  }
+}
+
+template<typename V>
+bool Server<V>::flush(Connection& c) {
+  while (c.sent < c.pending.size()) {
+    const ssize_t n = ::send(c.fd, c.pending.data() + c.sent, c.pending.size() - c.sent, MSG_NOSIGNAL | MSG_DONTWAIT);
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return errno == EAGAIN or errno == EWOULDBLOCK;
+    }
+    c.sent += static_cast<size_t>(n);
+  }
+  c.pending.clear();
+  c.sent = 0;
+  return true;
+}
+
+template<typename V>
+void Server<V>::hang_up(size_t connection) {
+  ::close(m_connections[connection].fd);
+  std::swap(m_connections[connection], m_connections.back());
+  m_connections.pop_back();
+  m_client_count = m_connections.size();
+  if (!m_stop.load()) {
+    std::cout << "Stream viewer left, " << m_connections.size() << " watching" << std::endl;
+  }
+}
+
+Status Client::connect(const std::string& address) {
+  disconnect();
+
+  Address parsed;
+  if (parse(address, parsed) != Status::Success) {
+    return Status::Failure;
+  }
+  m_fd = ::socket(parsed.family, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (m_fd < 0) {
+    return Status::Failure;
+  }
+  if (::connect(m_fd, parsed.get(), parsed.length()) != 0) {
+    ::close(m_fd);
+    m_fd = -1;
+    return Status::Failure;
+  }
+
+  m_connected = true;
+  m_thread = std::thread(&Client::receive, this);
+  return Status::Success;
+}
+
+void Client::disconnect() {
+  if (m_fd < 0) {
+    return;
+  }
+  // wakes the receiving thread out of recv()
+  ::shutdown(m_fd, SHUT_RDWR);
+  if (m_thread.joinable()) {
+    m_thread.join();
+  }
+  ::close(m_fd);
+  m_fd = -1;
+  m_connected = false;
+}
+
+void Client::receive() {
+  Util::Trace::set_thread_name("stream_client");
+  auto read_all = [this](void* out, size_t size) {
+    auto* p = static_cast<uint8_t*>(out);
+    while (size > 0) {
+      const ssize_t n = ::recv(m_fd, p, size, 0);
+      if (n <= 0) {
+        if (n < 0 and errno == EINTR) {
+          continue;
+        }
+        return false;
+      }
+      p += n;
+      size -= static_cast<size_t>(n);
+    }
+    return true;
+  };
+
+  std::vector<Util::QuantizedParticle> state;
+  std::vector<uint8_t> payload;
+  for (;;) {
+    Util::FrameHeader header;
+    // whatever's on the other end, check_header() bounds what we're about to allocate
+    if (!read_all(&header, sizeof(header)) or !Util::check_header(header)) {
+      break;
+    }
+    payload.resize(header.payload_bytes);
+    if (!read_all(payload.data(), payload.size()) or !Util::decode_frame(header, payload.data(), state)) {
+      break;
+    }
+
+    auto frame = std::make_shared<Frame>();
+    frame->reserve(state.size());
+    for (const auto& q : state) {
+      frame->push_back(Component::Particle<V>(static_cast<float>(Util::dequantize(q.radius)), 1, V(0, 0, 0),
+                                              V(static_cast<float>(Util::dequantize(q.x)), static_cast<float>(Util::dequantize(q.y)), 0)));
+      frame->back().uid = Util::LatchingValue<size_t>(q.uid);
+    }
+
+    m_width = header.width;
+    m_height = header.height;
+    m_sequence = header.sequence;
+    std::atomic_store(&m_frame, std::shared_ptr<const Frame>(std::move(frame)));
+    m_frames++;
+  }
+  m_connected = false;
+}
+
+template class Server<Component::Vector<float>>;
+template class Server<Component::Vector<double>>;
+template class Server<Component::Vector<Util::FixedPoint>>;
+
+} // Stream
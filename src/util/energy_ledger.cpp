@@ -0,0 +1,84 @@
+#include "util/energy_ledger.h"
+
+#include <algorithm>
+
+#ifdef PARALLELIZE_FOR_LOOPS
+#include <omp.h>
+#endif
+
+namespace Util {
+
+EnergyLedger::EnergyLedger() {
+#ifdef PARALLELIZE_FOR_LOOPS
+  m_slots.resize(static_cast<size_t>(std::max(omp_get_max_threads(), omp_get_num_procs())));
+#else
+  m_slots.resize(1);
+#endif
+}
+
+void EnergyLedger::record(double delta) {
+#ifdef PARALLELIZE_FOR_LOOPS
+  auto& slot = m_slots[static_cast<size_t>(omp_get_thread_num()) % m_slots.size()];
+#else
+  auto& slot = m_slots[0];
+#endif
+  slot.drift.add(delta);
+  slot.events++;
+}
+
+void EnergyLedger::merge() {
+  for (auto& slot : m_slots) {
+    m_drift.add(slot.drift);
+    m_events += slot.events;
+    slot.drift.clear();
+    slot.events = 0;
+  }
+}
+
+double EnergyLedger::expected() const {
+  if (!m_audited) {
+    return 0;
+  }
+  return m_total + (drift() - m_drift_at_audit) + (external_change() - m_external_at_audit);
+}
+
+void EnergyLedger::audit(double total, size_t step, bool closed) {
+  if (m_audited and closed) {
+    m_unexplained.add(total - expected());
+  }
+  if (!m_audited) {
+    m_drift_at_base = drift();
+    m_unexplained_at_base = unexplained();
+  }
+  m_audited = true;
+  m_total = total;
+  m_audit_step = step;
+  m_drift_at_audit = drift();
+  m_external_at_audit = external_change();
+}
+
+bool EnergyLedger::check(double tolerance) {
+  if (!m_audited) {
+    return false;
+  }
+
+  const double allowed = tolerance * std::abs(m_total);
+  const double drifted = drift() - m_drift_at_base;
+  const double unaccounted = unexplained() - m_unexplained_at_base;
+  const bool over = std::abs(drifted) > allowed or std::abs(unaccounted) > allowed;
+  if (over and !m_alarmed) {
+    std::cout << "Energy drift alarm: " << drifted << " drifted over " << m_events << " collisions and bounces, "
+              << unaccounted << " unexplained, against " << m_total << " at step " << m_audit_step
+              << ". See --energy-drift." << std::endl;
+  }
+  m_alarmed = over;
+  return over;
+}
+
+void EnergyLedger::report(std::ostream& os) const {
+  os << "Energy: " << expected() << " expected (" << m_total << " at step " << m_audit_step << ") | Drift: " << drift()
+     << " over " << m_events << " events | External: " << external_change() << " | Unexplained: " << unexplained()
+     << std::endl;
+}
+
+} // Util
@@ -0,0 +1,148 @@
+#include "util/event_log.h"
+#include "util/trace.h"
+
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <new>
+#include <vector>
+
+namespace Util {
+
+EventLog& EventLog::get() {
+  // Never destroyed, detached threads may still be pushing while the process exits.
+  // Placement new since C++14 new doesn't respect the alignment of the counters.
+  alignas(EventLog) static char storage[sizeof(EventLog)];
+  static EventLog* log = new (storage) EventLog();
+  return *log;
+}
+
+EventLog::EventLog()
+                  : m_cells(new Cell[CAPACITY])
+                  , m_tail(0)
+                  , m_head(0)
+                  , m_open(false)
+                  , m_stop(false)
+                  , m_dropped(0)
+                  , m_file(nullptr) {
+  for (size_t i = 0; i < CAPACITY; i++) {
+    m_cells[i].sequence.store(i, std::memory_order_relaxed);
+  }
+}
+
+EventLog::~EventLog() {
+  close();
+}
+
+bool EventLog::open(const std::string& path) {
+  if (is_open()) {
+    return true;
+  }
+
+  m_file = std::fopen(path.c_str(), "wb");
+  if (m_file == nullptr) {
+    return false;
+  }
+
+  FileHeader header;
+  std::memcpy(header.magic, EVENT_LOG_MAGIC, sizeof(header.magic));
+  header.record_size = sizeof(EventRecord);
+  header.reserved = 0;
+  std::fwrite(&header, sizeof(header), 1, m_file);
+
+  m_stop = false;
+  m_writer = std::thread(&EventLog::writer, this);
+  m_open = true;
+  return true;
+}
+
+void EventLog::close() {
+  if (!is_open()) {
+    return;
+  }
+
+  m_open = false;
+  m_stop = true;
+  m_writer.join();
+
+  std::fclose(m_file);
+  m_file = nullptr;
+
+  if (dropped() > 0) {
+    std::cout << "Event log dropped " << dropped() << " events, the writer couldn't keep up." << std::endl;
+  }
+}
+
+bool EventLog::push(const EventRecord& record) {
+  uint64_t pos = m_tail.load(std::memory_order_relaxed);
+  Cell* cell;
+
+  while (true) {
+    cell = &m_cells[pos & (CAPACITY - 1)];
+    uint64_t sequence = cell->sequence.load(std::memory_order_acquire);
+    auto diff = static_cast<int64_t>(sequence) - static_cast<int64_t>(pos);
+
+    if (diff == 0) {
+      // this cell is free, try to claim it
+      if (m_tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+        break;
+      }
+    } else if (diff < 0) {
+      // the writer hasn't freed this cell yet, we're full
+      m_dropped.fetch_add(1, std::memory_order_relaxed);
+      return false;
+    } else {
+      // someone else claimed it first
+      pos = m_tail.load(std::memory_order_relaxed);
+    }
+  }
+
+  cell->record = record;
+  cell->sequence.store(pos + 1, std::memory_order_release);
+  return true;
+}
+
+bool EventLog::pop(EventRecord& record) {
+  Cell* cell = &m_cells[m_head & (CAPACITY - 1)];
+  if (cell->sequence.load(std::memory_order_acquire) != m_head + 1) {
+    return false;
+  }
+
+  record = cell->record;
+  cell->sequence.store(m_head + CAPACITY, std::memory_order_release);
+  m_head++;
+  return true;
+}
+
+void EventLog::writer() {
+  Util::Trace::set_thread_name("event_log");
+
+  std::vector<EventRecord> batch;
+  batch.reserve(4096);
+
+  while (true) {
+    const bool stopping = m_stop.load(std::memory_order_acquire);
+
+    EventRecord record;
+    while (batch.size() < batch.capacity() and pop(record)) {
+      batch.push_back(record);
+    }
+
+    if (!batch.empty()) {
+      TRACE_SPAN("event_log_write");
+      std::fwrite(batch.data(), sizeof(EventRecord), batch.size(), m_file);
+      batch.clear();
+      continue;
+    }
+
+    // only quit once we've seen the stop flag and then found nothing left
+    if (stopping) {
+      break;
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+
+  std::fflush(m_file);
+}
+
+} // Util
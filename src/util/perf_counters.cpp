@@ -0,0 +1,188 @@
+#include "util/perf_counters.h"
+
+#include <cerrno>
+#include <cstring>
+#include <iomanip>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace Util {
+
+static constexpr std::array<const char*, PerfCounters::Counter::SIZE> counter_names = {
+  "cycles",
+  "instructions",
+  "l1d_misses",
+  "llc_misses",
+  "branch_misses",
+};
+
+const char* PerfCounters::counter_name(Counter c) {
+  return counter_names[c];
+}
+
+PerfCounters::PerfCounters()
+                          : m_leader(-1)
+                          , m_open_count(0)
+                          , m_steps(0)
+                          , m_skipped(0) {
+  m_fds.fill(-1);
+  m_slot.fill(-1);
+  for (auto& t : m_totals) {
+    t.fill(0);
+  }
+}
+
+PerfCounters::~PerfCounters() {
+#ifdef __linux__
+  for (auto fd : m_fds) {
+    if (fd >= 0) {
+      close(fd);
+    }
+  }
+#endif
+}
+
+#ifdef __linux__
+static int perf_event_open(uint32_t type, uint64_t config, int group_fd) {
+  perf_event_attr attr;
+  std::memset(&attr, 0, sizeof(attr));
+  attr.size = sizeof(attr);
+  attr.type = type;
+  attr.config = config;
+  attr.disabled = (group_fd == -1) ? 1 : 0;
+  attr.exclude_kernel = 1;
+  attr.exclude_hv = 1;
+  attr.read_format = PERF_FORMAT_GROUP;
+
+  return static_cast<int>(syscall(__NR_perf_event_open, &attr, 0, -1, group_fd, 0));
+}
+
+bool PerfCounters::open() {
+  if (enabled()) {
+    return true;
+  }
+
+  const std::array<std::pair<uint32_t, uint64_t>, Counter::SIZE> configs = {{
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+    {PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1D |
+                         (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                         (PERF_COUNT_HW_CACHE_RESULT_MISS << 16)},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+  }};
+
+  int first_errno = 0;
+  for (size_t i = 0; i < configs.size(); i++) {
+    int fd = perf_event_open(configs[i].first, configs[i].second, m_leader);
+    if (fd < 0) {
+      first_errno = (first_errno == 0) ? errno : first_errno;
+      continue;
+    }
+    if (m_leader < 0) {
+      m_leader = fd;
+    }
+    m_fds[i] = fd;
+    m_slot[i] = m_open_count++;
+  }
+
+  if (!enabled()) {
+    std::cout << "Hardware performance counters are unavailable (" << std::strerror(first_errno) << "), "
+              << "check /proc/sys/kernel/perf_event_paranoid or the container's seccomp profile. Continuing without them." << std::endl;
+    return false;
+  }
+
+  if (m_open_count < Counter::SIZE) {
+    std::cout << "Some hardware performance counters are unavailable, they will read as 0:";
+    for (size_t i = 0; i < m_fds.size(); i++) {
+      if (m_fds[i] < 0) {
+        std::cout << " " << counter_names[i];
+      }
+    }
+    std::cout << std::endl;
+  }
+
+  ioctl(m_leader, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+  ioctl(m_leader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+  return true;
+}
+
+Status PerfCounters::read(Sample& sample) const {
+  sample.fill(0);
+
+  // { nr, value[nr] }, anything short of every counter we opened is no good
+  std::array<uint64_t, Counter::SIZE + 1> buffer;
+  const auto expected = static_cast<ssize_t>(sizeof(uint64_t) * static_cast<size_t>(m_open_count + 1));
+  if (::read(m_leader, buffer.data(), sizeof(buffer)) < expected) {
+    return Status::Failure;
+  }
+
+  for (size_t i = 0; i < sample.size(); i++) {
+    if (m_slot[i] >= 0) {
+      sample[i] = buffer[static_cast<size_t>(m_slot[i]) + 1];
+    }
+  }
+  return Status::Success;
+}
+#else
+bool PerfCounters::open() {
+  std::cout << "Hardware performance counters are only supported on Linux. Continuing without them." << std::endl;
+  return false;
+}
+
+Status PerfCounters::read(Sample& sample) const {
+  sample.fill(0);
+  return Status::Failure;
+}
+#endif
+
+void PerfCounters::accumulate(Phase phase, const Sample& start, const Sample& end) {
+  auto& totals = m_totals[static_cast<size_t>(phase)];
+  for (size_t i = 0; i < totals.size(); i++) {
+    totals[i] += end[i] - start[i];
+  }
+}
+
+void PerfCounters::report(std::ostream& os) {
+  if (!enabled() or m_steps == 0) {
+    return;
+  }
+
+  os << "Hardware Counters (per step, over the last " << m_steps << " steps):" << std::endl;
+  os << "  " << std::left << std::setw(12) << "phase" << std::right;
+  for (auto name : counter_names) {
+    os << std::setw(15) << name;
+  }
+  os << std::setw(8) << "ipc" << std::endl;
+
+  const auto steps = static_cast<double>(m_steps);
+  for (size_t p = 0; p < m_totals.size(); p++) {
+    auto& totals = m_totals[p];
+    if (totals[Counter::Cycles] == 0 and totals[Counter::Instructions] == 0) {
+      continue;
+    }
+
+    os << "  " << std::left << std::setw(12) << PhaseProfiler::phase_name(static_cast<Phase>(p)) << std::right;
+    os << std::fixed << std::setprecision(0);
+    for (auto t : totals) {
+      os << std::setw(15) << static_cast<double>(t) / steps;
+    }
+    const double ipc = (totals[Counter::Cycles] == 0) ? 0 :
+      static_cast<double>(totals[Counter::Instructions]) / static_cast<double>(totals[Counter::Cycles]);
+    os << std::setprecision(2) << std::setw(8) << ipc << std::defaultfloat << std::endl;
+
+    totals.fill(0);
+  }
+  if (m_skipped > 0) {
+    os << "  (" << m_skipped << " phases uncounted, the counters couldn't be read)" << std::endl;
+  }
+  m_steps = 0;
+  m_skipped = 0;
+}
+
+} // Util
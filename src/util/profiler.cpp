@@ -0,0 +1,90 @@
+#include "util/profiler.h"
+
+#include <iomanip>
+
+namespace Util {
+
+static constexpr std::array<const char*, static_cast<size_t>(Phase::SIZE)> phase_names = {
+  "gravity",
+  "step",
+  "collision",
+  "bounce",
+  "publish",
+  "settle",
+  "substep",
+  "observe",
+};
+
+const char* PhaseProfiler::phase_name(Phase phase) {
+  return phase_names[static_cast<size_t>(phase)];
+}
+
+void PhaseProfiler::reset() {
+  for (auto& stats : m_phases) {
+    stats.count = 0;
+    stats.total_ns = 0;
+    stats.max_ns = 0;
+    for (auto& b : stats.histogram) {
+      b = 0;
+    }
+  }
+}
+
+uint64_t PhaseProfiler::percentile_ns(Phase phase, double p) const {
+  const auto& stats = m_phases[static_cast<size_t>(phase)];
+  const uint64_t count = stats.count.load(std::memory_order_relaxed);
+  if (count == 0) {
+    return 0;
+  }
+
+  const auto rank = static_cast<uint64_t>(p / 100.0 * static_cast<double>(count - 1)) + 1;
+  uint64_t seen = 0;
+  for (size_t b = 0; b < BUCKETS; b++) {
+    seen += stats.histogram[b].load(std::memory_order_relaxed);
+    if (seen >= rank) {
+      return uint64_t(1) << (b + 1);
+    }
+  }
+  return stats.max_ns.load(std::memory_order_relaxed);
+}
+
+void PhaseProfiler::report(std::ostream& os) const {
+  os << "Phase Profile (mean / p50 / p99 / max, in us):" << std::endl;
+  for (size_t i = 0; i < m_phases.size(); i++) {
+    const auto phase = static_cast<Phase>(i);
+    const auto& stats = m_phases[i];
+    const uint64_t count = stats.count.load(std::memory_order_relaxed);
+    if (count == 0) {
+      continue;
+    }
+
+    auto us = [](uint64_t ns) { return static_cast<double>(ns) / 1000.0; };
+    os << "  " << std::left << std::setw(12) << phase_name(phase) << std::right << std::fixed << std::setprecision(2)
+       << us(stats.total_ns.load(std::memory_order_relaxed) / count) << " / "
+       << us(percentile_ns(phase, 50)) << " / "
+       << us(percentile_ns(phase, 99)) << " / "
+       << us(stats.max_ns.load(std::memory_order_relaxed))
+       << " (" << count << " samples)" << std::endl;
+  }
+  os << std::defaultfloat;
+}
+
+void PhaseProfiler::dump(std::ostream& os) const {
+  os << "phase,count,total_ns,max_ns,p50_ns,p99_ns,log2_histogram" << std::endl;
+  for (size_t i = 0; i < m_phases.size(); i++) {
+    const auto phase = static_cast<Phase>(i);
+    const auto& stats = m_phases[i];
+    os << phase_name(phase) << ","
+       << stats.count.load(std::memory_order_relaxed) << ","
+       << stats.total_ns.load(std::memory_order_relaxed) << ","
+       << stats.max_ns.load(std::memory_order_relaxed) << ","
+       << percentile_ns(phase, 50) << ","
+       << percentile_ns(phase, 99) << ",";
+    for (size_t b = 0; b < BUCKETS; b++) {
+      os << ((b == 0) ? "" : " ") << stats.histogram[b].load(std::memory_order_relaxed);
+    }
+    os << std::endl;
+  }
+}
+
+} // Util
@@ -0,0 +1,85 @@
+#include "util/scheduler.h"
+
+#include <algorithm>
+#include <iomanip>
+#include <thread>
+
+namespace Util {
+
+constexpr std::chrono::microseconds TickScheduler::DEFAULT_SPIN;
+
+namespace {
+
+class SteadyTime :
+  public TickScheduler::TimeSource {
+public:
+  TickScheduler::clock::time_point now() override { return TickScheduler::clock::now(); }
+  void sleep_until(TickScheduler::clock::time_point t) override { std::this_thread::sleep_until(t); }
+  void yield() override { std::this_thread::yield(); }
+};
+
+} // namespace
+
+TickScheduler::TimeSource& TickScheduler::steady_time() {
+  static SteadyTime time;
+  return time;
+}
+
+TickScheduler::TickScheduler(std::chrono::microseconds period, size_t max_catch_up, std::chrono::microseconds spin,
+                             TimeSource& time)
+                            : m_period(period)
+                            , m_max_catch_up(1)
+                            , m_spin(spin)
+                            , m_time(time)
+                            {
+                              set_catch_up(max_catch_up);
+                              restart();
+                            }
+
+void TickScheduler::restart() {
+  m_start = m_time.now();
+  m_deadline = m_start;
+  m_waited = clock::duration::zero();
+}
+
+size_t TickScheduler::wait() {
+  auto now = m_time.now();
+  if (now < m_deadline) {
+    const auto start = now;
+    if (m_deadline - now > m_spin) {
+      m_time.sleep_until(m_deadline - m_spin);
+    }
+    while ((now = m_time.now()) < m_deadline) {
+      m_time.yield();
+    }
+    m_waited += now - start;
+  }
+
+  // this tick, and any whose deadlines went by while we were busy
+  const auto late = now - m_deadline;
+  const auto due = static_cast<uint64_t>(late / m_period) + 1;
+  const auto run = std::min<uint64_t>(due, m_max_catch_up);
+
+  m_missed += due - 1;
+  m_dropped += due - run;
+  m_ticks += run;
+  m_deadline += m_period * static_cast<int64_t>(due);
+  return static_cast<size_t>(run);
+}
+
+double TickScheduler::idle() const {
+  const auto total = m_time.now() - m_start;
+  if (total <= clock::duration::zero()) {
+    return 0;
+  }
+  return std::chrono::duration<double>(m_waited) / std::chrono::duration<double>(total);
+}
+
+void TickScheduler::report(std::ostream& os) const {
+  const auto precision = os.precision();
+  os << "Ticks: " << m_ticks << " | Missed: " << m_missed << " | Dropped: " << m_dropped
+     << " | Idle: " << std::fixed << std::setprecision(1) << idle() * 100 << "%" << std::defaultfloat << std::endl;
+  os.precision(precision);
+}
+
+} // Util
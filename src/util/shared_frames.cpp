@@ -0,0 +1,127 @@
+#include "util/shared_frames.h"
+
+#include <iostream>
+
+namespace Util {
+
+Status SharedFrames::open(const std::string& name, size_t capacity) {
+  if (is_open() and name == m_name) {
+    return Status::Success;
+  }
+  close();
+
+  // anything left over from some other run is theirs to keep, this is a new one
+  ::shm_unlink(name.c_str());
+  m_fd = ::shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0644);
+  if (m_fd < 0) {
+    std::cout << "Couldn't open shared memory " << name << std::endl;
+    return Status::Failure;
+  }
+  m_name = name;
+  m_sequence[0] = m_sequence[1] = 0;
+  m_generation = 0;
+  m_latest = 0;
+  if (grow(capacity > 0 ? capacity : 1) != Status::Success) {
+    close();
+    return Status::Failure;
+  }
+
+  // zeroed, nothing written yet
+  __atomic_store_n(&header()->magic, SIM_SHM_MAGIC, __ATOMIC_RELEASE);
+  return Status::Success;
+}
+
+void SharedFrames::close() {
+  if (m_base != nullptr) {
+    ::munmap(m_base, m_size);
+    m_base = nullptr;
+    m_size = 0;
+    m_capacity = 0;
+  }
+  if (m_fd >= 0) {
+    ::close(m_fd);
+    ::shm_unlink(m_name.c_str());
+    m_fd = -1;
+  }
+  m_name.clear();
+}
+
+Status SharedFrames::grow(size_t capacity) {
+  // odd while slots aren't where readers think they are. Whatever they've mapped stays valid, the region never shrinks
+  uint64_t layout = 0;
+  if (m_base != nullptr) {
+    layout = header()->layout + 1;
+    __atomic_store_n(&header()->layout, layout, __ATOMIC_RELEASE);
+  }
+
+  // if it can't be done, what's there now carries on as it was
+  const size_t size = sim_shm_bytes(capacity);
+  void* base = MAP_FAILED;
+  if (::ftruncate(m_fd, static_cast<off_t>(size)) == 0) {
+    base = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, m_fd, 0);
+  }
+  if (base == MAP_FAILED) {
+    std::cout << "Couldn't make shared memory " << m_name << " " << size << " bytes" << std::endl;
+    if (m_base != nullptr) {
+      __atomic_store_n(&header()->layout, layout + 1, __ATOMIC_RELEASE);
+    }
+    return Status::Failure;
+  }
+  if (m_base != nullptr) {
+    ::munmap(m_base, m_size);
+  }
+  m_base = base;
+  m_size = size;
+  m_capacity = capacity;
+
+  // the slots have moved, and what's where they are now isn't a frame. Odd until each is written again
+  for (size_t i = 0; i < SIM_SHM_SLOTS; i++) {
+    __atomic_store_n(&slot(i)->sequence, m_sequence[i] + 1, __ATOMIC_RELAXED);
+  }
+  __atomic_store_n(&header()->capacity, static_cast<uint64_t>(capacity), __ATOMIC_RELAXED);
+  __atomic_store_n(&header()->layout, layout + (layout & 1), __ATOMIC_RELEASE);
+  return Status::Success;
+}
+
+sim_shm_particle* SharedFrames::begin(size_t count) {
+  if (!is_open()) {
+    return nullptr;
+  }
+  if (count > m_capacity) {
+    size_t capacity = m_capacity;
+    while (capacity < count) {
+      capacity *= 2;
+    }
+    if (grow(capacity) != Status::Success) {
+      return nullptr;
+    }
+  }
+
+  // whichever one readers weren't pointed at
+  m_writing = (m_latest + 1) % SIM_SHM_SLOTS;
+  m_count = count;
+  __atomic_store_n(&slot(m_writing)->sequence, m_sequence[m_writing] + 1, __ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+  return reinterpret_cast<sim_shm_particle*>(slot(m_writing) + 1);
+}
+
+void SharedFrames::commit(uint64_t step, double time, double width, double height) {
+  if (!is_open()) {
+    return;
+  }
+  auto* s = slot(m_writing);
+  s->step = step;
+  s->count = m_count;
+  s->time = time;
+  s->width = width;
+  s->height = height;
+
+  m_sequence[m_writing] += 2;
+  __atomic_store_n(&s->sequence, m_sequence[m_writing], __ATOMIC_RELEASE);
+  m_latest = m_writing;
+  m_generation++;
+  __atomic_store_n(&header()->latest, static_cast<uint64_t>(m_latest), __ATOMIC_RELEASE);
+  __atomic_store_n(&header()->generation, m_generation, __ATOMIC_RELEASE);
+}
+
+} // Util
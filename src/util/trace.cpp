@@ -0,0 +1,98 @@
+#include "util/trace.h"
+
+#include <fstream>
+#include <iomanip>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace Util {
+namespace Trace {
+
+std::atomic<bool> g_enabled(false);
+
+static const auto g_trace_start = std::chrono::steady_clock::now();
+
+// Buffers are never freed, detached threads may still be recording while we write
+static std::mutex g_registry_lock;
+static std::vector<ThreadBuffer*> g_registry;
+
+static thread_local ThreadBuffer* t_buffer = nullptr;
+
+void enable() {
+  g_enabled = true;
+}
+
+uint64_t now_ns() {
+  return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+    std::chrono::steady_clock::now() - g_trace_start).count());
+}
+
+ThreadBuffer& thread_buffer() {
+  if (t_buffer == nullptr) {
+    std::lock_guard<std::mutex> lock(g_registry_lock);
+    t_buffer = new ThreadBuffer(static_cast<uint32_t>(g_registry.size() + 1));
+    g_registry.push_back(t_buffer);
+  }
+  return *t_buffer;
+}
+
+void set_thread_name(const char* name) {
+  auto& buffer = thread_buffer();
+  // write() reads it under the lock
+  std::lock_guard<std::mutex> lock(g_registry_lock);
+  buffer.name = name;
+}
+
+bool write(const std::string& path) {
+  std::ofstream os(path, std::ios::trunc);
+  if (!os) {
+    return false;
+  }
+
+  // Chrome wants microseconds, keep the nanoseconds as a fraction
+  auto us = [](uint64_t ns) {
+    return static_cast<double>(ns) / 1000.0;
+  };
+
+  os << std::fixed << std::setprecision(3);
+  os << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[" << std::endl;
+
+  // hold everyone still, recording off and anyone part way through a push() out the other side
+  std::lock_guard<std::mutex> lock(g_registry_lock);
+  const bool was_enabled = g_enabled.exchange(false);
+  for (const auto* buffer : g_registry) {
+    while (buffer->busy.load()) {
+      std::this_thread::yield();
+    }
+  }
+
+  bool first = true;
+  for (const auto* buffer : g_registry) {
+    os << (first ? "" : ",\n");
+    first = false;
+    os << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << buffer->tid
+       << ",\"args\":{\"name\":\"" << ((buffer->name == nullptr) ? "unnamed" : buffer->name) << "\"}}";
+
+    // anything older than one buffer's worth has been overwritten
+    const uint64_t head = buffer->head.load(std::memory_order_relaxed);
+    const uint64_t tail = (head > EVENTS_PER_THREAD) ? head - EVENTS_PER_THREAD : 0;
+    for (uint64_t i = tail; i < head; i++) {
+      const auto& e = (*buffer->events)[i % EVENTS_PER_THREAD];
+      os << ",\n{\"name\":\"" << e.name << "\",\"pid\":1,\"tid\":" << buffer->tid << ",\"ts\":" << us(e.ts_ns);
+      if (e.type == EventType::Span) {
+        os << ",\"ph\":\"X\",\"dur\":" << us(e.dur_ns) << "}";
+      } else {
+        os << ",\"ph\":\"i\",\"s\":\"t\"}";
+      }
+    }
+  }
+
+  g_enabled = was_enabled;
+
+  os << std::endl << "]}" << std::endl;
+  return static_cast<bool>(os);
+}
+
+} // Trace
+} // Util
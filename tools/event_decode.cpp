@@ -0,0 +1,111 @@
+// Pretty print an event log written with --debug-event-log
+//
+// usage: event_decode <log> [uid...]
+// With uids, only events involving one of those particles are printed.
+
+#include "util/event_log.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <vector>
+
+using Util::EventRecord;
+using Util::EventStatus;
+using Util::EventType;
+
+static const char* status_name(EventStatus s) {
+  switch (s) {
+    case EventStatus::Success:      return "success";
+    case EventStatus::Corrected:    return "corrected";
+    case EventStatus::Inconsistent: return "inconsistent";
+    case EventStatus::Failed:       return "failed";
+  }
+  return "?";
+}
+
+static const char* wall_name(uint8_t wall) {
+  static const char* names[] = {"left", "back", "right", "front", "top", "bottom"};
+  return (wall < 6) ? names[wall] : "?";
+}
+
+static void print(const EventRecord& r) {
+  std::printf("step %8llu  t %10.6fs  ", static_cast<unsigned long long>(r.step),
+              static_cast<double>(r.elapsed_us) / 1e6);
+
+  switch (r.type) {
+    case EventType::Collision:
+      std::printf("collision  %4llu <-> %-4llu %-12s ke %.4f -> %.4f (%+.4f)  dist %.4f"
+                  "  va {%.4f, %.4f, %.4f}  vb {%.4f, %.4f, %.4f}",
+                  static_cast<unsigned long long>(r.uid_a), static_cast<unsigned long long>(r.uid_b),
+                  status_name(r.status), r.data[0], r.data[1], r.data[1] - r.data[0], r.data[2],
+                  r.data[3], r.data[4], r.data[5], r.data[6], r.data[7], r.data[8]);
+      break;
+    case EventType::Bounce:
+      std::printf("bounce     %4llu %-6s  pos {%.4f, %.4f, %.4f}  vel {%.4f, %.4f, %.4f}",
+                  static_cast<unsigned long long>(r.uid_a), wall_name(r.wall),
+                  r.data[0], r.data[1], r.data[2], r.data[3], r.data[4], r.data[5]);
+      break;
+    case EventType::Correction:
+      std::printf("correction %4llu <-> %-4llu attempt %u at %.0fus: %s",
+                  static_cast<unsigned long long>(r.uid_a), static_cast<unsigned long long>(r.uid_b),
+                  r.attempt, r.data[0], status_name(r.status));
+      break;
+    default:
+      std::printf("unknown event type %u", static_cast<unsigned>(r.type));
+      break;
+  }
+
+  std::printf("%s\n", r.replay ? "  (replay)" : "");
+}
+
+int main(int argc, char** argv) {
+  if (argc < 2) {
+    std::fprintf(stderr, "usage: %s <log> [uid...]\n", argv[0]);
+    return 1;
+  }
+
+  std::FILE* f = std::fopen(argv[1], "rb");
+  if (f == nullptr) {
+    std::perror(argv[1]);
+    return 1;
+  }
+
+  Util::FileHeader header;
+  if (std::fread(&header, sizeof(header), 1, f) != 1 or
+      std::memcmp(header.magic, Util::EVENT_LOG_MAGIC, sizeof(header.magic)) != 0) {
+    std::fprintf(stderr, "%s is not an event log\n", argv[1]);
+    return 1;
+  }
+  if (header.record_size != sizeof(EventRecord)) {
+    std::fprintf(stderr, "%s has %u byte records, this decoder expects %zu\n",
+                 argv[1], header.record_size, sizeof(EventRecord));
+    return 1;
+  }
+
+  std::vector<uint64_t> uids;
+  for (int i = 2; i < argc; i++) {
+    uids.push_back(std::strtoull(argv[i], nullptr, 10));
+  }
+  auto wanted = [&](const EventRecord& r) {
+    return uids.empty() or
+           std::find(uids.begin(), uids.end(), r.uid_a) != uids.end() or
+           std::find(uids.begin(), uids.end(), r.uid_b) != uids.end();
+  };
+
+  std::map<EventType, size_t> counts;
+  EventRecord record;
+  while (std::fread(&record, sizeof(record), 1, f) == 1) {
+    if (wanted(record)) {
+      print(record);
+      counts[record.type]++;
+    }
+  }
+  std::fclose(f);
+
+  std::printf("\n%zu collisions, %zu bounces, %zu correction attempts\n",
+              counts[EventType::Collision], counts[EventType::Bounce], counts[EventType::Correction]);
+  return 0;
+}
@@ -0,0 +1,37 @@
+// Watch a simulation running with --stream, from another process
+//
+// usage: stream_view <address> [seed]
+// The address is whatever the simulation was given, unix:<path> or tcp:<port>. To watch a simulation on
+// another machine, tunnel its port or socket here first (ssh -L). Give the same seed to get the same colors.
+
+#include "stream.h"
+#include "window.h"
+
+#include <cstdlib>
+#include <iostream>
+
+int main(int argc, char** argv) {
+  if (argc < 2 or argc > 3) {
+    std::cout << "usage: " << argv[0] << " <unix:path | tcp:port> [seed]" << std::endl;
+    return 1;
+  }
+
+  Stream::Client client;
+  if (client.connect(argv[1]) != Status::Success) {
+    std::cout << "Nobody streaming at " << argv[1] << std::endl;
+    return 1;
+  }
+
+  auto settings = Simulation::DefaultSettings<float>;
+  settings.screen_mode = Simulation::ScreenMode::DEFAULT;
+  if (argc == 3) {
+    settings.seed = std::strtoull(argv[2], nullptr, 0);
+  }
+
+  Graphics::StreamWindowThread(client, settings);
+
+  if (!client.connected()) {
+    std::cout << "The simulation hung up after " << client.frames() << " frames" << std::endl;
+  }
+  return 0;
+}
@@ -0,0 +1,18 @@
+#pragma once
+// Setting up a simulation for a test to run
+
+#include "context.h"
+
+#include <cstddef>
+#include <memory>
+
+// a simulation in an x by y by z box, free running, with physics to match its settings
+template<typename V>
+std::unique_ptr<Simulation::SimulationContext<V>> make_context(const Simulation::SimSettings<typename V::vector_t>& settings,
+                                                               size_t x, size_t y, size_t z) {
+  auto sim = std::make_unique<Simulation::SimulationContext<V>>(settings);
+  sim->set_boundaries(x, y, z);
+  sim->set_physics_context(Simulation::PhysicsContext<V>(settings));
+  sim->set_free_run(true);
+  return sim;
+}
@@ -0,0 +1,117 @@
+#include "physics/barnes_hut.h"
+#include "timer.h"
+#include "util/random.h"
+
+#include <cmath>
+#include <cstdlib>
+#include <gtest/gtest.h>
+#include <iomanip>
+#include <vector>
+
+// Mutual gravity against direct summation. AccuracyAndSpeed times the tree at a few opening angles against the
+// O(n^2) sum, on SIM_BENCH_BH_N bodies (20000 by default).
+
+using Simulation::BarnesHut;
+
+static constexpr uint64_t BH_SEED = 0x6EA7;
+static constexpr double G = 100;
+static constexpr double SOFTENING = 2;
+
+// A lumpy cluster: a few gaussian clumps in a 1000 wide box, masses in [1, 10]
+static std::vector<BarnesHut::Body> cluster(size_t n) {
+  std::vector<BarnesHut::Body> bodies(n);
+  for (size_t i = 0; i < n; i++) {
+    Util::CounterRng gen(BH_SEED, i);
+    const double clump = static_cast<double>(gen.uniform_int(0, 4));
+    const double r = 100 * std::sqrt(-2 * std::log(1 - gen.uniform()));
+    const double a = gen.uniform(0, 2 * M_PI);
+    bodies[i] = {300 * std::cos(clump) + r * std::cos(a), 300 * std::sin(clump) + r * std::sin(a), gen.uniform(1, 10)};
+  }
+  return bodies;
+}
+
+// RMS of |a - exact| / RMS of |exact|
+static double relative_error(const std::vector<BarnesHut::Accel>& a, const std::vector<BarnesHut::Accel>& exact) {
+  double err = 0;
+  double norm = 0;
+  for (size_t i = 0; i < a.size(); i++) {
+    const double dx = a[i][0] - exact[i][0];
+    const double dy = a[i][1] - exact[i][1];
+    err += dx * dx + dy * dy;
+    norm += exact[i][0] * exact[i][0] + exact[i][1] * exact[i][1];
+  }
+  return std::sqrt(err / norm);
+}
+
+TEST(BarnesHutTest, TwoBodies) {
+  std::vector<BarnesHut::Body> bodies = {{0, 0, 1}, {10, 0, 4}};
+  BarnesHut tree;
+  tree.build(bodies);
+
+  std::vector<BarnesHut::Accel> a;
+  tree.accelerations(1, 0.5, 0, a);
+  ASSERT_DOUBLE_EQ(a[0][0], 4.0 / 100);
+  ASSERT_DOUBLE_EQ(a[1][0], -1.0 / 100);
+  ASSERT_EQ(a[0][1], 0);
+}
+
+TEST(BarnesHutTest, ThetaZeroIsExact) {
+  const auto bodies = cluster(2000);
+  std::vector<BarnesHut::Accel> exact;
+  BarnesHut::direct(bodies, G, SOFTENING, exact);
+
+  BarnesHut tree;
+  tree.build(bodies);
+  std::vector<BarnesHut::Accel> a;
+  tree.accelerations(G, 0, SOFTENING, a);
+
+  ASSERT_LT(relative_error(a, exact), 1e-12);
+}
+
+TEST(BarnesHutTest, CoincidentBodies) {
+  // more than fit in a leaf, all in one spot, plus one elsewhere
+  std::vector<BarnesHut::Body> bodies(50, {5, 5, 1});
+  bodies.push_back({100, 5, 1});
+
+  BarnesHut tree;
+  tree.build(bodies);
+  std::vector<BarnesHut::Accel> a;
+  tree.accelerations(G, 0.5, SOFTENING, a);
+  std::vector<BarnesHut::Accel> exact;
+  BarnesHut::direct(bodies, G, SOFTENING, exact);
+
+  ASSERT_LT(relative_error(a, exact), 1e-3);
+}
+
+TEST(BarnesHutTest, AccuracyAndSpeed) {
+  const size_t n = bench_size("SIM_BENCH_BH_N", 20000);
+  const auto bodies = cluster(n);
+
+  Timer<chrono::microseconds> direct_timer;
+  std::vector<BarnesHut::Accel> exact;
+  direct_timer.start();
+  BarnesHut::direct(bodies, G, SOFTENING, exact);
+  direct_timer.stop();
+  std::cout << "n = " << n << ", direct: " << direct_timer.max().count() << "us" << std::endl;
+
+  BarnesHut tree;
+  for (double theta : {0.3, 0.5, 0.7, 1.0}) {
+    Timer<chrono::microseconds> timer;
+    std::vector<BarnesHut::Accel> a;
+    timer.start();
+    tree.build(bodies);
+    tree.accelerations(G, theta, SOFTENING, a);
+    timer.stop();
+
+    const double error = relative_error(a, exact);
+    std::cout << "theta = " << theta << ": " << std::setw(8) << timer.max().count() << "us, "
+              << tree.node_count() << " nodes, relative error " << error << std::endl;
+
+    if (theta == 0.5) {
+      // monopoles only, a percent or so is par for the course
+      ASSERT_LT(error, 2e-2);
+      // an order of magnitude is the least we should expect at this size
+      ASSERT_LT(timer.max() * 10, direct_timer.max());
+    }
+  }
+}
@@ -0,0 +1,98 @@
+#include "ensemble.h"
+
+#include <cstdio>
+#include <fstream>
+#include <gtest/gtest.h>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// Sweeps, and many simulations at once giving what they'd give one at a time
+
+typedef Component::Vector<double> V;
+
+static std::string temp_path(const std::string& name) {
+  return ::testing::TempDir() + name;
+}
+
+TEST(EnsembleTest, SweepExpands) {
+  std::istringstream spec(
+    "# a comment\n"
+    "steps 20   # and another\n"
+    "\n"
+    "--p-count 10 20 30\n"
+    "--gravity 0 100\n");
+  Ensemble::Sweep sweep;
+  ASSERT_EQ(Ensemble::load_sweep(spec, sweep), Status::Success);
+  ASSERT_EQ(sweep.steps, 20u);
+  ASSERT_EQ(sweep.threads, 0u);
+
+  const auto runs = Ensemble::expand(sweep);
+  ASSERT_EQ(runs.size(), 6u);
+  ASSERT_EQ(runs[0], std::vector<std::string>({"--p-count", "10", "--gravity", "0"}));
+  ASSERT_EQ(runs[1], std::vector<std::string>({"--p-count", "10", "--gravity", "100"}));
+  ASSERT_EQ(runs[5], std::vector<std::string>({"--p-count", "30", "--gravity", "100"}));
+
+  // nothing swept is still one run
+  ASSERT_EQ(Ensemble::expand(Ensemble::Sweep()).size(), 1u);
+}
+
+TEST(EnsembleTest, BadSweeps) {
+  for (const char* bad : {"steps\n", "steps 10 20\n", "--gravity\n", "--seed 1\n--seed 2\n", "gravity 10\n", "steps 0\n"}) {
+    std::istringstream spec(bad);
+    Ensemble::Sweep sweep;
+    ASSERT_EQ(Ensemble::load_sweep(spec, sweep), Status::Failure) << bad;
+  }
+}
+
+TEST(EnsembleTest, SameAsOneAtATime) {
+  const auto sweep_path = temp_path("sweep.txt");
+  const auto out_path = temp_path("ensemble.csv");
+  {
+    std::ofstream f(sweep_path);
+    f << "steps 50\nthreads 3\n--gravity 0 100\n--v-max 100 300\n";
+  }
+
+  std::vector<std::string> args = {"sim", "--p-count", "40", "--seed", "7",
+                                   "--ensemble", sweep_path, "--ensemble-out", out_path};
+  std::vector<char*> argv;
+  for (auto& arg : args) {
+    argv.push_back(&arg[0]);
+  }
+  auto settings = Simulation::DefaultSettings<double>;
+  settings.ensemble = sweep_path;
+  settings.ensemble_out = out_path;
+  ASSERT_EQ(Ensemble::run<V>(static_cast<int>(argv.size()), argv.data(), settings), Status::Success);
+
+  std::ifstream f(out_path);
+  std::string line;
+  std::vector<std::string> rows;
+  while (std::getline(f, line)) {
+    rows.push_back(line);
+  }
+  ASSERT_EQ(rows.size(), 5u);
+
+  // the last run again on its own, it shouldn't matter what else was running alongside
+  auto last = Simulation::DefaultSettings<double>;
+  last.number_particles = 40;
+  last.seed = 7;
+  last.gravity = 100;
+  last.vmax = 300;
+  last.no_gui = true;
+  auto alone = Ensemble::run_one<V>(last, 50);
+  alone.args = "--gravity 100 --v-max 300";
+  std::ostringstream expected;
+  Ensemble::write_summaries(expected, {alone});
+
+  // everything but the wall time
+  auto without_time = [](const std::string& row) { return row.substr(0, row.rfind(',')); };
+  std::string expected_row;
+  std::istringstream expected_rows(expected.str());
+  std::getline(expected_rows, expected_row);
+  std::getline(expected_rows, expected_row);
+  ASSERT_EQ(without_time(rows.back()), "3" + without_time(expected_row).substr(1));
+  ASSERT_NE(alone.collisions + alone.bounces, 0u);
+
+  std::remove(sweep_path.c_str());
+  std::remove(out_path.c_str());
+}
@@ -0,0 +1,92 @@
+#include "util/event_log.h"
+
+#include <cstdio>
+#include <cstring>
+#include <gtest/gtest.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+// The binary event log, written from several threads and read back the way bin/event_decode does
+
+using Util::EventLog;
+using Util::EventRecord;
+using Util::EventStatus;
+using Util::EventType;
+
+static EventRecord make_record(uint64_t thread, uint64_t i) {
+  EventRecord r;
+  std::memset(&r, 0, sizeof(r));
+  r.type = (i % 2 == 0) ? EventType::Collision : EventType::Bounce;
+  r.status = EventStatus::Success;
+  r.wall = static_cast<uint8_t>(i % 6);
+  r.step = i;
+  r.elapsed_us = i * 10;
+  r.uid_a = thread;
+  r.uid_b = i;
+  for (size_t d = 0; d < 9; d++) {
+    r.data[d] = static_cast<double>(thread) + static_cast<double>(i) / 8 + static_cast<double>(d);
+  }
+  return r;
+}
+
+static bool read_log(const std::string& path, Util::FileHeader& header, std::vector<EventRecord>& records) {
+  std::FILE* file = std::fopen(path.c_str(), "rb");
+  if (file == nullptr or std::fread(&header, sizeof(header), 1, file) != 1) {
+    return false;
+  }
+  EventRecord r;
+  while (std::fread(&r, sizeof(r), 1, file) == 1) {
+    records.push_back(r);
+  }
+  std::fclose(file);
+  return true;
+}
+
+TEST(EventLogTest, ReadsBackWhatWasWritten) {
+  const std::string path = ::testing::TempDir() + "sim_events.bin";
+  auto& log = EventLog::get();
+  ASSERT_TRUE(log.open(path));
+  ASSERT_TRUE(log.is_open());
+
+  // a few thousand each, well under the ring's capacity so nothing has to be dropped
+  static constexpr uint64_t THREADS = 4;
+  static constexpr uint64_t PER_THREAD = 5000;
+  std::vector<std::thread> threads;
+  std::vector<uint64_t> pushed(THREADS, 0);
+  for (uint64_t t = 0; t < THREADS; t++) {
+    threads.emplace_back([&log, &pushed, t]() {
+      for (uint64_t i = 0; i < PER_THREAD; i++) {
+        pushed[t] += log.push(make_record(t, i));
+      }
+    });
+  }
+  for (auto& t : threads) {
+    t.join();
+  }
+  log.close();
+  ASSERT_FALSE(log.is_open());
+
+  Util::FileHeader header;
+  std::vector<EventRecord> records;
+  ASSERT_TRUE(read_log(path, header, records));
+  ASSERT_EQ(std::memcmp(header.magic, Util::EVENT_LOG_MAGIC, sizeof(header.magic)), 0);
+  ASSERT_EQ(header.record_size, sizeof(EventRecord));
+
+  // everything is there exactly as it went in, each thread's in the order it pushed them
+  uint64_t accepted = 0;
+  for (auto p : pushed) {
+    accepted += p;
+  }
+  ASSERT_EQ(log.dropped(), 0u);
+  ASSERT_EQ(accepted, THREADS * PER_THREAD);
+  ASSERT_EQ(records.size(), accepted);
+  std::vector<int64_t> last(THREADS, -1);
+  for (const auto& r : records) {
+    ASSERT_LT(r.uid_a, THREADS);
+    ASSERT_GT(static_cast<int64_t>(r.uid_b), last[r.uid_a]);
+    last[r.uid_a] = static_cast<int64_t>(r.uid_b);
+    const auto expected = make_record(r.uid_a, r.uid_b);
+    ASSERT_EQ(std::memcmp(&r, &expected, sizeof(r)), 0);
+  }
+}
@@ -0,0 +1,139 @@
+#include "context.h"
+#include "util/history.h"
+#include "util/random.h"
+
+#include <gtest/gtest.h>
+#include <vector>
+
+// Delta compressed history, in the shape the simulation uses it
+
+using Component::Particle;
+using Component::Vector;
+using Util::FrameHistory;
+
+typedef Vector<Util::FixedPoint> V;
+typedef std::vector<Particle<V>> Frame;
+
+static constexpr uint64_t HISTORY_SEED = 0x415;
+
+// n particles scattered about, drifting
+static Frame scattered(size_t n) {
+  Frame frame;
+  for (size_t i = 0; i < n; i++) {
+    Util::CounterRng gen(HISTORY_SEED, i);
+    Particle<V> p(10, 1, V(gen.uniform(-100, 100), gen.uniform(-100, 100), 0),
+                         V(gen.uniform(-500, 500), gen.uniform(-500, 500), 0));
+    p.uid.latch(i + 1);
+    frame.push_back(p);
+  }
+  return frame;
+}
+
+// one step's worth of free flight, with the odd bump
+static void advance(Frame& frame, size_t step) {
+  const Util::FixedPoint dt(0.01);
+  for (size_t i = 0; i < frame.size(); i++) {
+    auto& p = frame[i];
+    if ((i + step) % 97 == 0) {
+      p.set_velocity(p.velocity() * Util::FixedPoint(-1));
+    }
+    p.set_position(p.position() + p.velocity() * dt);
+  }
+}
+
+TEST(HistoryTest, EveryFrameComesBack) {
+  const size_t depth = 40;
+  FrameHistory<Frame> history(depth);
+  std::vector<Frame> expected;
+
+  Frame frame = scattered(500);
+  for (size_t step = 0; step < 100; step++) {
+    history.push(frame);
+    expected.push_back(frame);
+    advance(frame, step);
+  }
+
+  ASSERT_EQ(history.size(), depth);
+  for (size_t back = 0; back < depth; back++) {
+    Frame out;
+    ASSERT_EQ(history.get(back, out), Status::Success);
+    ASSERT_EQ(out, expected[expected.size() - 1 - back]) << back << " back";
+  }
+  Frame out;
+  ASSERT_EQ(history.get(depth, out), Status::Failure);
+}
+
+TEST(HistoryTest, SmallerThanCopies) {
+  const size_t n = 2000;
+  const size_t frame_bytes = n * sizeof(Particle<V>);
+
+  for (size_t depth : {10, 100, 400}) {
+    FrameHistory<Frame> history(depth);
+    Frame frame = scattered(n);
+    for (size_t step = 0; step < depth; step++) {
+      history.push(frame);
+      advance(frame, step);
+    }
+    const double copies = static_cast<double>(history.bytes()) / static_cast<double>(frame_bytes);
+    std::cout << "depth " << depth << ": " << history.keyframes() << " keyframes, "
+              << history.bytes() << " bytes, " << copies << " frames worth" << std::endl;
+    // a keyframe and encode() scratch, then a delta costs no more than a quarter of a frame and in practice much less
+    ASSERT_LT(copies, 1 + static_cast<double>(depth) / 10);
+  }
+}
+
+TEST(HistoryTest, ChangingSizes) {
+  FrameHistory<Frame> history(5);
+  Frame frame = scattered(10);
+  history.push(frame);
+  frame.pop_back();
+  history.push(frame);
+  frame.push_back(scattered(20).back());
+  frame.push_back(scattered(30).back());
+  history.push(frame);
+
+  Frame out;
+  ASSERT_EQ(history.get(0, out), Status::Success);
+  ASSERT_EQ(out, frame);
+  ASSERT_EQ(history.get(1, out), Status::Success);
+  ASSERT_EQ(out.size(), 9u);
+  ASSERT_EQ(history.get(2, out), Status::Success);
+  ASSERT_EQ(out, scattered(10));
+
+  // shrinking the depth lets go of the old keyframes
+  history.set_depth(1);
+  ASSERT_EQ(history.size(), 1u);
+  ASSERT_EQ(history.keyframes(), 1u);
+  ASSERT_EQ(history.get(1, out), Status::Failure);
+}
+
+TEST(HistoryTest, RewindInPlace) {
+  FrameHistory<Frame> history(20);
+  std::vector<Frame> expected;
+
+  Frame frame = scattered(500);
+  for (size_t step = 0; step < 30; step++) {
+    history.push(frame);
+    expected.push_back(frame);
+    advance(frame, step);
+  }
+
+  // from the newest, like the working buffer would be
+  Frame working = expected.back();
+  ASSERT_EQ(history.rewind(5, working), Status::Success);
+  ASSERT_EQ(working, expected[expected.size() - 6]);
+  ASSERT_EQ(history.size(), 15u);
+
+  // and again from there, then on to new things
+  ASSERT_EQ(history.rewind(14, working), Status::Success);
+  ASSERT_EQ(working, expected[expected.size() - 20]);
+  ASSERT_EQ(history.rewind(1, working), Status::Failure);
+  ASSERT_EQ(working, expected[expected.size() - 20]);
+
+  history.push(frame);
+  Frame out;
+  ASSERT_EQ(history.get(0, out), Status::Success);
+  ASSERT_EQ(out, frame);
+  ASSERT_EQ(history.get(1, out), Status::Success);
+  ASSERT_EQ(out, expected[expected.size() - 20]);
+}
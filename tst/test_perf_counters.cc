@@ -0,0 +1,140 @@
+#include "util/perf_counters.h"
+
+#include <linux/audit.h>
+#include <linux/filter.h>
+#include <linux/seccomp.h>
+#include <sys/prctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstddef>
+#include <cstdlib>
+#include <gtest/gtest.h>
+#include <iostream>
+#include <sstream>
+#include <string>
+
+// Hardware counters around each phase, and what happens when there aren't any
+
+using Util::Phase;
+using Util::PerfCounters;
+
+// some work worth counting
+static uint64_t busy() {
+  volatile uint64_t x = 1;
+  for (uint64_t i = 0; i < 1000000; i++) {
+    x = x * 6364136223846793005ULL + i;
+  }
+  return x;
+}
+
+// perf_event_open fails with EACCES from here on, the way it does under a locked down container
+static bool deny_perf_event_open() {
+  sock_filter filter[] = {
+    BPF_STMT(BPF_LD | BPF_W | BPF_ABS, offsetof(seccomp_data, nr)),
+    BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, __NR_perf_event_open, 0, 1),
+    BPF_STMT(BPF_RET | BPF_K, SECCOMP_RET_ERRNO | (EACCES & SECCOMP_RET_DATA)),
+    BPF_STMT(BPF_RET | BPF_K, SECCOMP_RET_ALLOW),
+  };
+  sock_fprog program = {static_cast<unsigned short>(sizeof(filter) / sizeof(filter[0])), filter};
+  return prctl(PR_SET_NO_NEW_PRIVS, 1, 0, 0, 0) == 0 and
+         prctl(PR_SET_SECCOMP, SECCOMP_MODE_FILTER, &program) == 0;
+}
+
+TEST(PerfCountersTest, DegradesWithoutPerfEvents) {
+  // in a child, so the filter goes with it
+  EXPECT_EXIT({
+    if (!deny_perf_event_open()) {
+      std::exit(2);
+    }
+    // says so, rather than failing
+    std::stringstream said;
+    auto* out = std::cout.rdbuf(said.rdbuf());
+    PerfCounters counters;
+    const bool opened = counters.open();
+    std::cout.rdbuf(out);
+    if (opened or counters.enabled() or said.str().find("unavailable") == std::string::npos) {
+      std::exit(3);
+    }
+    // scopes count nothing, reads are all zeros, and there's nothing to report
+    {
+      PERF_PHASE(counters, Phase::Collision);
+      busy();
+    }
+    counters.end_step();
+    PerfCounters::Sample sample;
+    if (counters.read(sample) != Status::Failure) {
+      std::exit(4);
+    }
+    for (auto value : sample) {
+      if (value != 0) {
+        std::exit(4);
+      }
+    }
+    std::stringstream report;
+    counters.report(report);
+    std::exit(report.str().empty() ? 0 : 5);
+  }, ::testing::ExitedWithCode(0), "");
+}
+
+TEST(PerfCountersTest, CountsWhenAvailable) {
+  PerfCounters counters;
+  if (!counters.open()) {
+    GTEST_SKIP() << "no hardware counters here";
+  }
+  ASSERT_TRUE(counters.open());
+
+  PerfCounters::Sample before;
+  ASSERT_EQ(counters.read(before), Status::Success);
+  {
+    PERF_PHASE(counters, Phase::Step);
+    busy();
+  }
+  counters.end_step();
+  PerfCounters::Sample after;
+  ASSERT_EQ(counters.read(after), Status::Success);
+  for (size_t i = 0; i < before.size(); i++) {
+    ASSERT_GE(after[i], before[i]) << PerfCounters::counter_name(static_cast<PerfCounters::Counter>(i));
+  }
+
+  // the phase that did the work shows up, and the averages start again after a report
+  std::stringstream report;
+  counters.report(report);
+  if (after[PerfCounters::Instructions] > before[PerfCounters::Instructions]) {
+    ASSERT_NE(report.str().find("step"), std::string::npos);
+  }
+  std::stringstream again;
+  counters.report(again);
+  ASSERT_TRUE(again.str().empty());
+}
+
+TEST(PerfCountersTest, FailedReadsAreSkipped) {
+  // "open", on something that can't be read from, the way a group read fails
+  int fds[2];
+  ASSERT_EQ(pipe(fds), 0);
+  PerfCounters counters;
+  counters.m_leader = fds[1];
+  counters.m_slot[PerfCounters::Cycles] = 0;
+  counters.m_open_count = 1;
+
+  PerfCounters::Sample sample;
+  ASSERT_EQ(counters.read(sample), Status::Failure);
+  {
+    PERF_PHASE(counters, Phase::Step);
+    busy();
+  }
+  counters.end_step();
+
+  // nothing wrapped around into the totals, and the report says what went missing
+  for (auto value : counters.m_totals[static_cast<size_t>(Phase::Step)]) {
+    ASSERT_EQ(value, 0u);
+  }
+  std::stringstream report;
+  counters.report(report);
+  ASSERT_NE(report.str().find("1 phases uncounted"), std::string::npos) << report.str();
+
+  counters.m_leader = -1;
+  close(fds[0]);
+  close(fds[1]);
+}
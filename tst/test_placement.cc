@@ -0,0 +1,113 @@
+#include "demo/placement.h"
+#include "timer.h"
+
+#include <cmath>
+#include <cstdlib>
+#include <gtest/gtest.h>
+#include <random>
+#include <vector>
+
+// Startup placement. StartupTime holds placing SIM_BENCH_PLACE_N particles (a million by default) to 10ms a thousand.
+
+using Demo::Disk;
+
+static constexpr uint32_t PLACE_SEED = 0xC0FFEE;
+
+// Suggest a square lattice like the demo does, with radii in [r_min, r_max] and a box sized
+// for the requested packing fraction. The lattice is too tight for the biggest disks, on purpose.
+static std::vector<Disk> lattice_disks(size_t n, double r_min, double r_max, double packing_fraction,
+                                       double& width, Util::CounterRng& gen) {
+  std::uniform_real_distribution<double> radius_dist(r_min, r_max);
+  const double r_mean = (r_min + r_max) / 2;
+  width = std::sqrt(static_cast<double>(n) * M_PI * r_mean * r_mean / packing_fraction);
+
+  const size_t grid = static_cast<size_t>(std::ceil(std::sqrt(static_cast<double>(n))));
+  const double spacing = width / static_cast<double>(grid);
+
+  std::vector<Disk> disks;
+  disks.reserve(n);
+  for (size_t i = 0; i < n; i++) {
+    disks.push_back({-width / 2 + spacing * (static_cast<double>(i % grid) + 0.5),
+                     width / 2 - spacing * (static_cast<double>(i / grid) + 0.5),
+                     radius_dist(gen), i});
+  }
+  return disks;
+}
+
+// The slow way, so we trust the fast way
+static size_t count_overlaps(const std::vector<Disk>& disks) {
+  size_t overlaps = 0;
+  for (size_t i = 0; i < disks.size(); i++) {
+    for (size_t j = i + 1; j < disks.size(); j++) {
+      const double dx = disks[i].x - disks[j].x;
+      const double dy = disks[i].y - disks[j].y;
+      const double min_dist = disks[i].radius + disks[j].radius;
+      overlaps += (dx * dx + dy * dy < min_dist * min_dist) ? 1 : 0;
+    }
+  }
+  return overlaps;
+}
+
+TEST(PlacementTest, NoOverlapMixedRadii) {
+  Util::CounterRng gen(PLACE_SEED, 0);
+  double width;
+  auto disks = lattice_disks(10000, 2, 12, 0.35, width, gen);
+
+  ASSERT_GT(count_overlaps(disks), 0u);
+  ASSERT_EQ(Demo::place_disks(disks, width, width, gen), 0u);
+  ASSERT_EQ(disks.size(), 10000u);
+  ASSERT_EQ(count_overlaps(disks), 0u);
+
+  for (size_t i = 0; i < disks.size(); i++) {
+    ASSERT_EQ(disks[i].index, i);
+    ASSERT_LE(std::abs(disks[i].x) + disks[i].radius, width / 2);
+    ASSERT_LE(std::abs(disks[i].y) + disks[i].radius, width / 2);
+  }
+}
+
+TEST(PlacementTest, FreeSuggestionsStay) {
+  Util::CounterRng gen(PLACE_SEED, 0);
+  double width;
+  auto disks = lattice_disks(2500, 1, 2, 0.1, width, gen);
+  const auto before = disks;
+
+  ASSERT_EQ(Demo::place_disks(disks, width, width, gen), 0u);
+  for (size_t i = 0; i < disks.size(); i++) {
+    ASSERT_EQ(disks[i].x, before[i].x);
+    ASSERT_EQ(disks[i].y, before[i].y);
+  }
+}
+
+TEST(PlacementTest, OverfullBoxDropsExtras) {
+  Util::CounterRng gen(PLACE_SEED, 0);
+  // room for roughly 100 of these, ask for 1000
+  double width = 200;
+  std::vector<Disk> disks;
+  for (size_t i = 0; i < 1000; i++) {
+    disks.push_back({0, 0, 10, i});
+  }
+
+  const size_t removed = Demo::place_disks(disks, width, width, gen);
+  ASSERT_GT(removed, 0u);
+  ASSERT_EQ(disks.size() + removed, 1000u);
+  ASSERT_EQ(count_overlaps(disks), 0u);
+}
+
+TEST(PlacementTest, StartupTime) {
+  const size_t n = bench_size("SIM_BENCH_PLACE_N", 1000000);
+  // a million particles should be ready in seconds, not minutes
+  const auto TIME_LIMIT = chrono::milliseconds(static_cast<long>(10 * n / 1000));
+
+  Util::CounterRng gen(PLACE_SEED, 0);
+  double width;
+  auto disks = lattice_disks(n, 1, 3, 0.4, width, gen);
+
+  Timer<chrono::milliseconds> timer;
+  timer.start();
+  const size_t removed = Demo::place_disks(disks, width, width, gen);
+  timer.stop();
+
+  std::cout << "Placed " << disks.size() << " particles in " << timer.max().count() << "ms" << std::endl;
+  ASSERT_EQ(removed, 0u);
+  ASSERT_LT(timer.max(), TIME_LIMIT);
+}
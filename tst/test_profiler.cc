@@ -0,0 +1,96 @@
+#include "util/profiler.h"
+
+#include <chrono>
+#include <gtest/gtest.h>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Per-phase step timing, the histograms under make profile
+
+using Util::Phase;
+using Util::PhaseProfiler;
+
+// the dump's row for a phase
+static std::string dump_row(const PhaseProfiler& profiler, Phase phase) {
+  std::stringstream dump;
+  profiler.dump(dump);
+  std::string line;
+  while (std::getline(dump, line)) {
+    if (line.compare(0, line.find(','), PhaseProfiler::phase_name(phase)) == 0) {
+      return line;
+    }
+  }
+  return "";
+}
+
+TEST(ProfilerTest, SamplesLandInTheirPhaseAndBucket) {
+  PhaseProfiler profiler;
+  // 99 quick collisions and one slow one
+  for (size_t i = 0; i < 99; i++) {
+    profiler.record(Phase::Collision, 1000);
+  }
+  profiler.record(Phase::Collision, 1000000);
+  profiler.record(Phase::Bounce, 3);
+
+  // 1000ns is bucket 9, [512, 1024), and a percentile is the top of its bucket
+  ASSERT_EQ(profiler.percentile_ns(Phase::Collision, 50), 1024u);
+  ASSERT_EQ(profiler.percentile_ns(Phase::Collision, 98), 1024u);
+  ASSERT_EQ(profiler.percentile_ns(Phase::Collision, 100), 1u << 20);
+  ASSERT_EQ(profiler.percentile_ns(Phase::Bounce, 50), 4u);
+  // nobody else saw a thing
+  ASSERT_EQ(profiler.percentile_ns(Phase::Step, 50), 0u);
+
+  ASSERT_EQ(dump_row(profiler, Phase::Collision).compare(0, 30, "collision,100,1099000,1000000,"), 0);
+  ASSERT_EQ(dump_row(profiler, Phase::Step).compare(0, 12, "step,0,0,0,0"), 0);
+  // the histogram's the last column, space separated
+  const auto row = dump_row(profiler, Phase::Collision);
+  std::stringstream histogram(row.substr(row.rfind(',') + 1));
+  std::vector<uint64_t> buckets;
+  uint64_t count;
+  while (histogram >> count) {
+    buckets.push_back(count);
+  }
+  const size_t all = PhaseProfiler::BUCKETS;
+  ASSERT_EQ(buckets.size(), all);
+  ASSERT_EQ(buckets[9], 99u);
+  ASSERT_EQ(buckets[19], 1u);
+
+  // only phases with samples are reported
+  std::stringstream report;
+  profiler.report(report);
+  ASSERT_NE(report.str().find("collision"), std::string::npos);
+  ASSERT_EQ(report.str().find("gravity"), std::string::npos);
+
+  profiler.reset();
+  ASSERT_EQ(profiler.percentile_ns(Phase::Collision, 50), 0u);
+}
+
+TEST(ProfilerTest, ScopesAreTimed) {
+  PhaseProfiler profiler;
+  {
+    Util::ScopedPhase phase(profiler, Phase::Publish);
+    std::this_thread::sleep_for(std::chrono::milliseconds(2));
+  }
+  // at least the 2ms we slept, which is bucket 20 or later
+  ASSERT_GE(profiler.percentile_ns(Phase::Publish, 100), 1u << 21);
+  ASSERT_EQ(dump_row(profiler, Phase::Publish).compare(0, 10, "publish,1,"), 0);
+}
+
+TEST(ProfilerTest, RecordsFromManyThreads) {
+  PhaseProfiler profiler;
+  std::vector<std::thread> threads;
+  for (size_t t = 0; t < 4; t++) {
+    threads.emplace_back([&profiler, t]() {
+      for (uint64_t i = 1; i <= 10000; i++) {
+        profiler.record(Phase::Step, i + t);
+      }
+    });
+  }
+  for (auto& t : threads) {
+    t.join();
+  }
+  // nothing lost, and the longest of anyone's
+  ASSERT_EQ(dump_row(profiler, Phase::Step).compare(0, 27, "step,40000,200080000,10003,"), 0);
+}
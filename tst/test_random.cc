@@ -0,0 +1,59 @@
+#include "util/random.h"
+
+#include <gtest/gtest.h>
+#include <omp.h>
+#include <vector>
+
+using Util::CounterRng;
+
+TEST(RandomTest, SameKeySameSequence) {
+  CounterRng a(42, 7, Util::RngStream::Attributes);
+  CounterRng b(42, 7, Util::RngStream::Attributes);
+  for (size_t i = 0; i < 1000; i++) {
+    ASSERT_EQ(a(), b());
+  }
+}
+
+TEST(RandomTest, KeysAreIndependent) {
+  CounterRng base(42, 7, Util::RngStream::Attributes);
+  CounterRng other_seed(43, 7, Util::RngStream::Attributes);
+  CounterRng other_index(42, 8, Util::RngStream::Attributes);
+  CounterRng other_stream(42, 7, Util::RngStream::Color);
+
+  const auto first = base();
+  ASSERT_NE(first, other_seed());
+  ASSERT_NE(first, other_index());
+  ASSERT_NE(first, other_stream());
+}
+
+TEST(RandomTest, Ranges) {
+  CounterRng gen(1, 0);
+  double sum = 0;
+  for (size_t i = 0; i < 100000; i++) {
+    const double u = gen.uniform(-2, 3);
+    ASSERT_GE(u, -2);
+    ASSERT_LT(u, 3);
+    sum += u;
+
+    const auto k = gen.uniform_int(5, 9);
+    ASSERT_GE(k, 5);
+    ASSERT_LE(k, 9);
+  }
+  ASSERT_NEAR(sum / 100000, 0.5, 0.05);
+}
+
+// what the demo relies on, particle i's draws don't care who made them
+TEST(RandomTest, ThreadCountDoesNotMatter) {
+  const size_t n = 100000;
+  auto generate = [&](int threads) {
+    std::vector<double> out(n);
+    #pragma omp parallel for num_threads(threads)
+    for (size_t i = 0; i < n; i++) {
+      CounterRng gen(1234, i);
+      out[i] = gen.uniform() + gen.uniform(10, 20);
+    }
+    return out;
+  };
+
+  ASSERT_EQ(generate(1), generate(4));
+}
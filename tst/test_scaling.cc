@@ -0,0 +1,156 @@
+#include "context.h"
+#include "timer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <gtest/gtest.h>
+#include <iostream>
+#include <random>
+#include <string>
+#include <tuple>
+#include <unistd.h>
+#include <vector>
+
+// Sweeps particle count, packing fraction, radius spread and scalar type, and writes one CSV row per case.
+// Tune the sweep with the environment:
+//   SIM_BENCH_MAX_N  largest particle count to run, decades from 1e2 (default 1e3, the engine is O(n^2) past that)
+//   SIM_BENCH_STEPS  steps timed per case (default 100)
+//   SIM_BENCH_CSV    where to write results (default bench_scaling.csv)
+
+using Component::Vector;
+using Component::Particle;
+
+// particle count, packing fraction, radius spread
+typedef std::tuple<size_t, float, float> ScalingCase;
+
+class ScalingBenchmark :
+  public ::testing::TestWithParam<ScalingCase> {};
+
+static constexpr uint32_t BENCH_SEED = 0xDEADBEEF;
+static constexpr float BENCH_RADIUS = 10;
+static constexpr float BENCH_V_MAX = 100;
+
+static std::vector<size_t> particle_counts() {
+  std::vector<size_t> counts;
+  const size_t max_n = bench_size("SIM_BENCH_MAX_N", 1000);
+  for (size_t n = 100; n <= max_n && n <= 1000000; n *= 10) {
+    counts.push_back(n);
+  }
+  return counts;
+}
+
+static std::ofstream& csv_out() {
+  static std::ofstream csv;
+  if (!csv.is_open()) {
+    const char* path = std::getenv("SIM_BENCH_CSV");
+    csv.open((path == nullptr) ? "bench_scaling.csv" : path, std::ios::trunc);
+    csv << "scalar,n,packing_fraction,radius_spread,steps,median_us,p99_us,"
+           "collisions_per_step,bounces_per_step,ring_bytes,rss_bytes" << std::endl;
+  }
+  return csv;
+}
+
+static size_t resident_bytes() {
+  std::ifstream statm("/proc/self/statm");
+  size_t pages = 0, resident = 0;
+  statm >> pages >> resident;
+  return resident * static_cast<size_t>(sysconf(_SC_PAGESIZE));
+}
+
+// Lay particles out on a lattice inside a square box sized for the requested packing fraction.
+// Radii are uniform in [r, r * (1 + spread)]. The same seed always produces the same system.
+// Returns the box width and the packing fraction we actually achieved, since dense polydisperse
+// cases need the box widened to keep lattice neighbours from overlapping.
+template<typename V>
+std::tuple<size_t, float> seeded_initial_conditions(Simulation::SimulationContext<V>& sim, size_t n,
+                                                    float packing_fraction, float spread, uint32_t seed) {
+  typedef typename V::vector_t vector_t;
+
+  std::mt19937 gen(seed);
+  std::uniform_real_distribution<float> radius_dist(BENCH_RADIUS, BENCH_RADIUS * (1.f + spread));
+  std::uniform_real_distribution<float> mass_dist(1, 10);
+  std::uniform_real_distribution<float> vel_dist(-BENCH_V_MAX / 2, BENCH_V_MAX / 2);
+
+  const float r_max = BENCH_RADIUS * (1.f + spread);
+  const float r_mean = BENCH_RADIUS * (1.f + spread / 2.f);
+  const size_t grid = static_cast<size_t>(std::ceil(std::sqrt(static_cast<float>(n))));
+
+  float width = std::sqrt(static_cast<float>(n) * static_cast<float>(M_PI) * r_mean * r_mean / packing_fraction);
+  width = std::max(width, static_cast<float>(grid) * 2.2f * r_max);
+  const float spacing = width / static_cast<float>(grid);
+
+  const size_t box = static_cast<size_t>(std::ceil(width));
+  sim.set_boundaries(box, box, box);
+
+  for (size_t i = 0; i < n; i++) {
+    float px = -width / 2.f + spacing * (static_cast<float>(i % grid) + 0.5f);
+    float py = width / 2.f - spacing * (static_cast<float>(i / grid) + 0.5f);
+
+    Vector<vector_t> v{vector_t(vel_dist(gen)), vector_t(vel_dist(gen)), vector_t(0.f)};
+    Vector<vector_t> p{vector_t(px), vector_t(py), vector_t(0.f)};
+
+    Particle<V> particle(vector_t(radius_dist(gen)), vector_t(mass_dist(gen)), v, p);
+    sim.add_particle(particle);
+  }
+
+  const float achieved = static_cast<float>(n) * static_cast<float>(M_PI) * r_mean * r_mean / (width * width);
+  return std::make_tuple(box, achieved);
+}
+
+template<typename V>
+void run_scaling_case(const std::string& scalar_name, const ScalingCase& c) {
+  const size_t n = std::get<0>(c);
+  const float spread = std::get<2>(c);
+  const size_t n_steps = bench_size("SIM_BENCH_STEPS", 100);
+
+  Simulation::SimulationContext<V> sim;
+  auto layout = seeded_initial_conditions(sim, n, std::get<1>(c), spread, BENCH_SEED);
+
+  Simulation::PhysicsContext<V> phys(Simulation::DefaultSettings<typename V::vector_t>);
+  sim.set_physics_context(phys);
+  sim.set_free_run(true);
+
+  Timer<chrono::microseconds> timer;
+  for (size_t i = 0; i < n_steps; i++) {
+    timer.start();
+    sim.run();
+    timer.stop();
+  }
+
+  // every buffer in the pool holds a full copy of the system, history is compressed
+  const size_t ring_bytes = sim.m_particle_buffer.pool_size() * n * sizeof(Particle<V>) +
+                            sim.m_particle_buffer.history_bytes();
+  const double steps = static_cast<double>(n_steps);
+
+  csv_out() << scalar_name << "," << n << "," << std::get<1>(layout) << "," << spread << "," << n_steps << ","
+            << timer.calculate_median().count() << "," << timer.calculate_percentile(99).count() << ","
+            << static_cast<double>(sim.get_collision_count()) / steps << ","
+            << static_cast<double>(sim.get_bounce_count()) / steps << ","
+            << ring_bytes << "," << resident_bytes() << std::endl;
+
+  std::cout << scalar_name << " n=" << n << " box=" << std::get<0>(layout)
+            << " packing=" << std::get<1>(layout) << " spread=" << spread << std::endl;
+  timer.print_all();
+
+  ASSERT_EQ(timer.count(), n_steps);
+}
+
+TEST_P(ScalingBenchmark, FixedPoint) {
+  run_scaling_case<Vector<Util::FixedPoint>>("fixed", GetParam());
+}
+
+TEST_P(ScalingBenchmark, Double) {
+  run_scaling_case<Vector<double>>("double", GetParam());
+}
+
+TEST_P(ScalingBenchmark, Float) {
+  run_scaling_case<Vector<float>>("float", GetParam());
+}
+
+INSTANTIATE_TEST_SUITE_P(Sweep,
+                        ScalingBenchmark,
+                        ::testing::Combine(::testing::ValuesIn(particle_counts()),
+                                           ::testing::Values(0.05f, 0.2f, 0.4f),
+                                           ::testing::Values(0.f, 1.f)));
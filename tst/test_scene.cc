@@ -0,0 +1,152 @@
+#include "context.h"
+#include "demo/scene.h"
+
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <gtest/gtest.h>
+#include <iterator>
+#include <string>
+#include <vector>
+
+using Component::Vector;
+using Component::Particle;
+
+typedef Vector<double> V;
+
+static std::string temp_path(const std::string& name) {
+  return ::testing::TempDir() + name;
+}
+
+TEST(SceneTest, TextScene) {
+  const auto path = temp_path("scene.csv");
+  {
+    std::ofstream f(path);
+    f << "x,y,vx,vy,radius,mass,r,g,b" << std::endl;
+    f << "# box 800 600" << std::endl;
+    f << "-100, 50, 1.5, -2, 10, 3, 255, 0, 128" << std::endl;
+    f << std::endl;
+    f << "# a comment" << std::endl;
+    f << "200,-75,0,0,20,6,1,2,3" << std::endl;
+  }
+
+  Simulation::SimulationContext<V> sim;
+  Demo::SceneInfo info;
+  ASSERT_EQ(Demo::load_scene(path, sim, info), Status::Success);
+  ASSERT_EQ(info.count, 2u);
+  ASSERT_TRUE(info.has_box);
+  ASSERT_EQ(info.box[0], 800);
+  ASSERT_EQ(info.box[1], 600);
+  ASSERT_EQ(info.colors, (std::vector<uint32_t>{0xFF0080, 0x010203}));
+
+  // nothing is visible to readers until it's committed
+  ASSERT_EQ(sim.get_particles().size(), 0u);
+  sim.commit_particles();
+
+  const auto& particles = sim.get_particles();
+  ASSERT_EQ(particles.size(), 2u);
+  ASSERT_EQ(particles[0].position(), V(-100, 50, 0));
+  ASSERT_EQ(particles[0].velocity(), V(1.5, -2, 0));
+  ASSERT_EQ(particles[0].radius(), 10);
+  ASSERT_EQ(particles[0].mass(), 3);
+  ASSERT_EQ(particles[1].uid.get(), 2u);
+  ASSERT_EQ(particles[1].position(), V(200, -75, 0));
+
+  std::remove(path.c_str());
+}
+
+TEST(SceneTest, BinaryRoundTrip) {
+  const auto path = temp_path("scene.bin");
+  const size_t n = 50000;
+
+  std::vector<Particle<V>> particles;
+  std::vector<uint32_t> colors;
+  for (size_t i = 0; i < n; i++) {
+    const double x = static_cast<double>(i % 1000);
+    const double y = static_cast<double>(i / 1000);
+    particles.push_back(Particle<V>(2, 1 + static_cast<double>(i % 7), V(-x / 4, y / 4, 0), V(x, y, 0)));
+    colors.push_back(static_cast<uint32_t>(i) & 0xFFFFFF);
+  }
+  ASSERT_TRUE(Demo::write_scene(path, particles, {{4000, 200, 10}}, colors));
+
+  Simulation::SimulationContext<V> sim;
+  Demo::SceneInfo info;
+  ASSERT_EQ(Demo::load_scene(path, sim, info), Status::Success);
+  ASSERT_EQ(info.count, n);
+  ASSERT_TRUE(info.has_box);
+  ASSERT_EQ(info.box[0], 4000);
+  ASSERT_EQ(info.colors, colors);
+
+  sim.commit_particles();
+  const auto& loaded = sim.get_particles();
+  ASSERT_EQ(loaded.size(), n);
+  for (size_t i = 0; i < n; i++) {
+    ASSERT_EQ(loaded[i].position(), particles[i].position());
+    ASSERT_EQ(loaded[i].velocity(), particles[i].velocity());
+    ASSERT_EQ(loaded[i].mass(), particles[i].mass());
+  }
+
+  std::remove(path.c_str());
+}
+
+TEST(SceneTest, Malformed) {
+  const auto path = temp_path("bad_scene.csv");
+  {
+    std::ofstream f(path);
+    f << "1,2,3,4,5,6" << std::endl;
+    f << "1,2,3" << std::endl;
+  }
+
+  Simulation::SimulationContext<V> sim;
+  Demo::SceneInfo info;
+  ASSERT_EQ(Demo::load_scene(path, sim, info), Status::Failure);
+  ASSERT_EQ(Demo::load_scene(temp_path("no_such_scene"), sim, info), Status::Failure);
+
+  std::remove(path.c_str());
+}
+
+TEST(SceneTest, MalformedBinary) {
+  const auto path = temp_path("bad_scene.bin");
+  std::vector<Particle<V>> particles(100, Particle<V>(2, 1, V(0, 0, 0), V(0, 0, 0)));
+  ASSERT_TRUE(Demo::write_scene(path, particles, {{100, 100, 100}}, std::vector<uint32_t>(100, 0)));
+  std::vector<char> bytes;
+  {
+    std::ifstream f(path, std::ios::binary);
+    bytes.assign(std::istreambuf_iterator<char>(f), std::istreambuf_iterator<char>());
+  }
+  auto rewrite = [&](const std::vector<char>& contents) {
+    std::ofstream f(path, std::ios::binary | std::ios::trunc);
+    f.write(contents.data(), static_cast<std::streamsize>(contents.size()));
+  };
+
+  // the last few records missing
+  rewrite(std::vector<char>(bytes.begin(), bytes.end() - 3 * sizeof(Demo::SceneRecord) - 5));
+  {
+    Simulation::SimulationContext<V> sim;
+    Demo::SceneInfo info;
+    ASSERT_EQ(Demo::load_scene(path, sim, info), Status::Failure);
+  }
+
+  // a count nobody could allocate, has to fail rather than throw or try
+  for (uint64_t count : {uint64_t(101), uint64_t(1) << 40, ~uint64_t(0)}) {
+    auto header = bytes;
+    std::memcpy(header.data() + offsetof(Demo::SceneHeader, count), &count, sizeof(count));
+    rewrite(header);
+    Simulation::SimulationContext<V> sim;
+    Demo::SceneInfo info;
+    ASSERT_EQ(Demo::load_scene(path, sim, info), Status::Failure) << count;
+    ASSERT_EQ(info.count, 0u);
+    ASSERT_EQ(info.colors.capacity(), 0u);
+  }
+
+  // and just the header
+  rewrite(std::vector<char>(bytes.begin(), bytes.begin() + sizeof(Demo::SceneHeader) - 1));
+  {
+    Simulation::SimulationContext<V> sim;
+    Demo::SceneInfo info;
+    ASSERT_EQ(Demo::load_scene(path, sim, info), Status::Failure);
+  }
+
+  std::remove(path.c_str());
+}
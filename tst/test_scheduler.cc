@@ -0,0 +1,99 @@
+#include "util/scheduler.h"
+
+#include <algorithm>
+#include <chrono>
+#include <gtest/gtest.h>
+
+// Fixed rate ticking. Time is ours to move here, so the counts are exact, the real clock only gets a sanity check.
+
+using Util::TickScheduler;
+using std::chrono::microseconds;
+using std::chrono::milliseconds;
+
+// time only passes when the scheduler waits for it, or when a test does some "work"
+class FakeTime :
+  public TickScheduler::TimeSource {
+public:
+  TickScheduler::clock::time_point now() override { return m_now; }
+  void sleep_until(TickScheduler::clock::time_point t) override { m_now = std::max(m_now, t); }
+  void yield() override { m_now += microseconds(1); }
+
+  void work(TickScheduler::clock::duration d) { m_now += d; }
+
+  TickScheduler::clock::duration elapsed() const { return m_now - TickScheduler::clock::time_point(); }
+
+private:
+  TickScheduler::clock::time_point m_now;
+};
+
+TEST(SchedulerTest, KeepsTime) {
+  FakeTime time;
+  TickScheduler scheduler(milliseconds(2), TickScheduler::DEFAULT_CATCH_UP, TickScheduler::DEFAULT_SPIN, time);
+
+  for (size_t i = 0; i < 50; i++) {
+    ASSERT_EQ(scheduler.wait(), 1u);
+  }
+
+  // the first tick is due straight away, every one after that exactly a period later
+  ASSERT_EQ(time.elapsed(), milliseconds(2 * 49));
+  ASSERT_EQ(scheduler.ticks(), 50u);
+  ASSERT_EQ(scheduler.missed(), 0u);
+  // with nothing to do between ticks, we were asleep the whole time
+  ASSERT_DOUBLE_EQ(scheduler.idle(), 1.0);
+}
+
+TEST(SchedulerTest, IdleIsTheTimeSpentWaiting) {
+  FakeTime time;
+  TickScheduler scheduler(milliseconds(2), TickScheduler::DEFAULT_CATCH_UP, TickScheduler::DEFAULT_SPIN, time);
+
+  // half of every period spent working
+  scheduler.wait();
+  for (size_t i = 0; i < 49; i++) {
+    time.work(milliseconds(1));
+    ASSERT_EQ(scheduler.wait(), 1u);
+  }
+  ASSERT_EQ(time.elapsed(), milliseconds(2 * 49));
+  ASSERT_DOUBLE_EQ(scheduler.idle(), 0.5);
+}
+
+TEST(SchedulerTest, CatchesUpWithinBudget) {
+  FakeTime time;
+  TickScheduler scheduler(milliseconds(1), 4, TickScheduler::DEFAULT_SPIN, time);
+  ASSERT_EQ(scheduler.wait(), 1u);
+
+  // a long step, 20 ticks' worth, the one due next and 19 after it
+  time.work(milliseconds(20));
+  ASSERT_EQ(scheduler.wait(), 4u);
+  ASSERT_EQ(scheduler.missed(), 19u);
+  ASSERT_EQ(scheduler.dropped(), 16u);
+  ASSERT_EQ(scheduler.ticks(), 5u);
+
+  // having given up on the rest, we're back on time
+  ASSERT_EQ(scheduler.wait(), 1u);
+  ASSERT_EQ(scheduler.missed(), 19u);
+  ASSERT_EQ(time.elapsed(), milliseconds(21));
+}
+
+TEST(SchedulerTest, RestartForgetsTheBacklog) {
+  FakeTime time;
+  TickScheduler scheduler(milliseconds(1), TickScheduler::DEFAULT_CATCH_UP, TickScheduler::DEFAULT_SPIN, time);
+  scheduler.wait();
+  time.work(milliseconds(10));
+
+  scheduler.restart();
+  ASSERT_EQ(scheduler.wait(), 1u);
+  ASSERT_EQ(scheduler.missed(), 0u);
+  ASSERT_EQ(time.elapsed(), milliseconds(10));
+}
+
+TEST(SchedulerTest, NeverEarlyOnTheRealClock) {
+  TickScheduler scheduler(milliseconds(2));
+  const auto start = TickScheduler::clock::now();
+  while (scheduler.ticks() < 50) {
+    scheduler.wait();
+  }
+
+  // on a busy machine we can be late and catch up, but the 50th tick isn't handed out before it's due
+  ASSERT_GE(TickScheduler::clock::now() - start, milliseconds(2 * 49));
+  ASSERT_GE(scheduler.ticks(), 50u);
+}
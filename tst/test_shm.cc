@@ -0,0 +1,191 @@
+#include "context.h"
+#include "sim_setup.h"
+#include "util/random.h"
+#include "util/shared_frames.h"
+#include "util/shm_frame.h"
+
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <gtest/gtest.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Frames out to shared memory, and someone reading them while they're being written
+
+using Component::Particle;
+
+typedef Component::Vector<double> V;
+
+static constexpr uint64_t SHM_SEED = 0x5137;
+
+static std::string shm_name(const char* what) {
+  return "/sim_test_" + std::string(what) + "_" + std::to_string(::getpid());
+}
+
+// frame g has this many particles, up and down and growing the region now and then
+static uint64_t pattern_count(uint64_t g) { return 16 + (g * 7) % 3000; }
+
+TEST(ShmTest, NoTornFrames) {
+  const std::string name = shm_name("torn");
+  Util::SharedFrames frames;
+  ASSERT_EQ(frames.open(name, 16), Status::Success);
+
+  static constexpr uint64_t FRAMES = 4000;
+  uint64_t validated = 0, thrown_away = 0, bad = 0, last_step = 0;
+  bool backwards = false;
+
+  std::thread reader([&]() {
+    sim_shm_reader r;
+    if (sim_shm_open(&r, name.c_str()) != 0) {
+      bad++;
+      return;
+    }
+    while (last_step < FRAMES) {
+      sim_shm_view view;
+      std::this_thread::yield();
+      if (sim_shm_begin(&r, &view) != 0) {
+        continue;
+      }
+      // every particle of frame g says g, and where it is in the frame
+      bool ok = view.count == pattern_count(view.step);
+      for (uint64_t i = 0; ok and i < view.count; i++) {
+        const auto& p = view.particles[i];
+        ok = p.uid == view.step and p.x == static_cast<double>(i) and p.y == -static_cast<double>(view.step) and
+             p.mass == static_cast<double>(view.step);
+        // let the writer lap us now and then, even on one core
+        if (i == view.count / 2 and view.step % 2 == 0) {
+          std::this_thread::yield();
+        }
+      }
+      if (!sim_shm_end(&r, &view)) {
+        thrown_away++;
+        continue;
+      }
+      bad += !ok;
+      backwards |= view.step < last_step;
+      last_step = view.step;
+      validated++;
+    }
+    sim_shm_close(&r);
+  });
+
+  for (uint64_t g = 1; g <= FRAMES; g++) {
+    const uint64_t count = pattern_count(g);
+    auto* out = frames.begin(count);
+    ASSERT_NE(out, nullptr);
+    for (uint64_t i = 0; i < count; i++) {
+      out[i] = {g, static_cast<double>(i), -static_cast<double>(g), 0, 0, 1, static_cast<double>(g)};
+      // and be caught half way through a frame
+      if (i == count / 2 and g % 3 == 0) {
+        std::this_thread::yield();
+      }
+    }
+    frames.commit(g, 0, 1600, 1000);
+    // and sometimes leave them be long enough to get a whole one
+    if (g % 8 == 0) {
+      std::this_thread::sleep_for(std::chrono::microseconds(100));
+    }
+  }
+  reader.join();
+
+  ASSERT_EQ(bad, 0u);
+  ASSERT_FALSE(backwards);
+  ASSERT_EQ(last_step, FRAMES);
+  ASSERT_GT(validated, 100u);
+  ASSERT_GT(thrown_away, 0u);
+  ASSERT_EQ(frames.generation(), FRAMES);
+  ASSERT_GE(frames.capacity(), pattern_count(428));
+
+  // gone once it's closed
+  frames.close();
+  sim_shm_reader r;
+  ASSERT_NE(sim_shm_open(&r, name.c_str()), 0);
+}
+
+TEST(ShmTest, FollowsTheSimulation) {
+  auto settings = Simulation::DefaultSettings<double>;
+  settings.shm = shm_name("sim");
+  auto context = make_context<V>(settings, 1600, 1000, 1000);
+  auto& sim = *context;
+  for (size_t i = 0; i < 500; i++) {
+    Util::CounterRng gen(SHM_SEED, i);
+    sim.add_particle(Particle<V>(3, 1, V(gen.uniform(-300, 300), gen.uniform(-300, 300), 0),
+                                 V(gen.uniform(-780, 780), gen.uniform(-480, 480), 0)));
+  }
+  sim.commit_particles();
+
+  sim_shm_reader r;
+  ASSERT_EQ(sim_shm_open(&r, settings.shm.c_str()), 0);
+
+  std::atomic<bool> done{false};
+  uint64_t validated = 0, bad = 0, last_step = 0;
+  bool backwards = false;
+  std::thread reader([&]() {
+    std::vector<uint64_t> uids;
+    while (!done.load()) {
+      sim_shm_view view;
+      std::this_thread::yield();
+      if (sim_shm_begin(&r, &view) != 0) {
+        continue;
+      }
+      // everyone's there once, inside the box, and it's everyone or everyone and the newcomers
+      uids.clear();
+      bool ok = view.count == 500 or view.count == 1500;
+      for (uint64_t i = 0; ok and i < view.count; i++) {
+        const auto& p = view.particles[i];
+        ok = p.uid != 0 and std::abs(p.x) <= view.width / 2 and std::abs(p.y) <= view.height / 2 and p.radius == 3;
+        uids.push_back(p.uid);
+      }
+      std::sort(uids.begin(), uids.end());
+      ok = ok and std::adjacent_find(uids.begin(), uids.end()) == uids.end();
+      if (!sim_shm_end(&r, &view)) {
+        continue;
+      }
+      bad += !ok;
+      backwards |= view.step < last_step;
+      last_step = view.step;
+      validated++;
+    }
+  });
+
+  for (size_t step = 0; step < 200; step++) {
+    if (step == 100) {
+      // more than there's room for
+      std::vector<Particle<V>> more;
+      for (size_t i = 0; i < 1000; i++) {
+        Util::CounterRng gen(SHM_SEED, i, 1);
+        more.push_back(Particle<V>(3, 1, V(gen.uniform(-300, 300), gen.uniform(-300, 300), 0),
+                                   V(gen.uniform(-780, 780), gen.uniform(-480, 480), 0)));
+      }
+      sim.queue_add(std::move(more));
+    }
+    sim.run();
+  }
+  done = true;
+  reader.join();
+
+  ASSERT_EQ(bad, 0u);
+  ASSERT_FALSE(backwards);
+  ASSERT_GT(validated, 0u);
+
+  // and the last is exactly the simulation's
+  sim_shm_view view;
+  ASSERT_EQ(sim_shm_begin(&r, &view), 0);
+  const auto frame = sim.get_frame();
+  ASSERT_EQ(view.count, frame->size());
+  ASSERT_EQ(view.width, 1600);
+  ASSERT_EQ(view.step, 199u);
+  for (size_t i = 0; i < frame->size(); i++) {
+    const auto& p = (*frame)[i];
+    ASSERT_EQ(view.particles[i].uid, p.uid.get());
+    ASSERT_EQ(view.particles[i].x, p.position().x());
+    ASSERT_EQ(view.particles[i].vy, p.velocity().y());
+  }
+  ASSERT_TRUE(sim_shm_end(&r, &view));
+  sim_shm_close(&r);
+}
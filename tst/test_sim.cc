@@ -1,15 +1,37 @@
 #include "context.h"
+#include "sim_setup.h"
+#include "util/random.h"
 
 #include <algorithm>
 #include <array>
+#include <atomic>
 #include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
 #include <gtest/gtest.h>
 #include <iostream>
+#include <memory>
+#include <new>
 #include <numeric>
 #include <thread>
 
-class SimulationTest :
-  public ::testing::Test {};
+// Every allocation in the process is counted while this is on, see SteadyStateDoesNotAllocate
+static std::atomic<bool> g_count_allocations{false};
+static std::atomic<size_t> g_allocations{0};
+
+void* operator new(size_t size) {
+  if (g_count_allocations.load(std::memory_order_relaxed)) {
+    g_allocations++;
+  }
+  if (void* p = std::malloc(size ? size : 1)) {
+    return p;
+  }
+  throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete(void* p, size_t) noexcept { std::free(p); }
 
 // A baseline performance test to alert us to regressions.
 // this seems to be worst case about 12 seconds with gcc, and 8 seconds with clang
@@ -37,17 +59,20 @@ struct TestSettings {
   static constexpr size_t N_STEPS = 10000UL;
 }TestSettings;
 
+class SimulationTest :
+  public ::testing::Test {
+protected:
+  // a simulation in the TestSettings box, free running, with physics to match its settings
+  template<typename V>
+  static std::unique_ptr<Simulation::SimulationContext<V>> make_context(
+      const Simulation::SimSettings<typename V::vector_t>& settings = Simulation::DefaultSettings<typename V::vector_t>) {
+    return ::make_context<V>(settings, TestSettings.x_width, TestSettings.y_width, TestSettings.z_width);
+  }
+};
+
 template<typename T>
 void sim_runner(Simulation::SimulationContext<T>& sim, std::array<int64_t, TestSettings::N_STEPS>& cycle_times_us) {
-
-  // simulation blocks forever if this isn't running...
-
   Simulation::PhysicsContext<T> phys;
-  std::thread th = std::thread(Util::ring_thread<std::vector<Component::Particle<T>>,
-                                                 Component::Particle<T>,
-                                                 Simulation::SimSettings<typename T::vector_t>::RingBufferSize>,
-                                                 std::ref(sim.m_particle_buffer));
-  th.detach();
 
   sim.set_physics_context(phys);
   sim.set_free_run(true);
@@ -136,3 +161,640 @@ TEST_F(SimulationTest, Performance) {
 
   ASSERT_LT(elapsed, TIME_LIMIT_US);
 }
+
+// run a step, which lands in get_particles() right away
+template<typename T>
+void step_and_publish(Simulation::SimulationContext<T>& sim) {
+  sim.run();
+}
+
+TEST_F(SimulationTest, AddRemoveAtRuntime) {
+  typedef Component::Vector<double> sim_t;
+
+  auto context = make_context<sim_t>();
+  auto& sim = *context;
+
+  // far enough apart and still, so nothing collides and the order is ours
+  for (size_t i = 0; i < 4; i++) {
+    sim.add_particle(Particle<sim_t>(1, 1, sim_t(0, 0, 0), sim_t(100 * static_cast<double>(i) - 150, 0, 0)));
+  }
+  sim.commit_particles();
+
+  step_and_publish(sim);
+
+  auto uids = [&sim]() {
+    std::vector<size_t> out;
+    for (const auto& p : sim.get_particles()) {
+      out.push_back(p.uid.get());
+    }
+    return out;
+  };
+  ASSERT_EQ(uids(), (std::vector<size_t>{1, 2, 3, 4}));
+
+  // the last particle fills the gap
+  sim.queue_remove({2});
+  step_and_publish(sim);
+  ASSERT_EQ(uids(), (std::vector<size_t>{1, 4, 3}));
+  ASSERT_EQ(sim.get_particle_count(), 3u);
+  ASSERT_EQ(sim.find_particle(4)->position(), sim_t(150, 0, 0));
+  ASSERT_EQ(sim.find_particle(2), nullptr);
+
+  // the new particle takes the free slot, but not the old uid
+  sim.queue_add({Particle<sim_t>(1, 1, sim_t(0, 0, 0), sim_t(0, 200, 0))});
+  step_and_publish(sim);
+  const size_t reused = Simulation::make_uid(1, 1);
+  ASSERT_EQ(uids(), (std::vector<size_t>{1, 4, 3, reused}));
+  ASSERT_EQ(Simulation::uid_slot(reused), 1u);
+  ASSERT_EQ(sim.find_particle(reused)->position(), sim_t(0, 200, 0));
+
+  // stale and unknown uids are left alone, removing the last particle is fine too
+  sim.queue_remove({2, 99, 0, reused});
+  step_and_publish(sim);
+  ASSERT_EQ(uids(), (std::vector<size_t>{1, 4, 3}));
+
+  // everyone out, then back in
+  sim.queue_remove(uids());
+  step_and_publish(sim);
+  ASSERT_EQ(sim.get_particles().size(), 0u);
+  sim.queue_add(std::vector<Particle<sim_t>>(5, Particle<sim_t>(1, 1, sim_t(0, 0, 0), sim_t(0, 0, 0))));
+  step_and_publish(sim);
+  ASSERT_EQ(sim.get_particle_count(), 5u);
+  for (const auto& p : sim.get_particles()) {
+    ASSERT_EQ(sim.find_particle(p.uid.get()), &p);
+  }
+}
+
+TEST_F(SimulationTest, RestingParticlesSleep) {
+  typedef Component::Vector<double> sim_t;
+
+  auto settings = Simulation::DefaultSettings<double>;
+  settings.gravity = 100;
+  settings.sleep_steps = 20;
+  settings.sleep_energy = 1;
+
+  auto context = make_context<sim_t>(settings);
+  auto& sim = *context;
+
+  // a row of 4 touching on the floor, and 1 on its own
+  const double floor = -static_cast<double>(TestSettings.y_width) / 2 + 10;
+  for (size_t i = 0; i < 4; i++) {
+    sim.add_particle(Particle<sim_t>(10, 1, sim_t(0, 0, 0), sim_t(-100 + 20 * static_cast<double>(i), floor, 0)));
+  }
+  sim.add_particle(Particle<sim_t>(10, 1, sim_t(0, 0, 0), sim_t(400, floor, 0)));
+  sim.commit_particles();
+
+  for (size_t i = 0; i < 50; i++) {
+    step_and_publish(sim);
+  }
+  const auto settled = sim.get_particles();
+  for (const auto& p : settled) {
+    ASSERT_TRUE(p.asleep()) << p;
+  }
+  ASSERT_EQ(settled[0].island(), settled[3].island());
+  ASSERT_NE(settled[0].island(), settled[4].island());
+
+  // nobody moves while they're asleep
+  for (size_t i = 0; i < 50; i++) {
+    step_and_publish(sim);
+  }
+  ASSERT_EQ(sim.get_particles(), settled);
+
+  // knock the row, the whole row wakes up but the loner sleeps on
+  sim.queue_add({Particle<sim_t>(10, 1, sim_t(500, 0, 0), sim_t(-200, floor, 0))});
+  for (size_t i = 0; i < 25; i++) {
+    step_and_publish(sim);
+  }
+  const auto& knocked = sim.get_particles();
+  for (size_t i = 0; i < 4; i++) {
+    ASSERT_FALSE(knocked[i].asleep()) << knocked[i];
+  }
+  ASSERT_TRUE(knocked[4].asleep());
+  ASSERT_EQ(knocked[4].position(), settled[4].position());
+}
+
+TEST_F(SimulationTest, GentleKnockBouncesOff) {
+  typedef Component::Vector<double> sim_t;
+
+  auto settings = Simulation::DefaultSettings<double>;
+  settings.gravity = 0;
+  settings.sleep_steps = 20;
+  settings.sleep_energy = 1;
+
+  auto context = make_context<sim_t>(settings);
+  auto& sim = *context;
+
+  sim.add_particle(Particle<sim_t>(10, 4, sim_t(0, 0, 0), sim_t(0, 0, 0)));
+  sim.commit_particles();
+  for (size_t i = 0; i < 30; i++) {
+    step_and_publish(sim);
+  }
+  const auto sleeper = sim.get_particles()[0];
+  ASSERT_TRUE(sleeper.asleep());
+
+  // Awake at 1.5 (1.125 of kinetic energy), but if they collided the sleeper would only come away with 0.72.
+  // Not enough to wake it, so it's a wall and the mover comes straight back at the speed it went in.
+  sim.queue_add({Particle<sim_t>(10, 1, sim_t(1.5, 0, 0), sim_t(-20.1, 0, 0))});
+  for (size_t i = 0; i < 20; i++) {
+    step_and_publish(sim);
+  }
+  const auto& after = sim.get_particles();
+  ASSERT_TRUE(after[0].asleep());
+  ASSERT_EQ(after[0], sleeper);
+  ASSERT_FALSE(after[1].asleep());
+  ASSERT_LT(after[1].position().x(), -20.1);
+  ASSERT_DOUBLE_EQ(after[1].velocity().x(), -1.5);
+  ASSERT_DOUBLE_EQ(after[1].velocity().y(), 0);
+  // and nothing went missing
+  ASSERT_DOUBLE_EQ(Simulation::PhysicsContext<sim_t>::ledger_energy(after[0]) +
+                   Simulation::PhysicsContext<sim_t>::ledger_energy(after[1]), 1.125);
+}
+
+TEST_F(SimulationTest, NoTunnellingThroughWalls) {
+  typedef Component::Vector<double> sim_t;
+
+  auto context = make_context<sim_t>();
+  auto& sim = *context;
+
+  // from a gentle drift, to a few box widths every step
+  // each in its own z plane, collisions would catch them crossing paths and it's only the walls we're after
+  const std::vector<double> speeds = {10, 5e3, 1e5, 3.7e5};
+  for (size_t i = 0; i < speeds.size(); i++) {
+    const double y = -300 + 200 * static_cast<double>(i);
+    sim.add_particle(Particle<sim_t>(10, 1, sim_t(speeds[i], speeds[i] / 3, 0), sim_t(0, y, y)));
+  }
+  sim.commit_particles();
+
+  const double x_inside = static_cast<double>(TestSettings.x_width) / 2 - 10;
+  const double y_inside = static_cast<double>(TestSettings.y_width) / 2 - 10;
+  for (size_t step = 0; step < 200; step++) {
+    step_and_publish(sim);
+    for (size_t i = 0; i < speeds.size(); i++) {
+      const auto& p = sim.get_particles()[i];
+      ASSERT_LE(std::abs(p.position().x()), x_inside) << "step " << step << std::endl << p;
+      ASSERT_LE(std::abs(p.position().y()), y_inside) << "step " << step << std::endl << p;
+      // bouncing only ever flips a component
+      ASSERT_DOUBLE_EQ(std::abs(p.velocity().x()), speeds[i]);
+      // and nobody bothers with walls until they get there
+      ASSERT_TRUE(p.wall_time_valid());
+      ASSERT_GT(p.wall_time(), sim.get_step_time());
+    }
+  }
+  ASSERT_GT(sim.get_bounce_count(), 200u);
+}
+
+TEST_F(SimulationTest, FastParticlesCollide) {
+  typedef Component::Vector<double> sim_t;
+
+  auto context = make_context<sim_t>();
+  auto& sim = *context;
+
+  // 30 apart and each covering 60 a step, they'd be clean through each other by the end of it
+  sim.add_particle(Particle<sim_t>(10, 1, sim_t(6000, 0, 0), sim_t(-25, 0, 0)));
+  sim.add_particle(Particle<sim_t>(10, 1, sim_t(-6000, 0, 0), sim_t(25, 0, 0)));
+  // a heavy one into a light one, glancing, so nothing is symmetric
+  sim.add_particle(Particle<sim_t>(10, 9, sim_t(3000, 0, 0), sim_t(-40, 300, 0)));
+  sim.add_particle(Particle<sim_t>(5, 1, sim_t(0, 0, 0), sim_t(0, 305, 0)));
+  sim.commit_particles();
+
+  auto total = [](std::vector<Particle<sim_t>> particles, size_t first) {
+    std::array<double, 3> out = {{0, 0, 0}};
+    for (size_t i = first; i < first + 2; i++) {
+      out[0] += particles[i].kinetic_energy();
+      out[1] += particles[i].mass() * particles[i].velocity().x();
+      out[2] += particles[i].mass() * particles[i].velocity().y();
+    }
+    return out;
+  };
+  const auto before = total(sim.get_particles(), 2);
+
+  step_and_publish(sim);
+
+  // they met a quarter of the way in and spent the rest of the step going back the way they came
+  const auto& particles = sim.get_particles();
+  ASSERT_EQ(sim.get_collision_count(), 2u);
+  ASSERT_NEAR(particles[0].position().x(), -55, 1e-9);
+  ASSERT_NEAR(particles[1].position().x(), 55, 1e-9);
+  ASSERT_NEAR(particles[0].velocity().x(), -6000, 1e-9);
+  ASSERT_NEAR(particles[1].velocity().x(), 6000, 1e-9);
+
+  const auto after = total(particles, 2);
+  ASSERT_NEAR(after[0], before[0], before[0] * 1e-12);
+  ASSERT_NEAR(after[1], before[1], before[1] * 1e-12);
+  ASSERT_NEAR(after[2], before[2], 1e-9);
+  // glancing off the bottom of it
+  ASSERT_GT(particles[3].velocity().y(), 0);
+}
+
+TEST_F(SimulationTest, FastParticlesSubstep) {
+  typedef Component::Vector<double> sim_t;
+
+  auto context = make_context<sim_t>();
+  auto& sim = *context;
+  Simulation::PhysicsContext<sim_t> phys;
+
+  // levels go by how far a particle gets in a step, against radius_min (10)
+  ASSERT_EQ(phys.substep_level(Particle<sim_t>(10, 1, sim_t(1000, 0, 0), sim_t(0, 0, 0))), 0u);
+  ASSERT_EQ(phys.substep_level(Particle<sim_t>(10, 1, sim_t(1001, 0, 0), sim_t(0, 0, 0))), 1u);
+  ASSERT_EQ(phys.substep_level(Particle<sim_t>(10, 1, sim_t(3000, -3000, 0), sim_t(0, 0, 0))), 3u);
+  ASSERT_EQ(phys.substep_level(Particle<sim_t>(10, 1, sim_t(1e9, 0, 0), sim_t(0, 0, 0))), 6u);
+
+  // a light particle rattling between two heavy ones, a few times a step
+  sim.add_particle(Particle<sim_t>(10, 1000, sim_t(0, 0, 0), sim_t(-25, 0, 0)));
+  sim.add_particle(Particle<sim_t>(10, 1000, sim_t(0, 0, 0), sim_t(25, 0, 0)));
+  sim.add_particle(Particle<sim_t>(5, 1, sim_t(5000, 0, 0), sim_t(0, 0, 0)));
+  sim.commit_particles();
+
+  auto energy = [](std::vector<Particle<sim_t>> particles) {
+    double total = 0;
+    for (auto& p : particles) {
+      total += p.kinetic_energy();
+    }
+    return total;
+  };
+  const double before = energy(sim.get_particles());
+
+  for (size_t step = 0; step < 20; step++) {
+    step_and_publish(sim);
+    const auto& particles = sim.get_particles();
+    // it never gets past either of them
+    ASSERT_GT(particles[2].position().x(), particles[0].position().x()) << "step " << step;
+    ASSERT_LT(particles[2].position().x(), particles[1].position().x()) << "step " << step;
+  }
+  // pushing them apart as it goes
+  ASSERT_GT(sim.get_collision_count(), 20u);
+  ASSERT_LT(sim.get_particles()[0].velocity().x(), 0);
+  ASSERT_GT(sim.get_particles()[1].velocity().x(), 0);
+  ASSERT_NEAR(energy(sim.get_particles()), before, before * 1e-9);
+}
+
+TEST_F(SimulationTest, KnockedParticlesStillCollide) {
+  typedef Component::Vector<double> sim_t;
+
+  Simulation::PhysicsContext<sim_t> phys;
+  // not stepped, but debug builds report collisions with the step they happened on
+  auto context = make_context<sim_t>();
+  phys.set_sim(context.get());
+
+  // Both level 0 at the start of the step, but one was hit by something sub-stepped and left at 7000, seven
+  // times the level 0 limit. Going that fast it met the other a little over 9ms ago, and went straight through.
+  std::vector<Particle<sim_t>> particles = {
+    Particle<sim_t>(10, 1, sim_t(7000, 0, 0), sim_t(25, 0, 0)),
+    Particle<sim_t>(10, 1, sim_t(0, 0, 0), sim_t(-20, 0, 0)),
+  };
+  phys.prepare_collisions(particles, {0, 0});
+  auto knocked = particles;
+  ASSERT_EQ(phys.collide(knocked[0], knocked[1]), Status::Success);
+  ASSERT_NEAR(knocked[1].velocity().x(), 7000, 1e-9);
+
+  // had it been sub-stepped itself it would have had its collisions then, and doesn't count here
+  phys.prepare_collisions(particles, {1, 0});
+  auto substepped = particles;
+  ASSERT_EQ(phys.collide(substepped[0], substepped[1]), Status::None);
+}
+
+TEST_F(SimulationTest, HistoryGoesBack) {
+  typedef Component::Vector<double> sim_t;
+
+  auto settings = Simulation::DefaultSettings<double>;
+  settings.history_depth = 5;
+
+  auto context = make_context<sim_t>(settings);
+  auto& sim = *context;
+  for (size_t i = 0; i < 10; i++) {
+    const double x = 60 * static_cast<double>(i) - 300;
+    sim.add_particle(Particle<sim_t>(10, 1, sim_t(x, 100 - x, 0), sim_t(x, 0, 0)));
+  }
+  sim.commit_particles();
+
+  std::vector<std::vector<Particle<sim_t>>> seen = {sim.get_particles()};
+  for (size_t step = 0; step < 8; step++) {
+    step_and_publish(sim);
+    seen.push_back(sim.get_particles());
+  }
+
+  std::vector<Particle<sim_t>> past;
+  for (size_t back = 0; back < settings.history_depth; back++) {
+    ASSERT_EQ(sim.get_history(back, past), Status::Success);
+    ASSERT_EQ(past, seen[seen.size() - 1 - back]) << back << " back";
+  }
+  ASSERT_EQ(sim.get_history(settings.history_depth, past), Status::Failure);
+}
+
+TEST_F(SimulationTest, NoHistoryWithoutDepth) {
+  typedef Component::Vector<double> sim_t;
+
+  auto settings = Simulation::DefaultSettings<double>;
+  settings.history_depth = 0;
+
+  auto context = make_context<sim_t>(settings);
+  auto& sim = *context;
+  sim.add_particle(Particle<sim_t>(10, 1, sim_t(100, 0, 0), sim_t(0, 0, 0)));
+  sim.commit_particles();
+  for (size_t step = 0; step < 5; step++) {
+    step_and_publish(sim);
+  }
+
+  // nothing to go back to, and nothing was ever started to encode it
+  std::vector<Particle<sim_t>> past;
+  ASSERT_EQ(sim.get_history(0, past), Status::Failure);
+  ASSERT_EQ(sim.rewind(1), Status::Failure);
+  ASSERT_FALSE(sim.m_particle_buffer.m_encoder.joinable());
+}
+
+TEST_F(SimulationTest, RewindAndReplay) {
+  typedef Component::Vector<double> sim_t;
+
+  auto settings = Simulation::DefaultSettings<double>;
+  settings.history_depth = 20;
+
+  auto context = make_context<sim_t>(settings);
+  auto& sim = *context;
+  // a row of particles all headed for their neighbours, so there's something to replay
+  for (size_t i = 0; i < 10; i++) {
+    const double x = 25 * static_cast<double>(i) - 125;
+    sim.add_particle(Particle<sim_t>(10, 1, sim_t((i % 2) ? -300.0 : 300.0, 0, 0), sim_t(x, 0, 0)));
+  }
+  sim.commit_particles();
+
+  const size_t gone = sim.get_particles()[3].uid.get();
+  std::vector<std::vector<Particle<sim_t>>> seen = {sim.get_particles()};
+  for (size_t step = 0; step < 12; step++) {
+    if (step == 9) {
+      sim.queue_remove({gone});
+    }
+    step_and_publish(sim);
+    seen.push_back(sim.get_particles());
+  }
+  ASSERT_GT(sim.get_collision_count(), 0u);
+  ASSERT_EQ(sim.get_particle_count(), 9u);
+
+  // back to before the removal
+  ASSERT_EQ(sim.rewind(5), Status::Success);
+  ASSERT_EQ(sim.get_step(), 7u);
+  ASSERT_EQ(sim.get_particles(), seen[7]);
+  ASSERT_EQ(sim.get_particle_count(), 10u);
+  std::vector<Particle<sim_t>> past;
+  ASSERT_EQ(sim.get_history(0, past), Status::Success);
+  ASSERT_EQ(past, seen[7]);
+  ASSERT_EQ(sim.get_history(7, past), Status::Success);
+  ASSERT_EQ(past, seen[0]);
+  ASSERT_EQ(sim.get_history(8, past), Status::Failure);
+
+  // the same again gets the same again, removal and all
+  for (size_t step = 7; step < 12; step++) {
+    if (step == 9) {
+      sim.queue_remove({gone});
+    }
+    step_and_publish(sim);
+    ASSERT_EQ(sim.get_particles(), seen[step + 1]) << "step " << step;
+  }
+  ASSERT_EQ(sim.get_particle_count(), 9u);
+  ASSERT_EQ(sim.rewind(13), Status::Failure);
+}
+
+TEST_F(SimulationTest, SteadyStateDoesNotAllocate) {
+  typedef Component::Vector<double> sim_t;
+
+  auto settings = Simulation::DefaultSettings<double>;
+  settings.gravity = 100;
+  settings.sleep_steps = 20;
+  settings.sleep_energy = 1;
+
+  auto context = make_context<sim_t>(settings);
+  auto& sim = *context;
+
+  // a crowd bouncing around, one much too fast to step in one go, and a row resting on the floor out of their way
+  for (size_t i = 0; i < 200; i++) {
+    const double x = 40 * static_cast<double>(i % 10) - 450;
+    const double y = 40 * static_cast<double>(i / 10) - 400;
+    sim.add_particle(Particle<sim_t>(10, 1, sim_t(30 * static_cast<double>(i % 7) - 90, 40 * static_cast<double>(i % 5) - 80, 0),
+                                     sim_t(x, y, 0)));
+  }
+  const double floor = -static_cast<double>(TestSettings.y_width) / 2 + 10;
+  for (size_t i = 0; i < 4; i++) {
+    sim.add_particle(Particle<sim_t>(10, 1, sim_t(0, 0, 0), sim_t(-100 + 20 * static_cast<double>(i), floor, 200)));
+  }
+  sim.add_particle(Particle<sim_t>(10, 1, sim_t(8000, 0, 0), sim_t(0, 470, 0)));
+  sim.commit_particles();
+
+  // long enough for every buffer to have grown to fit
+  for (size_t i = 0; i < 300; i++) {
+    step_and_publish(sim);
+  }
+
+  const size_t collisions = sim.get_collision_count();
+  g_count_allocations = true;
+  for (size_t i = 0; i < 300; i++) {
+    step_and_publish(sim);
+  }
+  g_count_allocations = false;
+
+  // and it was actually doing something the whole time
+  ASSERT_GT(sim.get_collision_count(), collisions);
+  ASSERT_EQ(sim.m_sleeping_count, 4u);
+  ASSERT_EQ(g_allocations, 0u);
+}
+
+TEST_F(SimulationTest, HeldFramesStayPut) {
+  typedef Component::Vector<double> sim_t;
+
+  auto context = make_context<sim_t>();
+  auto& sim = *context;
+  for (size_t i = 0; i < 10; i++) {
+    const double x = 60 * static_cast<double>(i) - 300;
+    sim.add_particle(Particle<sim_t>(10, 1, sim_t(x, 100 - x, 0), sim_t(x, 0, 0)));
+  }
+  sim.commit_particles();
+
+  // someone holding a frame sees it as it was, however long they hang on to it
+  const auto held = sim.get_frame();
+  const auto copy = *held;
+  for (size_t i = 0; i < 20; i++) {
+    step_and_publish(sim);
+    ASSERT_NE(sim.get_particles(), copy);
+  }
+  ASSERT_EQ(*held, copy);
+  ASSERT_EQ(sim.get_frame().get(), &sim.get_particles());
+
+  // nobody else is holding anything, so the rest go round the same few buffers
+  const size_t pool = sim.m_particle_buffer.pool_size();
+  for (size_t i = 0; i < 20; i++) {
+    step_and_publish(sim);
+  }
+  ASSERT_EQ(sim.m_particle_buffer.pool_size(), pool);
+  ASSERT_LE(pool, 4u);
+}
+
+TEST_F(SimulationTest, IdealGasObservables) {
+  typedef Component::Vector<double> sim_t;
+
+  auto settings = Simulation::DefaultSettings<double>;
+  settings.observables = ::testing::TempDir() + "observables.csv";
+  settings.observables_every = 20;
+
+  auto context = make_context<sim_t>(settings);
+  auto& sim = *context;
+
+  // a dilute gas, small particles on a lattice heading every which way
+  const size_t n = 200;
+  const double radius = 2;
+  for (size_t i = 0; i < n; i++) {
+    Util::CounterRng gen(0x0B5, i);
+    const double angle = gen.uniform(0, 2 * M_PI);
+    const double speed = gen.uniform(50, 300);
+    const sim_t position(60 * static_cast<double>(i % 14) - 390, 60 * static_cast<double>(i / 14) - 420, 0);
+    sim.add_particle(Particle<sim_t>(radius, gen.uniform(1, 10), sim_t(speed * std::cos(angle), speed * std::sin(angle), 0), position));
+  }
+  sim.commit_particles();
+
+  double pressure = 0;
+  double temperature = 0;
+  size_t samples = 0;
+  for (size_t step = 0; step < 2000; step++) {
+    step_and_publish(sim);
+    const auto& sample = sim.get_observables().latest();
+    // the first sample only covers a step, too few bounces to say much
+    if (step % settings.observables_every != 0 or step == 0) {
+      continue;
+    }
+    ASSERT_EQ(sample.step, step);
+    ASSERT_EQ(sample.particles, n);
+    ASSERT_EQ(std::accumulate(sample.speeds.begin(), sample.speeds.end(), uint64_t(0)), n);
+
+    double energy = 0;
+    for (const auto& p : sim.get_particles()) {
+      const auto& v = p.velocity();
+      energy += 0.5 * p.mass() * (v.x() * v.x() + v.y() * v.y() + v.z() * v.z());
+    }
+    ASSERT_NEAR(sample.kinetic_energy, energy, 1e-9 * energy);
+
+    pressure += sample.pressure;
+    temperature += sample.temperature;
+    samples++;
+  }
+  pressure /= static_cast<double>(samples);
+  temperature /= static_cast<double>(samples);
+
+  // P A = N k T, in the area the particles' centres can reach
+  const double reach = static_cast<double>(TestSettings.x_width) - 2 * radius;
+  const double ideal = static_cast<double>(n) * temperature / (reach * reach);
+  std::cout << "pressure " << pressure << ", ideal gas " << ideal << std::endl;
+  ASSERT_NEAR(pressure, ideal, 0.02 * ideal);
+
+  // a header, then every sample
+  std::ifstream f(settings.observables);
+  size_t lines = 0;
+  for (std::string line; std::getline(f, line);) {
+    lines++;
+  }
+  ASSERT_EQ(lines, 1 + 2000 / settings.observables_every);
+  std::remove(settings.observables.c_str());
+}
+
+TEST_F(SimulationTest, ObservablesAfterRewind) {
+  typedef Component::Vector<double> sim_t;
+
+  auto settings = Simulation::DefaultSettings<double>;
+  settings.observables = ::testing::TempDir() + "observables_rewind.csv";
+  settings.observables_every = 5;
+
+  auto context = make_context<sim_t>(settings);
+  auto& sim = *context;
+
+  // a row each, across the box and back more than once a sample, so every sample has bounces in it
+  for (size_t i = 0; i < 40; i++) {
+    const double y = 20 * static_cast<double>(i) - 400;
+    sim.add_particle(Particle<sim_t>(2, 1, sim_t(50000, 0, 0), sim_t(0, y, 0)));
+  }
+  sim.commit_particles();
+
+  for (size_t step = 0; step < 10; step++) {
+    step_and_publish(sim);
+  }
+  const double pressure = sim.get_observables().latest().pressure;
+  ASSERT_GT(pressure, 0);
+
+  // back to before the last sample, the first one from there covers from the frame we went back to
+  ASSERT_EQ(sim.rewind(7), Status::Success);
+  for (size_t step = 0; step < 3; step++) {
+    step_and_publish(sim);
+  }
+  const auto& sample = sim.get_observables().latest();
+  ASSERT_EQ(sample.step, 5u);
+  ASSERT_GT(sample.pressure, 0);
+  std::remove(settings.observables.c_str());
+}
+
+TEST_F(SimulationTest, EnergyLedgerKeepsUp) {
+  // float, so there's some drift to keep track of
+  typedef Component::Vector<float> sim_t;
+
+  auto settings = Simulation::DefaultSettings<float>;
+  settings.energy_audit = 50;
+  // far tighter than float can manage, so it has to go off
+  settings.energy_drift = 1e-12f;
+
+  auto context = make_context<sim_t>(settings);
+  auto& sim = *context;
+
+  for (size_t i = 0; i < 200; i++) {
+    Util::CounterRng gen(0xE4E, i);
+    const float angle = static_cast<float>(gen.uniform(0, 2 * M_PI));
+    const float speed = static_cast<float>(gen.uniform(50, 300));
+    const sim_t position(30 * static_cast<float>(i % 20) - 300, 30 * static_cast<float>(i / 20) - 150, 0);
+    sim.add_particle(Particle<sim_t>(5, static_cast<float>(gen.uniform(1, 10)),
+                                     sim_t(speed * std::cos(angle), speed * std::sin(angle), 0), position));
+  }
+  sim.commit_particles();
+
+  for (size_t step = 0; step < 1000; step++) {
+    step_and_publish(sim);
+    const auto& ledger = sim.get_energy_ledger();
+    if (step < settings.energy_audit) {
+      continue;
+    }
+
+    // the ledger's idea of the energy, without adding it all up, against actually adding it all up
+    double energy = 0;
+    for (const auto& p : sim.get_particles()) {
+      energy += Simulation::PhysicsContext<sim_t>::ledger_energy(p);
+    }
+    ASSERT_NEAR(ledger.expected(), energy, 1e-9 * energy) << "step " << step;
+    ASSERT_NEAR(ledger.unexplained(), 0, 1e-9 * energy);
+  }
+
+  const auto& ledger = sim.get_energy_ledger();
+  ASSERT_GT(ledger.events(), 0u);
+  ASSERT_NE(ledger.drift(), 0);
+  ASSERT_TRUE(ledger.alarmed());
+}
+
+TEST_F(SimulationTest, EnergyLedgerStartsOverOnRebase) {
+  Util::EnergyLedger ledger;
+  ledger.audit(1000, 0, true);
+  ledger.record(0.5);
+  ledger.merge();
+  ledger.audit(1000.5, 10, true);
+  ASSERT_FALSE(ledger.check(1e-3));
+
+  // drift piles up across audits, it's the total since the first that's held against the latest
+  ledger.record(0.75);
+  ledger.merge();
+  ledger.audit(1001.25, 20, true);
+  ASSERT_TRUE(ledger.check(1e-3));
+  ASSERT_DOUBLE_EQ(ledger.unexplained(), 0);
+
+  // rewound, nothing that drifted before counts any more
+  ledger.rebase();
+  ledger.audit(1000, 30, true);
+  ASSERT_FALSE(ledger.check(1e-3));
+  ASSERT_DOUBLE_EQ(ledger.drift(), 1.25);
+  ledger.record(2);
+  ledger.merge();
+  ledger.audit(1002, 40, true);
+  ASSERT_TRUE(ledger.check(1e-3));
+
+  // each thread's slot to itself
+  ASSERT_EQ(reinterpret_cast<uintptr_t>(ledger.m_slots.data()) % 64, 0u);
+  ASSERT_EQ(sizeof(ledger.m_slots[0]), 64u);
+}
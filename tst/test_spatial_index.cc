@@ -0,0 +1,250 @@
+#include "context.h"
+#include "sim_setup.h"
+#include "timer.h"
+#include "util/random.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdlib>
+#include <gtest/gtest.h>
+#include <memory>
+#include <thread>
+#include <vector>
+
+// Spatial queries against scanning everyone. QueriesPerSecond times radius, nearest and ray queries over
+// SIM_BENCH_SPATIAL_N particles (100000 by default).
+
+using Component::Particle;
+using Simulation::SpatialIndex;
+
+typedef Component::Vector<double> V;
+typedef std::vector<Particle<V>> Frame;
+
+static constexpr uint64_t SPATIAL_SEED = 0x5BA7;
+
+// n particles of radius [1, 5] in a 1000 wide box, a few of them in one big clump
+static std::shared_ptr<const Frame> scatter(size_t n) {
+  auto frame = std::make_shared<Frame>();
+  for (size_t i = 0; i < n; i++) {
+    Util::CounterRng gen(SPATIAL_SEED, i);
+    const double spread = (i % 4 == 0) ? 50 : 500;
+    frame->push_back(Particle<V>(gen.uniform(1, 5), 1, V(0, 0, 0), V(gen.uniform(-spread, spread), gen.uniform(-spread, spread), 0)));
+  }
+  return frame;
+}
+
+static double distance(const Particle<V>& p, double x, double y) {
+  return std::hypot(p.position().x() - x, p.position().y() - y);
+}
+
+// where a ray first touches p, or -1 if it doesn't
+static double ray_distance(const Particle<V>& p, double x, double y, double ux, double uy) {
+  const double fx = x - p.position().x();
+  const double fy = y - p.position().y();
+  const double b = fx * ux + fy * uy;
+  const double c = fx * fx + fy * fy - p.radius() * p.radius();
+  if (c <= 0) {
+    return 0;
+  }
+  const double discriminant = b * b - c;
+  return (discriminant < 0 or b > 0) ? -1 : -b - std::sqrt(discriminant);
+}
+
+TEST(SpatialIndexTest, Empty) {
+  SpatialIndex<V> index(std::make_shared<const Frame>());
+  std::vector<size_t> found;
+  index.within(0, 0, 100, found);
+  ASSERT_TRUE(found.empty());
+  std::vector<SpatialIndex<V>::Hit> nearest;
+  index.nearest(0, 0, 3, nearest);
+  ASSERT_TRUE(nearest.empty());
+  SpatialIndex<V>::Hit hit;
+  ASSERT_FALSE(index.ray_cast(0, 0, 1, 0, 1000, hit));
+}
+
+TEST(SpatialIndexTest, SameAsScanning) {
+  const auto frame = scatter(5000);
+  const auto& particles = *frame;
+  SpatialIndex<V> index(frame);
+
+  for (size_t q = 0; q < 200; q++) {
+    Util::CounterRng gen(SPATIAL_SEED, q, 1);
+    // some from well off the grid
+    const double x = gen.uniform(-700, 700);
+    const double y = gen.uniform(-700, 700);
+
+    const double radius = gen.uniform(0, 80);
+    std::vector<size_t> found;
+    index.within(x, y, radius, found);
+    std::sort(found.begin(), found.end());
+    std::vector<size_t> expected;
+    for (size_t i = 0; i < particles.size(); i++) {
+      if (distance(particles[i], x, y) <= radius) {
+        expected.push_back(i);
+      }
+    }
+    ASSERT_EQ(found, expected) << "within " << radius << " of " << x << ", " << y;
+
+    const size_t k = static_cast<size_t>(gen.uniform_int(1, 20));
+    std::vector<SpatialIndex<V>::Hit> nearest;
+    index.nearest(x, y, k, nearest);
+    std::vector<double> distances;
+    for (const auto& p : particles) {
+      distances.push_back(distance(p, x, y));
+    }
+    std::sort(distances.begin(), distances.end());
+    ASSERT_EQ(nearest.size(), k);
+    for (size_t i = 0; i < k; i++) {
+      ASSERT_DOUBLE_EQ(nearest[i].distance, distances[i]) << "neighbour " << i << " of " << x << ", " << y;
+      ASSERT_DOUBLE_EQ(distance(particles[nearest[i].index], x, y), nearest[i].distance);
+    }
+
+    const double angle = gen.uniform(0, 2 * M_PI);
+    const double max_distance = gen.uniform(0, 1500);
+    SpatialIndex<V>::Hit hit;
+    const bool hit_anyone = index.ray_cast(x, y, 3 * std::cos(angle), 3 * std::sin(angle), max_distance, hit);
+    double first = max_distance + 1;
+    for (const auto& p : particles) {
+      const double t = ray_distance(p, x, y, std::cos(angle), std::sin(angle));
+      if (t >= 0 and t <= max_distance) {
+        first = std::min(first, t);
+      }
+    }
+    ASSERT_EQ(hit_anyone, first <= max_distance) << "ray from " << x << ", " << y << " at " << angle;
+    if (hit_anyone) {
+      ASSERT_NEAR(hit.distance, first, 1e-9);
+      ASSERT_NEAR(ray_distance(particles[hit.index], x, y, std::cos(angle), std::sin(angle)), first, 1e-9);
+    }
+  }
+
+  // more neighbours than there are particles is just everyone
+  std::vector<SpatialIndex<V>::Hit> everyone;
+  index.nearest(0, 0, 10000, everyone);
+  ASSERT_EQ(everyone.size(), particles.size());
+}
+
+TEST(SpatialIndexTest, QueriesWhileRunning) {
+  auto settings = Simulation::DefaultSettings<double>;
+  auto context = make_context<V>(settings, 1000, 1000, 1000);
+  auto& sim = *context;
+  for (size_t i = 0; i < 500; i++) {
+    Util::CounterRng gen(SPATIAL_SEED, i, 2);
+    sim.add_particle(Particle<V>(5, 1, V(gen.uniform(-200, 200), gen.uniform(-200, 200), 0),
+                                 V(40 * static_cast<double>(i % 20) - 400, 40 * static_cast<double>(i / 20) - 400, 0)));
+  }
+  sim.commit_particles();
+
+  // everyone asks about whatever frame is newest, and the answer has to be right for that frame
+  std::atomic<bool> done{false};
+  std::atomic<size_t> queries{0};
+  std::atomic<size_t> wrong{0};
+  std::vector<std::thread> readers;
+  for (size_t t = 0; t < 3; t++) {
+    readers.emplace_back([&, t]() {
+      for (uint64_t q = 0; !done.load(); q++) {
+        Util::CounterRng gen(SPATIAL_SEED + t, q, 3);
+        const double x = gen.uniform(-500, 500);
+        const double y = gen.uniform(-500, 500);
+        const auto index = sim.query();
+        std::vector<size_t> found;
+        index->within(x, y, 60, found);
+        size_t expected = 0;
+        for (const auto& p : index->particles()) {
+          expected += (distance(p, x, y) <= 60);
+        }
+        wrong += (found.size() != expected);
+        queries++;
+      }
+    });
+  }
+
+  for (size_t step = 0; step < 300; step++) {
+    sim.run();
+  }
+  done = true;
+  for (auto& reader : readers) {
+    reader.join();
+  }
+
+  ASSERT_GT(queries.load(), 0u);
+  ASSERT_EQ(wrong.load(), 0u);
+  // the index is of the newest frame
+  ASSERT_EQ(sim.query()->frame(), sim.get_frame());
+  ASSERT_EQ(sim.query(), sim.query());
+}
+
+TEST(SpatialIndexTest, QueriesPerSecond) {
+  const size_t n = bench_size("SIM_BENCH_SPATIAL_N", 100000);
+  const auto frame = scatter(n);
+  const size_t queries = 2000;
+
+  Timer<chrono::microseconds> build_timer;
+  build_timer.start();
+  SpatialIndex<V> index(frame);
+  build_timer.stop();
+
+  // the same radius searches, by scanning and through the index
+  Timer<chrono::microseconds> scan_timer;
+  Timer<chrono::microseconds> index_timer;
+  Timer<chrono::microseconds> nearest_timer;
+  Timer<chrono::microseconds> ray_timer;
+  size_t scanned = 0;
+  size_t indexed = 0;
+  std::vector<size_t> found;
+  std::vector<SpatialIndex<V>::Hit> nearest;
+  SpatialIndex<V>::Hit hit;
+  size_t hits = 0;
+
+  scan_timer.start();
+  for (size_t q = 0; q < queries; q++) {
+    Util::CounterRng gen(SPATIAL_SEED, q, 4);
+    const double x = gen.uniform(-500, 500);
+    const double y = gen.uniform(-500, 500);
+    for (const auto& p : *frame) {
+      scanned += (distance(p, x, y) <= 20);
+    }
+  }
+  scan_timer.stop();
+
+  index_timer.start();
+  for (size_t q = 0; q < queries; q++) {
+    Util::CounterRng gen(SPATIAL_SEED, q, 4);
+    const double x = gen.uniform(-500, 500);
+    const double y = gen.uniform(-500, 500);
+    found.clear();
+    index.within(x, y, 20, found);
+    indexed += found.size();
+  }
+  index_timer.stop();
+
+  nearest_timer.start();
+  for (size_t q = 0; q < queries; q++) {
+    Util::CounterRng gen(SPATIAL_SEED, q, 4);
+    index.nearest(gen.uniform(-500, 500), gen.uniform(-500, 500), 8, nearest);
+  }
+  nearest_timer.stop();
+
+  ray_timer.start();
+  for (size_t q = 0; q < queries; q++) {
+    Util::CounterRng gen(SPATIAL_SEED, q, 4);
+    const double angle = gen.uniform(0, 2 * M_PI);
+    hits += index.ray_cast(gen.uniform(-500, 500), gen.uniform(-500, 500), std::cos(angle), std::sin(angle), 2000, hit);
+  }
+  ray_timer.stop();
+
+  auto qps = [queries](Timer<chrono::microseconds>& timer) {
+    return static_cast<double>(queries) * 1e6 / static_cast<double>(std::max<int64_t>(1, timer.max().count()));
+  };
+  std::cout << "n = " << n << ", " << index.cell_count() << " cells built in " << build_timer.max().count() << "us" << std::endl;
+  std::cout << "radius 20, scanning: " << qps(scan_timer) << " queries/s" << std::endl;
+  std::cout << "radius 20, indexed:  " << qps(index_timer) << " queries/s" << std::endl;
+  std::cout << "8 nearest:           " << qps(nearest_timer) << " queries/s" << std::endl;
+  std::cout << "ray cast:            " << qps(ray_timer) << " queries/s, " << hits << " hits" << std::endl;
+
+  ASSERT_EQ(indexed, scanned);
+  // at this size, an index that isn't two orders of magnitude better than looking at everyone isn't doing its job
+  if (n >= 100000) {
+    ASSERT_LT(index_timer.max() * 100, scan_timer.max());
+  }
+}
@@ -0,0 +1,219 @@
+#include "sim_setup.h"
+#include "stream.h"
+#include "util/random.h"
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <cstring>
+#include <gtest/gtest.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+// The wire format, and a server feeding viewers while the simulation runs
+
+using Component::Particle;
+using Util::QuantizedParticle;
+
+typedef Component::Vector<double> V;
+
+static constexpr uint64_t STREAM_SEED = 0x57EA;
+
+// the simulation's or a viewer's particles, as they'd go over the wire
+template<typename P>
+static std::vector<QuantizedParticle> quantize(const std::vector<P>& particles) {
+  std::vector<QuantizedParticle> out;
+  for (const auto& p : particles) {
+    out.push_back({p.uid.get(), Util::quantize(static_cast<double>(p.position().x())), Util::quantize(static_cast<double>(p.position().y())),
+                   static_cast<uint32_t>(Util::quantize(static_cast<double>(p.radius())))});
+  }
+  return out;
+}
+
+static bool same(const std::vector<QuantizedParticle>& a, const std::vector<QuantizedParticle>& b) {
+  if (a.size() != b.size()) {
+    return false;
+  }
+  for (size_t i = 0; i < a.size(); i++) {
+    if (a[i].uid != b[i].uid or a[i].x != b[i].x or a[i].y != b[i].y or a[i].radius != b[i].radius) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// decode everything in one buffer of frames, in order
+static bool decode_all(const std::vector<uint8_t>& bytes, std::vector<QuantizedParticle>& state, size_t& frames) {
+  size_t at = 0;
+  while (at < bytes.size()) {
+    Util::FrameHeader header;
+    if (bytes.size() - at < sizeof(header)) {
+      return false;
+    }
+    std::memcpy(&header, bytes.data() + at, sizeof(header));
+    at += sizeof(header);
+    if (!Util::check_header(header) or bytes.size() - at < header.payload_bytes or
+        !Util::decode_frame(header, bytes.data() + at, state)) {
+      return false;
+    }
+    at += header.payload_bytes;
+    frames++;
+  }
+  return true;
+}
+
+TEST(StreamTest, DeltasAddUp) {
+  // a frame, then particles wander, leave and arrive, the way they do between steps
+  std::vector<QuantizedParticle> frame;
+  for (uint64_t i = 0; i < 500; i++) {
+    Util::CounterRng gen(STREAM_SEED, i);
+    frame.push_back({i + 1, Util::quantize(gen.uniform(-800, 800)), Util::quantize(gen.uniform(-500, 500)),
+                     static_cast<uint32_t>(Util::quantize(gen.uniform(1, 20)))});
+  }
+
+  std::vector<uint8_t> key;
+  Util::encode_frame(1, 1600, 1000, {}, frame, key);
+  std::vector<QuantizedParticle> state;
+  size_t frames = 0;
+  ASSERT_TRUE(decode_all(key, state, frames));
+  ASSERT_TRUE(same(state, frame));
+
+  std::vector<uint8_t> deltas;
+  uint64_t next_uid = 501;
+  for (uint64_t f = 0; f < 20; f++) {
+    auto next = frame;
+    for (size_t i = 0; i < next.size(); i++) {
+      Util::CounterRng gen(STREAM_SEED, i, f + 1);
+      next[i].x += static_cast<int32_t>(gen.uniform_int(-40, 40));
+      next[i].y += static_cast<int32_t>(gen.uniform_int(-40, 40));
+    }
+    // the last swapped into the gap, and someone new on the end
+    next[f * 7] = next.back();
+    next.pop_back();
+    next.push_back({next_uid++, 0, 0, 160});
+
+    const size_t before = deltas.size();
+    Util::encode_frame(f + 2, 1600, 1000, frame, next, deltas);
+    // a couple of bytes a particle rather than 20
+    ASSERT_LT(deltas.size() - before, next.size() * 5);
+    frame = next;
+  }
+  ASSERT_TRUE(decode_all(deltas, state, frames));
+  ASSERT_EQ(frames, 21u);
+  ASSERT_TRUE(same(state, frame));
+
+  // cut short, or against the wrong frame
+  std::vector<uint8_t> truncated(key.begin(), key.end() - 3);
+  std::vector<QuantizedParticle> junk;
+  frames = 0;
+  ASSERT_FALSE(decode_all(truncated, junk, frames));
+  std::vector<uint8_t> delta;
+  Util::encode_frame(2, 1600, 1000, frame, frame, delta);
+  junk.clear();
+  ASSERT_FALSE(decode_all(delta, junk, frames));
+
+  // claiming more payload than its particles could take, or than any frame of ours
+  Util::FrameHeader header;
+  std::memcpy(&header, key.data(), sizeof(header));
+  ASSERT_TRUE(Util::check_header(header));
+  header.payload_bytes = static_cast<uint32_t>(header.count * Util::FRAME_MAX_PARTICLE_BYTES + 1);
+  ASSERT_FALSE(Util::check_header(header));
+  header.count = 0xFFFFFFFF;
+  header.payload_bytes = 0xFFFFFFFF;
+  ASSERT_FALSE(Util::check_header(header));
+}
+
+TEST(StreamTest, Addresses) {
+  ASSERT_EQ(Stream::check_address("unix:/tmp/sim.sock"), Status::Success);
+  ASSERT_EQ(Stream::check_address("tcp:7070"), Status::Success);
+  for (const char* bad : {"", "unix:", "tcp:", "tcp:0", "tcp:70000", "tcp:12ab", "udp:7070", "/tmp/sim.sock"}) {
+    ASSERT_EQ(Stream::check_address(bad), Status::Failure) << bad;
+  }
+}
+
+TEST(StreamTest, SlowViewersDontHoldAnyoneUp) {
+  auto settings = Simulation::DefaultSettings<double>;
+  auto context = make_context<V>(settings, 1600, 1000, 1000);
+  auto& sim = *context;
+  for (size_t i = 0; i < 2000; i++) {
+    Util::CounterRng gen(STREAM_SEED, i, 1);
+    sim.add_particle(Particle<V>(3, 1, V(gen.uniform(-300, 300), gen.uniform(-300, 300), 0),
+                                 V(gen.uniform(-780, 780), gen.uniform(-480, 480), 0)));
+  }
+  sim.commit_particles();
+
+  const std::string path = ::testing::TempDir() + "sim_stream.sock";
+  const std::string address = "unix:" + path;
+  Stream::Server<V> server(sim);
+  ASSERT_EQ(server.start(address), Status::Success);
+
+  Stream::Client viewer;
+  ASSERT_EQ(viewer.connect(address), Status::Success);
+
+  // and one who never reads a thing, with as little room as the kernel will give them
+  const int stalled = ::socket(AF_UNIX, SOCK_STREAM, 0);
+  const int tiny = 1;
+  ::setsockopt(stalled, SOL_SOCKET, SO_RCVBUF, &tiny, sizeof(tiny));
+  sockaddr_un un{};
+  un.sun_family = AF_UNIX;
+  std::strncpy(un.sun_path, path.c_str(), sizeof(un.sun_path) - 1);
+  ASSERT_EQ(::connect(stalled, reinterpret_cast<const sockaddr*>(&un), sizeof(un)), 0);
+
+  // about a second of simulation, in real time
+  for (size_t step = 0; step < 100; step++) {
+    sim.run();
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  ASSERT_EQ(server.client_count(), 2u);
+  ASSERT_GT(server.frames_skipped(), 0u);
+
+  // the viewer catches up with the last frame, exactly as quantized
+  const auto expected = quantize(*sim.get_frame());
+  for (size_t wait = 0; wait < 200 and !same(quantize(*viewer.get_frame()), expected); wait++) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  ASSERT_TRUE(viewer.connected());
+  ASSERT_GT(viewer.frames(), 10u);
+  ASSERT_EQ(viewer.width(), 1600u);
+  const auto& seen = *viewer.get_frame();
+  ASSERT_EQ(seen.size(), 2000u);
+  for (size_t i = 0; i < seen.size(); i++) {
+    ASSERT_EQ(seen[i].uid.get(), sim.get_frame()->at(i).uid.get());
+  }
+
+  // and so does the slow one once it starts reading, having skipped whatever it didn't have room for
+  std::vector<QuantizedParticle> state;
+  std::vector<uint8_t> bytes;
+  size_t frames = 0;
+  for (size_t wait = 0; wait < 200 and !same(state, expected); wait++) {
+    uint8_t chunk[1 << 16];
+    ssize_t n;
+    while ((n = ::recv(stalled, chunk, sizeof(chunk), MSG_DONTWAIT)) > 0) {
+      bytes.insert(bytes.end(), chunk, chunk + n);
+    }
+    // only whole frames
+    size_t whole = 0;
+    for (size_t at = 0; bytes.size() - at >= sizeof(Util::FrameHeader);) {
+      Util::FrameHeader header;
+      std::memcpy(&header, bytes.data() + at, sizeof(header));
+      if (bytes.size() - at - sizeof(header) < header.payload_bytes) {
+        break;
+      }
+      at += sizeof(header) + header.payload_bytes;
+      whole = at;
+    }
+    ASSERT_TRUE(decode_all(std::vector<uint8_t>(bytes.begin(), bytes.begin() + static_cast<ptrdiff_t>(whole)), state, frames));
+    bytes.erase(bytes.begin(), bytes.begin() + static_cast<ptrdiff_t>(whole));
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  ASSERT_TRUE(same(state, expected));
+  ASSERT_LT(frames, viewer.frames());
+
+  ::close(stalled);
+  viewer.disconnect();
+  server.stop();
+  ASSERT_NE(::access(path.c_str(), F_OK), 0);
+}
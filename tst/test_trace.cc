@@ -0,0 +1,118 @@
+#include "util/trace.h"
+
+// only so boost/bind.hpp keeps quiet
+#define BOOST_BIND_GLOBAL_PLACEHOLDERS
+#include <boost/property_tree/json_parser.hpp>
+#include <boost/property_tree/ptree.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <gtest/gtest.h>
+#include <map>
+#include <string>
+#include <thread>
+
+// The Chrome trace, as chrome://tracing would read it
+
+namespace pt = boost::property_tree;
+
+struct Recorded {
+  double ts;
+  double dur;
+  std::string ph;
+  int tid;
+};
+
+TEST(TraceTest, WritesValidNestedSpans) {
+  Util::Trace::enable();
+  Util::Trace::set_thread_name("test_main");
+  {
+    TRACE_SPAN("trace_outer");
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    {
+      TRACE_SPAN("trace_inner");
+      Util::Trace::instant("trace_instant");
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  std::thread([]() {
+    Util::Trace::set_thread_name("test_worker");
+    TRACE_SPAN("trace_worker");
+  }).join();
+
+  const std::string path = ::testing::TempDir() + "sim_trace.json";
+  ASSERT_TRUE(Util::Trace::write(path));
+
+  // has to parse at all
+  pt::ptree trace;
+  ASSERT_NO_THROW(pt::read_json(path, trace));
+
+  std::map<std::string, Recorded> events;
+  std::map<int, std::string> threads;
+  for (const auto& child : trace.get_child("traceEvents")) {
+    const auto& e = child.second;
+    const auto ph = e.get<std::string>("ph");
+    if (ph == "M") {
+      threads[e.get<int>("tid")] = e.get<std::string>("args.name");
+      continue;
+    }
+    events[e.get<std::string>("name")] = {e.get<double>("ts"), e.get<double>("dur", 0), ph, e.get<int>("tid")};
+  }
+
+  ASSERT_EQ(events.count("trace_outer"), 1u);
+  ASSERT_EQ(events.count("trace_inner"), 1u);
+  ASSERT_EQ(events.count("trace_instant"), 1u);
+  ASSERT_EQ(events.count("trace_worker"), 1u);
+  const auto& outer = events["trace_outer"];
+  const auto& inner = events["trace_inner"];
+  const auto& instant = events["trace_instant"];
+
+  // spans are complete events, each begins and ends inside whatever it was opened in
+  ASSERT_EQ(outer.ph, "X");
+  ASSERT_EQ(inner.ph, "X");
+  ASSERT_GE(outer.dur, 3000);
+  ASSERT_GE(inner.dur, 1000);
+  ASSERT_LE(outer.ts, inner.ts);
+  ASSERT_LE(inner.ts + inner.dur, outer.ts + outer.dur);
+  ASSERT_EQ(instant.ph, "i");
+  ASSERT_GE(instant.ts, inner.ts);
+  ASSERT_LE(instant.ts, inner.ts + inner.dur);
+
+  // and on their own thread's track
+  ASSERT_EQ(threads[outer.tid], "test_main");
+  ASSERT_EQ(threads[events["trace_worker"].tid], "test_worker");
+  ASSERT_NE(outer.tid, events["trace_worker"].tid);
+}
+
+TEST(TraceTest, WritesWhileRecording) {
+  Util::Trace::enable();
+
+  // someone busy wrapping their buffer the whole time, like a detached simulation thread at exit
+  std::atomic<bool> done{false};
+  std::thread worker([&done]() {
+    Util::Trace::set_thread_name("test_busy");
+    while (!done) {
+      TRACE_SPAN("trace_busy");
+    }
+  });
+
+  const std::string path = ::testing::TempDir() + "sim_trace_busy.json";
+  for (size_t i = 0; i < 3; i++) {
+    ASSERT_TRUE(Util::Trace::write(path));
+    pt::ptree trace;
+    ASSERT_NO_THROW(pt::read_json(path, trace));
+    for (const auto& child : trace.get_child("traceEvents")) {
+      const auto& e = child.second;
+      if (e.get<std::string>("ph") == "X") {
+        ASSERT_GE(e.get<double>("dur"), 0);
+      }
+    }
+  }
+  done = true;
+  worker.join();
+
+  // and recording carries on afterwards
+  ASSERT_TRUE(Util::Trace::enabled());
+  std::remove(path.c_str());
+}
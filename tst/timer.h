@@ -2,6 +2,8 @@
 
 #include <algorithm>
 #include <chrono>
+#include <cstddef>
+#include <cstdlib>
 #include <iostream>
 #include <numeric>
 #include <string>
@@ -9,6 +11,12 @@
 
 namespace chrono = std::chrono;
 
+// How big a benchmark to run, from the environment variable `name` (scientific notation is fine, 1e6) or the fallback
+inline size_t bench_size(const char* name, size_t fallback) {
+  const char* value = std::getenv(name);
+  return (value == nullptr) ? fallback : static_cast<size_t>(std::atof(value));
+}
+
 template <typename TIME>
 class Timer {
 public:
@@ -38,6 +46,14 @@ public:
     return copy[n];
   }
 
+  // nearest-rank percentile, p in [0, 100]
+  TIME calculate_percentile(double p) {
+    auto copy = samples;
+    size_t n = static_cast<size_t>(p / 100.0 * static_cast<double>(copy.size() - 1) + 0.5);
+    std::nth_element(copy.begin(), copy.begin() + n, copy.end());
+    return copy[n];
+  }
+
   TIME max() {
     return *std::max_element(samples.begin(), samples.end());
   }
@@ -54,6 +70,10 @@ public:
     std::cout << "Median: " << calculate_median().count() << unit_name() << std::endl;
   }
 
+  void print_p99() {
+    std::cout << "P99: " << calculate_percentile(99).count() << unit_name() << std::endl;
+  }
+
   void print_max() {
     std::cout << "Max: " << max().count() << unit_name() << std::endl;
   }
@@ -65,10 +85,15 @@ public:
   void print_all() {
     print_average();
     print_median();
+    print_p99();
     print_max();
     print_min();
   }
 
+  size_t count() const { return samples.size(); }
+
+  void clear() { samples.clear(); }
+
 private:
   std::string unit_name() {
     return "?";